@@ -0,0 +1,107 @@
+#include "alloc_guard.h"
+
+#ifndef PANDA_ALLOC_GUARD
+
+void AllocGuard::arm() {}
+void AllocGuard::disarm() {}
+unsigned long long AllocGuard::count() { return 0; }
+bool AllocGuard::enabled() { return false; }
+
+#else
+
+#include <Eigen/Core>
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+namespace {
+thread_local bool armed = false;
+thread_local int no_alloc_depth = 0;
+std::atomic<unsigned long long> allocations(0);
+
+inline void onAllocation() {
+  if (armed) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (no_alloc_depth > 0) {
+      // reporting may allocate itself
+      armed = false;
+      fprintf(stderr, "AllocGuard: heap allocation inside ScopedNoAlloc\n");
+      assert(false);
+      armed = true;
+    }
+  }
+}
+} // namespace
+
+void AllocGuard::arm() { armed = true; }
+void AllocGuard::disarm() { armed = false; }
+unsigned long long AllocGuard::count() { return allocations.load(); }
+bool AllocGuard::enabled() { return true; }
+
+ScopedNoAlloc::ScopedNoAlloc() {
+  no_alloc_depth++;
+  _eigen_malloc_allowed = Eigen::internal::is_malloc_allowed();
+#ifndef NDEBUG
+  Eigen::internal::set_is_malloc_allowed(false);
+#endif
+}
+
+ScopedNoAlloc::~ScopedNoAlloc() {
+  no_alloc_depth--;
+  Eigen::internal::set_is_malloc_allowed(_eigen_malloc_allowed);
+}
+
+#if defined(__GLIBC__)
+// interpose the malloc family so that allocations made inside libraries
+// (hiredis, sai2) are seen as well
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *p, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+
+void *malloc(size_t size) {
+  onAllocation();
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+  onAllocation();
+  return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size) {
+  onAllocation();
+  return __libc_realloc(p, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+  onAllocation();
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **p, size_t alignment, size_t size) {
+  onAllocation();
+  *p = __libc_memalign(alignment, size);
+  return *p == nullptr ? 12 /* ENOMEM */ : 0;
+}
+}
+#else
+void *operator new(size_t size) {
+  onAllocation();
+  void *p = std::malloc(size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+#endif
+
+#endif // PANDA_ALLOC_GUARD
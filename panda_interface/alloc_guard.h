@@ -0,0 +1,34 @@
+/*
+Heap allocation guard for the control loops (build with -DPANDA_ALLOC_GUARD=ON).
+  - AllocGuard::arm() starts counting every heap allocation made by the
+    calling thread (malloc family on glibc, operator new elsewhere)
+  - ScopedNoAlloc marks code that must not allocate; in debug builds an
+    allocation inside it asserts, including Eigen temporaries
+Without PANDA_ALLOC_GUARD everything here compiles to nothing.
+*/
+
+#ifndef ALLOC_GUARD_H
+#define ALLOC_GUARD_H
+
+class AllocGuard {
+public:
+  // start / stop counting allocations made by the calling thread
+  static void arm();
+  static void disarm();
+  // allocations made on armed threads so far
+  static unsigned long long count();
+  static bool enabled();
+};
+
+class ScopedNoAlloc {
+public:
+#ifdef PANDA_ALLOC_GUARD
+  ScopedNoAlloc();
+  ~ScopedNoAlloc();
+
+private:
+  bool _eigen_malloc_allowed;
+#endif
+};
+
+#endif // ALLOC_GUARD_H
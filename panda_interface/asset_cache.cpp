@@ -0,0 +1,664 @@
+#include "asset_cache.h"
+
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <climits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+// part of every mesh hash, bump when the conversion changes
+const char cache_format[] = "obj-3ds-1";
+
+// 3ds chunks
+const uint16_t CHUNK_MAIN = 0x4D4D;
+const uint16_t CHUNK_VERSION = 0x0002;
+const uint16_t CHUNK_EDITOR = 0x3D3D;
+const uint16_t CHUNK_MESH_VERSION = 0x3D3E;
+const uint16_t CHUNK_MASTER_SCALE = 0x0100;
+const uint16_t CHUNK_MATERIAL = 0xAFFF;
+const uint16_t CHUNK_MATERIAL_NAME = 0xA000;
+const uint16_t CHUNK_AMBIENT = 0xA010;
+const uint16_t CHUNK_DIFFUSE = 0xA020;
+const uint16_t CHUNK_SPECULAR = 0xA030;
+const uint16_t CHUNK_SHININESS = 0xA040;
+const uint16_t CHUNK_TRANSPARENCY = 0xA050;
+const uint16_t CHUNK_COLOR_24 = 0x0011;
+const uint16_t CHUNK_PERCENT = 0x0030;
+const uint16_t CHUNK_OBJECT = 0x4000;
+const uint16_t CHUNK_TRIANGLES = 0x4100;
+const uint16_t CHUNK_POINTS = 0x4110;
+const uint16_t CHUNK_FACES = 0x4120;
+const uint16_t CHUNK_FACE_MATERIAL = 0x4130;
+const uint16_t CHUNK_SMOOTHING = 0x4150;
+const uint16_t CHUNK_MESH_MATRIX = 0x4160;
+// vertices and faces per object are 16 bit
+const int max_object_vertices = 65535;
+const int max_object_faces = 65535;
+
+double seconds(chrono::steady_clock::time_point since) {
+  return chrono::duration<double>(chrono::steady_clock::now() - since).count();
+}
+
+// read-only map of a whole file
+struct MappedFile {
+  const char *data = nullptr;
+  size_t size = 0;
+
+  bool open(const string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0;
+    size = ok ? st.st_size : 0;
+    if (ok && size > 0) {
+      void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      ok = p != MAP_FAILED;
+      data = ok ? (const char *)p : nullptr;
+    }
+    ::close(fd);
+    return ok;
+  }
+  ~MappedFile() {
+    if (data != nullptr) {
+      munmap((void *)data, size);
+    }
+  }
+};
+
+uint64_t fnv1a(const char *data, size_t size, uint64_t hash) {
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ (unsigned char)data[i]) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+const uint64_t fnv1a_basis = 0xcbf29ce484222325ull;
+
+// calls f(line, length) for each line of the map, without the line end
+template <typename F> void forEachLine(const MappedFile &file, F f) {
+  const char *p = file.data;
+  const char *end = file.data + file.size;
+  while (p < end) {
+    const char *eol = (const char *)memchr(p, '\n', end - p);
+    if (eol == nullptr) {
+      eol = end;
+    }
+    size_t length = eol - p;
+    if (length > 0 && p[length - 1] == '\r') {
+      length--;
+    }
+    f(p, length);
+    p = eol + 1;
+  }
+}
+
+bool startsWith(const char *line, size_t length, const char *prefix) {
+  const size_t n = strlen(prefix);
+  return length >= n && memcmp(line, prefix, n) == 0 &&
+         (length == n || line[n] == ' ' || line[n] == '\t');
+}
+
+string directoryOf(const string &path) {
+  const size_t slash = path.rfind('/');
+  return slash == string::npos ? "." : path.substr(0, slash);
+}
+
+string baseName(const string &path) {
+  const size_t slash = path.rfind('/');
+  return slash == string::npos ? path : path.substr(slash + 1);
+}
+
+string joinPath(const string &dir, const string &path) {
+  return path.empty() || path[0] == '/' ? path : dir + "/" + path;
+}
+
+// absolute path with no symlinks or dot components, empty if it does not
+// exist
+string canonicalPath(const string &path) {
+  char buffer[PATH_MAX];
+  return realpath(path.c_str(), buffer) != nullptr ? string(buffer) : string();
+}
+
+vector<string> splitPath(const string &path) {
+  vector<string> parts;
+  stringstream stream(path);
+  string part;
+  while (getline(stream, part, '/')) {
+    if (!part.empty()) {
+      parts.push_back(part);
+    }
+  }
+  return parts;
+}
+
+// path of the file target relative to the directory from; target as it is
+// if either does not exist
+string relativePath(const string &from, const string &target) {
+  const string from_path = canonicalPath(from);
+  const string target_path = canonicalPath(target);
+  if (from_path.empty() || target_path.empty()) {
+    return target;
+  }
+  const vector<string> a = splitPath(from_path);
+  const vector<string> b = splitPath(target_path);
+  size_t common = 0;
+  while (common < a.size() && common + 1 < b.size() &&
+         a[common] == b[common]) {
+    common++;
+  }
+  string path;
+  for (size_t k = common; k < a.size(); k++) {
+    path += "../";
+  }
+  for (size_t k = common; k < b.size(); k++) {
+    path += b[k] + (k + 1 < b.size() ? "/" : "");
+  }
+  return path;
+}
+
+// writes contents to path through a temporary file, so a reader never sees
+// a partial one
+bool writeFile(const string &path, const char *data, size_t size) {
+  const string temporary = path + ".tmp";
+  FILE *file = fopen(temporary.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  const bool ok = fwrite(data, 1, size, file) == size;
+  if (fclose(file) != 0 || !ok || rename(temporary.c_str(), path.c_str())) {
+    remove(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+struct ObjMaterial {
+  string name;
+  float ambient[3] = {0.2f, 0.2f, 0.2f};
+  float diffuse[3] = {0.8f, 0.8f, 0.8f};
+  float specular[3] = {0, 0, 0};
+  float shininess = 0; // Ns, 0 .. 1000
+  float opacity = 1;   // d
+};
+
+struct ObjFace {
+  uint32_t v[3];
+  int material;
+  uint32_t smoothing;
+};
+
+// the mtllib file names of an .obj
+vector<string> materialLibraries(const MappedFile &obj) {
+  vector<string> libraries;
+  forEachLine(obj, [&](const char *line, size_t length) {
+    if (startsWith(line, length, "mtllib")) {
+      string names(line + 6, length - 6);
+      stringstream stream(names);
+      string name;
+      while (stream >> name) {
+        libraries.push_back(name);
+      }
+    }
+  });
+  return libraries;
+}
+
+void readMaterials(const string &path, vector<ObjMaterial> &materials) {
+  ifstream file(path);
+  string line;
+  while (getline(file, line)) {
+    stringstream stream(line);
+    string key;
+    stream >> key;
+    if (key == "newmtl") {
+      materials.push_back(ObjMaterial());
+      stream >> materials.back().name;
+    } else if (materials.empty()) {
+      continue;
+    } else if (key == "Ka") {
+      stream >> materials.back().ambient[0] >> materials.back().ambient[1] >>
+          materials.back().ambient[2];
+    } else if (key == "Kd") {
+      stream >> materials.back().diffuse[0] >> materials.back().diffuse[1] >>
+          materials.back().diffuse[2];
+    } else if (key == "Ks") {
+      stream >> materials.back().specular[0] >>
+          materials.back().specular[1] >> materials.back().specular[2];
+    } else if (key == "Ns") {
+      stream >> materials.back().shininess;
+    } else if (key == "d") {
+      stream >> materials.back().opacity;
+    }
+  }
+}
+
+// 3ds chunk writer, little-endian like the hosts this runs on
+class ChunkWriter {
+public:
+  void begin(uint16_t id) {
+    u16(id);
+    _open.push_back(_buffer.size());
+    u32(0); // length, set by end()
+  }
+  void end() {
+    const size_t start = _open.back() - 2;
+    _open.pop_back();
+    const uint32_t length = _buffer.size() - start;
+    memcpy(&_buffer[start + 2], &length, sizeof(length));
+  }
+  void u16(uint16_t value) { bytes(&value, sizeof(value)); }
+  void u32(uint32_t value) { bytes(&value, sizeof(value)); }
+  void f32(float value) { bytes(&value, sizeof(value)); }
+  void str(const string &value) { bytes(value.c_str(), value.size() + 1); }
+  void bytes(const void *data, size_t size) {
+    const char *p = (const char *)data;
+    _buffer.insert(_buffer.end(), p, p + size);
+  }
+  void color(uint16_t id, const float *rgb) {
+    begin(id);
+    begin(CHUNK_COLOR_24);
+    for (int k = 0; k < 3; k++) {
+      const float c = rgb[k] < 0 ? 0 : rgb[k] > 1 ? 1 : rgb[k];
+      const unsigned char byte = c * 255 + 0.5f;
+      bytes(&byte, 1);
+    }
+    end();
+    end();
+  }
+  void percent(uint16_t id, float value) {
+    begin(id);
+    begin(CHUNK_PERCENT);
+    u16(value < 0 ? 0 : value > 100 ? 100 : value + 0.5f);
+    end();
+    end();
+  }
+  const vector<char> &buffer() const { return _buffer; }
+
+private:
+  vector<char> _buffer;
+  vector<size_t> _open;
+};
+} // namespace
+
+//------------------------------------------------------------------------------
+bool hashFile(const string &path, uint64_t &hash) {
+  MappedFile file;
+  if (!file.open(path)) {
+    return false;
+  }
+  hash = fnv1a(file.data, file.size, hash);
+  return true;
+}
+
+bool convertObjTo3ds(const string &obj_path, const string &out_path) {
+  MappedFile obj;
+  if (!obj.open(obj_path)) {
+    return false;
+  }
+  vector<ObjMaterial> materials;
+  for (const string &library : materialLibraries(obj)) {
+    readMaterials(joinPath(directoryOf(obj_path), library), materials);
+  }
+
+  vector<float> positions;
+  vector<ObjFace> faces;
+  int material = -1;
+  uint32_t smoothing = 0;
+  string text;
+  vector<long> polygon;
+  bool ok = true;
+  forEachLine(obj, [&](const char *line, size_t length) {
+    if (length < 2) {
+      return;
+    }
+    // a copy, so parsing stops at the end of the line
+    text.assign(line, length);
+    const char *p = text.c_str();
+    if (startsWith(line, length, "v")) {
+      char *next;
+      p++;
+      for (int k = 0; k < 3; k++) {
+        positions.push_back(strtof(p, &next));
+        p = next;
+      }
+    } else if (startsWith(line, length, "f")) {
+      // v, v/vt, v//vn or v/vt/vn; only the position is kept
+      const long vertices = positions.size() / 3;
+      polygon.clear();
+      p++;
+      while (*p != 0) {
+        char *next;
+        const long index = strtol(p, &next, 10);
+        if (next == p) {
+          break;
+        }
+        const long vertex = index > 0 ? index - 1 : vertices + index;
+        if (vertex < 0 || vertex >= vertices) {
+          ok = false;
+          return;
+        }
+        polygon.push_back(vertex);
+        p = next;
+        while (*p != 0 && *p != ' ' && *p != '\t') {
+          p++;
+        }
+      }
+      for (size_t k = 2; k < polygon.size(); k++) {
+        ObjFace face = {{(uint32_t)polygon[0], (uint32_t)polygon[k - 1],
+                         (uint32_t)polygon[k]},
+                        material,
+                        smoothing};
+        faces.push_back(face);
+      }
+    } else if (startsWith(line, length, "usemtl")) {
+      string name;
+      stringstream(text.substr(6)) >> name;
+      material = -1;
+      for (size_t k = 0; k < materials.size(); k++) {
+        if (materials[k].name == name) {
+          material = k;
+        }
+      }
+      if (material < 0) {
+        // not in the libraries, the default colors
+        materials.push_back(ObjMaterial());
+        materials.back().name = name;
+        material = materials.size() - 1;
+      }
+    } else if (startsWith(line, length, "s")) {
+      smoothing = strtol(p + 1, nullptr, 10) != 0 ? 1 : 0;
+    }
+  });
+  if (!ok) {
+    return false;
+  }
+  // faces before any usemtl
+  for (ObjFace &face : faces) {
+    if (face.material < 0) {
+      if (materials.empty() || materials.back().name != "default") {
+        materials.push_back(ObjMaterial());
+        materials.back().name = "default";
+      }
+      face.material = materials.size() - 1;
+    }
+  }
+
+  ChunkWriter out;
+  out.begin(CHUNK_MAIN);
+  out.begin(CHUNK_VERSION);
+  out.u32(3);
+  out.end();
+  out.begin(CHUNK_EDITOR);
+  out.begin(CHUNK_MESH_VERSION);
+  out.u32(3);
+  out.end();
+  for (const ObjMaterial &m : materials) {
+    out.begin(CHUNK_MATERIAL);
+    out.begin(CHUNK_MATERIAL_NAME);
+    out.str(m.name);
+    out.end();
+    out.color(CHUNK_AMBIENT, m.ambient);
+    out.color(CHUNK_DIFFUSE, m.diffuse);
+    out.color(CHUNK_SPECULAR, m.specular);
+    out.percent(CHUNK_SHININESS, m.shininess / 10);
+    out.percent(CHUNK_TRANSPARENCY, 100 * (1 - m.opacity));
+    out.end();
+  }
+  out.begin(CHUNK_MASTER_SCALE);
+  out.f32(1);
+  out.end();
+
+  // one object per run of faces of a material, up to the 16 bit limits
+  const size_t vertices = positions.size() / 3;
+  vector<int> local(vertices), owner(vertices, -1);
+  vector<uint32_t> object_vertices;
+  vector<const ObjFace *> object_faces;
+  int objects = 0;
+  auto flush = [&](int m) {
+    if (object_faces.empty()) {
+      return;
+    }
+    out.begin(CHUNK_OBJECT);
+    out.str("o" + to_string(objects));
+    out.begin(CHUNK_TRIANGLES);
+    out.begin(CHUNK_POINTS);
+    out.u16(object_vertices.size());
+    for (uint32_t v : object_vertices) {
+      out.bytes(&positions[3 * v], 3 * sizeof(float));
+    }
+    out.end();
+    out.begin(CHUNK_MESH_MATRIX);
+    const float identity[12] = {1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0};
+    out.bytes(identity, sizeof(identity));
+    out.end();
+    out.begin(CHUNK_FACES);
+    out.u16(object_faces.size());
+    for (const ObjFace *face : object_faces) {
+      for (int k = 0; k < 3; k++) {
+        out.u16(local[face->v[k]]);
+      }
+      out.u16(7); // all edges visible
+    }
+    out.begin(CHUNK_FACE_MATERIAL);
+    out.str(materials[m].name);
+    out.u16(object_faces.size());
+    for (size_t k = 0; k < object_faces.size(); k++) {
+      out.u16(k);
+    }
+    out.end();
+    out.begin(CHUNK_SMOOTHING);
+    for (const ObjFace *face : object_faces) {
+      out.u32(face->smoothing);
+    }
+    out.end();
+    out.end();
+    out.end();
+    out.end();
+    objects++;
+    object_vertices.clear();
+    object_faces.clear();
+  };
+  for (size_t m = 0; m < materials.size(); m++) {
+    for (const ObjFace &face : faces) {
+      if (face.material != (int)m) {
+        continue;
+      }
+      if (object_vertices.size() + 3 > (size_t)max_object_vertices ||
+          object_faces.size() == (size_t)max_object_faces) {
+        flush(m);
+      }
+      for (int k = 0; k < 3; k++) {
+        const uint32_t v = face.v[k];
+        if (owner[v] != objects) {
+          owner[v] = objects;
+          local[v] = object_vertices.size();
+          object_vertices.push_back(v);
+        }
+      }
+      object_faces.push_back(&face);
+    }
+    flush(m);
+  }
+  out.end();
+  out.end();
+  return writeFile(out_path, out.buffer().data(), out.buffer().size());
+}
+
+//------------------------------------------------------------------------------
+AssetCache::AssetCache(const string &dir) : _dir(dir), _writable(true) {
+  if (mkdir(_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+    cerr << "AssetCache: cannot create " << _dir << ", loading the sources"
+         << endl;
+    _writable = false;
+  }
+}
+
+string AssetCache::mesh(const string &path) {
+  _stats.meshes++;
+  const size_t dot = path.rfind('.');
+  const string extension = dot == string::npos ? "" : path.substr(dot + 1);
+  if (!_writable || (extension != "obj" && extension != "OBJ")) {
+    return path;
+  }
+
+  // the cached mesh depends on the .obj, its materials and the conversion
+  const auto hash_start = chrono::steady_clock::now();
+  uint64_t hash = fnv1a(cache_format, sizeof(cache_format), fnv1a_basis);
+  MappedFile obj;
+  bool ok = obj.open(path);
+  if (ok) {
+    hash = fnv1a(obj.data, obj.size, hash);
+    for (const string &library : materialLibraries(obj)) {
+      // a missing library leaves the default colors, as it would the source
+      hashFile(joinPath(directoryOf(path), library), hash);
+      hash = fnv1a(library.c_str(), library.size() + 1, hash);
+    }
+  }
+  _stats.hash_time += seconds(hash_start);
+  if (!ok) {
+    _stats.failed++;
+    return path;
+  }
+
+  string stem = baseName(path);
+  stem = stem.substr(0, stem.rfind('.'));
+  char name[32];
+  snprintf(name, sizeof(name), "-%016llx.3ds", (unsigned long long)hash);
+  const string cached = _dir + "/" + stem + name;
+  if (access(cached.c_str(), R_OK) == 0) {
+    return cached;
+  }
+  const auto convert_start = chrono::steady_clock::now();
+  ok = convertObjTo3ds(path, cached);
+  _stats.convert_time += seconds(convert_start);
+  if (!ok) {
+    cerr << "AssetCache: cannot convert " << path << ", loading it as is"
+         << endl;
+    _stats.failed++;
+    return path;
+  }
+  _stats.converted++;
+  return cached;
+}
+
+/*
+The model files are rewritten tag by tag, outside of comments: the filename
+of each <mesh> (relative to the file) points to its cached mesh, relative
+to the cache directory, and the dir / path of each <model> (dir relative to
+the working directory, as SAI2 reads it) to the cache directory as given and
+the name of the cached copy of that model in it.
+*/
+string AssetCache::model(const string &path) {
+  const auto known = _models.find(path);
+  if (known != _models.end()) {
+    return known->second;
+  }
+  ifstream file(path);
+  if (!_writable || !file) {
+    return path;
+  }
+  stringstream contents;
+  contents << file.rdbuf();
+  const string source = contents.str();
+  const string source_dir = directoryOf(path);
+
+  // value range of attribute name in the tag [begin, end) of source
+  auto attribute = [&](size_t begin, size_t end, const string &name,
+                       size_t &value_begin, size_t &value_end) {
+    const string key = name + "=\"";
+    for (size_t at = source.find(key, begin); at < end;
+         at = source.find(key, at + 1)) {
+      const char before = source[at - 1];
+      if (before == ' ' || before == '\t' || before == '\n' || before == '\r') {
+        value_begin = at + key.size();
+        value_end = source.find('"', value_begin);
+        return value_end < end;
+      }
+    }
+    return false;
+  };
+  auto isTag = [&](size_t at, const string &name) {
+    return source.compare(at + 1, name.size(), name) == 0 &&
+           isspace((unsigned char)source[at + 1 + name.size()]);
+  };
+
+  string output;
+  size_t copied = 0;
+  for (size_t at = source.find('<'); at != string::npos;
+       at = source.find('<', at + 1)) {
+    if (source.compare(at, 4, "<!--") == 0) {
+      const size_t close = source.find("-->", at);
+      if (close == string::npos) {
+        break;
+      }
+      at = close;
+      continue;
+    }
+    const size_t end = source.find('>', at);
+    if (end == string::npos) {
+      break;
+    }
+    size_t begin = 0, finish = 0;
+    if (isTag(at, "mesh") && attribute(at, end, "filename", begin, finish)) {
+      const string mesh_path =
+          joinPath(source_dir, source.substr(begin, finish - begin));
+      const string cached = mesh(mesh_path);
+      output += source.substr(copied, begin - copied);
+      output += cached == mesh_path ? relativePath(_dir, mesh_path)
+                                    : baseName(cached);
+      copied = finish;
+    } else if (isTag(at, "model") && attribute(at, end, "dir", begin, finish)) {
+      size_t path_begin = 0, path_end = 0;
+      if (!attribute(at, end, "path", path_begin, path_end)) {
+        continue;
+      }
+      const string model_path =
+          joinPath(source.substr(begin, finish - begin),
+                   source.substr(path_begin, path_end - path_begin));
+      const string cached = model(model_path);
+      string dir = _dir, name = baseName(cached);
+      if (cached == model_path) {
+        // not cached (unreadable), SAI2 reports it
+        dir = source.substr(begin, finish - begin);
+        name = source.substr(path_begin, path_end - path_begin);
+      }
+      // dir and path in the order they appear
+      const bool dir_first = begin < path_begin;
+      output += source.substr(copied, (dir_first ? begin : path_begin) -
+                                          copied);
+      output += dir_first ? dir : name;
+      output += source.substr(dir_first ? finish : path_end,
+                              (dir_first ? path_begin : begin) -
+                                  (dir_first ? finish : path_end));
+      output += dir_first ? name : dir;
+      copied = dir_first ? path_end : finish;
+    }
+    at = end;
+  }
+  output += source.substr(copied);
+
+  const string cached = _dir + "/" + baseName(path);
+  if (canonicalPath(cached) == canonicalPath(path) ||
+      !writeFile(cached, output.data(), output.size())) {
+    cerr << "AssetCache: cannot write " << cached << ", loading " << path
+         << endl;
+    return _models[path] = path;
+  }
+  return _models[path] = cached;
+}
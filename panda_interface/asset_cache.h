@@ -0,0 +1,69 @@
+/*
+Asset cache of simviz_panda: the meshes of the models preconverted for a
+fast start. Sai2Graphics loads every visual mesh of the world on each
+launch, and the text .obj meshes of the arm (about 11 MB) are most of its
+startup time.
+
+AssetCache::model() maps a world or robot file and every .obj (with the
+.mtl it uses) that it references, hashes them, and converts each .obj once
+into a binary .3ds under the cache directory, with its materials. The
+cached mesh is named by the hash of its sources, so an edited mesh gets a
+new entry and the stale one is never used. The model files are rewritten
+into the cache directory, and those are what Sai2Graphics / Sai2Simulation
+load: mesh filenames become relative to the cache directory (the bare name
+of a cached mesh, a path back to the source of one that is not cached), and
+each nested <model> gets the cache directory as its dir and its cached copy
+as its path. SAI2 only loads models from files, so the kinematic tree is
+still parsed from the (small) URDF; the meshes are what the cache saves.
+*/
+
+#ifndef ASSET_CACHE_H
+#define ASSET_CACHE_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+struct AssetCacheStats {
+  int meshes = 0;          // meshes referenced
+  int converted = 0;       // converted this run (not in the cache yet)
+  int failed = 0;          // could not be converted, loaded from the source
+  double hash_time = 0;    // s, mapping and hashing the sources
+  double convert_time = 0; // s
+};
+
+class AssetCache {
+public:
+  // dir: cache directory, created if missing
+  explicit AssetCache(const std::string &dir);
+
+  // path of the cached copy of the world or robot file at path, with the
+  // meshes it references converted as needed; path itself if the cache
+  // cannot be written
+  std::string model(const std::string &path);
+
+  const AssetCacheStats &stats() const { return _stats; }
+
+private:
+  // path to load the mesh at path from: the cached .3ds of an .obj, else
+  // path itself
+  std::string mesh(const std::string &path);
+
+  std::string _dir;
+  bool _writable;
+  AssetCacheStats _stats;
+  // source to cached path of the models rewritten so far
+  std::map<std::string, std::string> _models;
+};
+
+// 64-bit FNV-1a of the contents of the file at path, through a read-only
+// map, continuing from hash; false if it cannot be read
+bool hashFile(const std::string &path, uint64_t &hash);
+
+// converts the .obj at obj_path (and the materials of its mtllib) to a
+// binary .3ds at out_path: faces grouped by material, polygons fanned into
+// triangles, objects split at the format's 65535 vertices; false if the
+// .obj cannot be read or out_path written
+bool convertObjTo3ds(const std::string &obj_path, const std::string &out_path);
+
+#endif // ASSET_CACHE_H
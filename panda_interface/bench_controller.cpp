@@ -0,0 +1,296 @@
+/*
+Micro-benchmarks of the pieces of a controller_panda tick, for before / after
+numbers on changes to the control loop:
+  cd bin/panda_interface && ./bench_controller [--benchmark_filter=<regex>]
+Run from the binary directory so ./resources/panda_arm.urdf is found. The
+robot is held at q_init_desired with a small joint velocity, the pose the
+arm is in when a shot starts; times are per call.
+*/
+
+#include "Sai2Model.h"
+#include "Sai2Primitives.h"
+#include "panda_controller.h"
+#include "redis/RedisClient.h"
+#include "redis_pipeline.h"
+#include "shot_trajectory.h"
+#include "task_models.h"
+#include "trajectory_table.h"
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+using namespace std;
+using namespace Eigen;
+
+namespace {
+const string robot_file = "./resources/panda_arm.urdf";
+const string control_link = "link7";
+const Vector3d control_point =
+    Vector3d((-PANDA_EE_LENGTH + 0.0254 / 2) * sin(M_PI / 4.0),
+             (PANDA_EE_LENGTH + 0.0254 / 2) * cos(M_PI / 4.0),
+             0.1070 + 0.0254 * 1);
+
+// a shot at psi = 60 degrees from 0.1 m, -0.05 m in the board frame
+const Vector4d cue_start_pos(0.1, -0.05, 0, 1);
+const double psi = 60 * M_PI / 180.0;
+const double t_end = 13;
+
+// the same robot for every benchmark, with an up to date model
+Sai2Model::Sai2Model *panda() {
+  static Sai2Model::Sai2Model *robot = nullptr;
+  if (robot == nullptr) {
+    robot = new Sai2Model::Sai2Model(robot_file, false);
+    robot->_q.resize(robot->dof());
+    robot->_q << 0.004, -0.44, 0.315, -1.63, 1.53, 2.15, -0.33;
+    robot->_dq = 0.1 * VectorXd::Ones(robot->dof());
+    robot->updateModel();
+  }
+  return robot;
+}
+
+// t stepping through the whole trajectory at the control rate
+double nextTime(double &t) {
+  t += 0.001;
+  if (t > t_end) {
+    t = 0;
+  }
+  return t;
+}
+} // namespace
+
+//------------------------------------------------------------------------------
+// trajectory
+static void BM_CalculatePointInTrajectory(benchmark::State &state) {
+  double t = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        calculatePointInTrajectory(nextTime(t), cue_start_pos));
+  }
+}
+BENCHMARK(BM_CalculatePointInTrajectory);
+
+static void BM_CalculateRotationInTrajectory(benchmark::State &state) {
+  double t = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(calculateRotationInTrajectory(nextTime(t), psi));
+  }
+}
+BENCHMARK(BM_CalculateRotationInTrajectory);
+
+// the baked table that replaces the two above during a shot
+static void BM_TrajectoryTableLookup(benchmark::State &state) {
+  TrajectoryTable table(0, t_end, 0.001);
+  table.reset(
+      [](double t) { return calculatePointInTrajectory(t, cue_start_pos); },
+      [](double t) { return calculateRotationInTrajectory(t, psi); });
+  while (!table.bakeStep(1000)) {
+  }
+  double t = 0;
+  Vector3d x;
+  Matrix3d rot;
+  for (auto _ : state) {
+    table.lookup(nextTime(t), x, rot);
+    benchmark::DoNotOptimize(x);
+    benchmark::DoNotOptimize(rot);
+  }
+}
+BENCHMARK(BM_TrajectoryTableLookup);
+
+// the OTG's minimum-jerk segments (controller_panda --otg), a step and a
+// pose per tick
+static void BM_ShotTrajectoryPose(benchmark::State &state) {
+  ShotTrajectory otg;
+  otg.plan(cue_start_pos, psi);
+  Vector3d x;
+  Matrix3d rot;
+  for (auto _ : state) {
+    if (otg.advance(0.001, 1)) {
+      otg.start((otg.segment() + 1) % OTG_SEGMENTS);
+    }
+    otg.pose(x, rot);
+    benchmark::DoNotOptimize(x);
+    benchmark::DoNotOptimize(rot);
+  }
+}
+BENCHMARK(BM_ShotTrajectoryPose);
+
+static void BM_RobotReachedGoal(benchmark::State &state) {
+  const Vector3d x(0.5, 0.3, 0.4), x_desired(0.5, 0.31, 0.4);
+  const Vector3d xdot(0.01, 0, 0), xddot(0, 0.01, 0);
+  const Vector3d omega(0, 0, 0.01), alpha(0.01, 0, 0);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        robotReachedGoal(x, x_desired, xdot, xddot, omega, alpha));
+  }
+}
+BENCHMARK(BM_RobotReachedGoal);
+
+//------------------------------------------------------------------------------
+// model
+static void BM_UpdateModel(benchmark::State &state) {
+  Sai2Model::Sai2Model *robot = panda();
+  for (auto _ : state) {
+    robot->updateModel();
+    benchmark::DoNotOptimize(robot->_M_inv.data());
+  }
+}
+BENCHMARK(BM_UpdateModel);
+
+static void BM_UpdateKinematics(benchmark::State &state) {
+  Sai2Model::Sai2Model *robot = panda();
+  for (auto _ : state) {
+    robot->updateKinematics();
+    benchmark::ClobberMemory();
+  }
+  robot->updateModel();
+}
+BENCHMARK(BM_UpdateKinematics);
+
+// _M_inv from the regularized mass matrix: dense inverse (the original
+// controller) vs one LDLT factorization (DynamicsCache)
+static void BM_MassMatrixInverse(benchmark::State &state) {
+  Sai2Model::Sai2Model *robot = panda();
+  MatrixXd M = robot->_M;
+  M.diagonal().array() += 0.1;
+  MatrixXd M_inv(M.rows(), M.cols());
+  for (auto _ : state) {
+    M_inv = M.inverse();
+    benchmark::DoNotOptimize(M_inv.data());
+  }
+}
+BENCHMARK(BM_MassMatrixInverse);
+
+static void BM_MassMatrixLDLT(benchmark::State &state) {
+  Sai2Model::Sai2Model *robot = panda();
+  MatrixXd M = robot->_M;
+  M.diagonal().array() += 0.1;
+  MatrixXd M_inv(M.rows(), M.cols());
+  LDLT<MatrixXd> ldlt(M.rows());
+  for (auto _ : state) {
+    ldlt.compute(M);
+    M_inv.setIdentity();
+    ldlt.solveInPlace(M_inv);
+    benchmark::DoNotOptimize(M_inv.data());
+  }
+}
+BENCHMARK(BM_MassMatrixLDLT);
+
+//------------------------------------------------------------------------------
+// tasks
+static void BM_PosOriUpdateTaskModel(benchmark::State &state) {
+  Sai2Model::Sai2Model *robot = panda();
+  Sai2Primitives::PosOriTask task(robot, control_link, control_point);
+  const MatrixXd N_prec = MatrixXd::Identity(robot->dof(), robot->dof());
+  for (auto _ : state) {
+    task.updateTaskModel(N_prec);
+    benchmark::DoNotOptimize(task._N.data());
+  }
+}
+BENCHMARK(BM_PosOriUpdateTaskModel);
+
+// posori + joint task models as the controller computes them
+static void BM_TaskModelsPosOriJoint(benchmark::State &state) {
+  Sai2Model::Sai2Model *robot = panda();
+  Sai2Primitives::PosOriTask posori_task(robot, control_link, control_point);
+  Sai2Primitives::JointTask joint_task(robot);
+  TaskModels<7> task_models(robot);
+  for (auto _ : state) {
+    task_models.updatePosOriJoint(&posori_task, &joint_task);
+    benchmark::DoNotOptimize(joint_task._N_prec.data());
+  }
+}
+BENCHMARK(BM_TaskModelsPosOriJoint);
+
+static void BM_PosOriComputeTorques(benchmark::State &state) {
+  Sai2Model::Sai2Model *robot = panda();
+  Sai2Primitives::PosOriTask task(robot, control_link, control_point);
+  task._use_velocity_saturation_flag = true;
+  task.updateTaskModel(MatrixXd::Identity(robot->dof(), robot->dof()));
+  task._desired_position = calculatePointInTrajectory(6, cue_start_pos);
+  task._desired_orientation = calculateRotationInTrajectory(6, psi);
+  VectorXd torques = VectorXd::Zero(robot->dof());
+  for (auto _ : state) {
+    task.computeTorques(torques);
+    benchmark::DoNotOptimize(torques.data());
+  }
+}
+BENCHMARK(BM_PosOriComputeTorques);
+
+static void BM_JointComputeTorques(benchmark::State &state) {
+  Sai2Model::Sai2Model *robot = panda();
+  Sai2Primitives::JointTask task(robot);
+  task._use_velocity_saturation_flag = true;
+  task._saturation_velocity = M_PI / 3 * VectorXd::Ones(robot->dof());
+  task.updateTaskModel(MatrixXd::Identity(robot->dof(), robot->dof()));
+  task._desired_position = robot->_q + 0.1 * VectorXd::Ones(robot->dof());
+  VectorXd torques = VectorXd::Zero(robot->dof());
+  for (auto _ : state) {
+    task.computeTorques(torques);
+    benchmark::DoNotOptimize(torques.data());
+  }
+}
+BENCHMARK(BM_JointComputeTorques);
+
+//------------------------------------------------------------------------------
+// serialization of the 7 commanded torques / the 7x7 mass matrix
+static void BM_EncodeJSONRedisClient(benchmark::State &state) {
+  const VectorXd tau = VectorXd::LinSpaced(7, -10.123456789, 10.987654321);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(RedisClient::encodeEigenMatrixJSON(tau));
+  }
+}
+BENCHMARK(BM_EncodeJSONRedisClient);
+
+static void BM_EncodeJSON(benchmark::State &state) {
+  const VectorXd tau = VectorXd::LinSpaced(7, -10.123456789, 10.987654321);
+  string out;
+  for (auto _ : state) {
+    RedisPipeline::encodeJSON(tau, out);
+    benchmark::DoNotOptimize(out.data());
+  }
+}
+BENCHMARK(BM_EncodeJSON);
+
+static void BM_EncodeBinary(benchmark::State &state) {
+  const VectorXd tau = VectorXd::LinSpaced(7, -10.123456789, 10.987654321);
+  string out;
+  for (auto _ : state) {
+    RedisPipeline::encodeBinary(tau, out);
+    benchmark::DoNotOptimize(out.data());
+  }
+}
+BENCHMARK(BM_EncodeBinary);
+
+static void BM_DecodeJSONRedisClient(benchmark::State &state) {
+  const string json =
+      RedisClient::encodeEigenMatrixJSON(MatrixXd(panda()->_M));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(RedisClient::decodeEigenMatrixJSON(json));
+  }
+}
+BENCHMARK(BM_DecodeJSONRedisClient);
+
+static void BM_DecodeJSON(benchmark::State &state) {
+  string json;
+  RedisPipeline::encodeJSON(panda()->_M, json);
+  MatrixXd M(7, 7);
+  for (auto _ : state) {
+    RedisPipeline::decodeJSON(json.data(), json.size(), M);
+    benchmark::DoNotOptimize(M.data());
+  }
+}
+BENCHMARK(BM_DecodeJSON);
+
+static void BM_DecodeBinary(benchmark::State &state) {
+  string binary;
+  RedisPipeline::encodeBinary(panda()->_M, binary);
+  MatrixXd M(7, 7);
+  for (auto _ : state) {
+    RedisPipeline::decodeBinary(binary.data(), binary.size(), M);
+    benchmark::DoNotOptimize(M.data());
+  }
+}
+BENCHMARK(BM_DecodeBinary);
+
+BENCHMARK_MAIN();
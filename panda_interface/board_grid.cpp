@@ -0,0 +1,125 @@
+#include "board_grid.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+double Capsule::distance(double x, double y) const {
+  double abx = bx - ax, aby = by - ay;
+  double len2 = abx * abx + aby * aby;
+  double t = len2 > 0 ? ((x - ax) * abx + (y - ay) * aby) / len2 : 0;
+  t = max(0.0, min(1.0, t));
+  return hypot(x - (ax + t * abx), y - (ay + t * aby));
+}
+
+BoardGrid::BoardGrid(double half_extent, double cell_size)
+    : _half_extent(half_extent), _cell_size(cell_size),
+      _cells(max(1, (int)ceil(2 * half_extent / cell_size))), _max_r(0),
+      _words(0) {}
+
+int BoardGrid::cellOf(double v) const {
+  int c = (int)floor((v + _half_extent) / _cell_size);
+  return max(0, min(_cells - 1, c));
+}
+
+void BoardGrid::build(const CircleSet &circles) {
+  _circles = circles;
+  _max_r = 0;
+  _words = (circles.size() + 63) / 64;
+  _cell_masks.assign(_cells * _cells * _words, 0);
+  _outside_mask.assign(_words, 0);
+  for (int i = 0; i < circles.size(); i++) {
+    const double x = circles.x[i], y = circles.y[i], r = circles.r[i];
+    const uint64_t bit = 1ull << (i % 64);
+    _max_r = max(_max_r, r);
+    if (x - r < -_half_extent || x + r > _half_extent ||
+        y - r < -_half_extent || y + r > _half_extent) {
+      _outside_mask[i / 64] |= bit;
+      continue;
+    }
+    for (int cy = cellOf(y - r); cy <= cellOf(y + r); cy++) {
+      for (int cx = cellOf(x - r); cx <= cellOf(x + r); cx++) {
+        _cell_masks[(cy * _cells + cx) * _words + i / 64] |= bit;
+      }
+    }
+  }
+}
+
+void BoardGrid::query(const Capsule &capsule, CircleQuery &out) const {
+  out.clear();
+  out.mask = _outside_mask;
+  // anything within this distance of the segment can be inside the capsule
+  const double e = capsule.reach + _max_r;
+  const double dx = capsule.bx - capsule.ax;
+  const double dy = capsule.by - capsule.ay;
+
+  // only the part of the segment within e of the grid can reach a binned
+  // circle (paths across the board run far past its edge)
+  double t0 = 0, t1 = 1;
+  const double limit = _half_extent + e;
+  for (int axis = 0; axis < 2 && t0 <= t1; axis++) {
+    double a = axis == 0 ? capsule.ax : capsule.ay;
+    double d = axis == 0 ? dx : dy;
+    if (d == 0) {
+      if (fabs(a) > limit) {
+        t1 = -1;
+      }
+      continue;
+    }
+    double ta = (-limit - a) / d;
+    double tb = (limit - a) / d;
+    t0 = max(t0, min(ta, tb));
+    t1 = min(t1, max(ta, tb));
+  }
+  if (t0 <= t1) {
+    const double ax = capsule.ax + t0 * dx, ay = capsule.ay + t0 * dy;
+    const double cx = dx * (t1 - t0), cy = dy * (t1 - t0);
+    for (int row = cellOf(min(ay, ay + cy) - e);
+         row <= cellOf(max(ay, ay + cy) + e); row++) {
+      // part of the clipped segment within e of this row's band
+      double lo = -_half_extent + row * _cell_size - e;
+      double hi = lo + _cell_size + 2 * e;
+      double s0 = 0, s1 = 1;
+      if (cy != 0) {
+        double sa = (lo - ay) / cy;
+        double sb = (hi - ay) / cy;
+        s0 = max(0.0, min(sa, sb));
+        s1 = min(1.0, max(sa, sb));
+        if (s0 > s1) {
+          continue;
+        }
+      } else if (ay < lo || ay > hi) {
+        continue;
+      }
+      double xa = ax + s0 * cx;
+      double xb = ax + s1 * cx;
+      int col0 = cellOf(min(xa, xb) - e);
+      int col1 = cellOf(max(xa, xb) + e);
+      const uint64_t *cell = &_cell_masks[(row * _cells + col0) * _words];
+      for (int c = col0; c <= col1; c++) {
+        for (int w = 0; w < _words; w++) {
+          out.mask[w] |= *cell++;
+        }
+      }
+    }
+  }
+
+  // the cells only bound the corridor, keep what the capsule really covers
+  const double len2 = dx * dx + dy * dy;
+  for (int w = 0; w < _words; w++) {
+    for (uint64_t bits = out.mask[w]; bits != 0; bits &= bits - 1) {
+      int i = w * 64 + __builtin_ctzll(bits);
+      double px = _circles.x[i] - capsule.ax;
+      double py = _circles.y[i] - capsule.ay;
+      double t = len2 > 0 ? max(0.0, min(1.0, (px * dx + py * dy) / len2)) : 0;
+      px -= t * dx;
+      py -= t * dy;
+      double reach = capsule.reach + _circles.r[i];
+      if (px * px + py * py < reach * reach) {
+        out.index.push_back(i);
+        out.circles.add(_circles.x[i], _circles.y[i], _circles.r[i]);
+      }
+    }
+  }
+}
@@ -0,0 +1,82 @@
+/*
+Uniform grid over the crokinole board (board frame, mm) for corridor
+queries: which circles (coins, posts) can a coin moving along a segment
+touch? Every cell holds a bitmask of the circles whose disk overlaps it; a
+capsule query ORs the masks of the cells along the segment, row by row, and
+returns the circles within reach of it in index order. Small enough to
+rebuild for every board.
+*/
+
+#ifndef BOARD_GRID_H
+#define BOARD_GRID_H
+
+#include <cstdint>
+#include <vector>
+
+// circles in structure-of-arrays layout
+struct CircleSet {
+  std::vector<double> x;
+  std::vector<double> y;
+  std::vector<double> r;
+
+  void add(double cx, double cy, double cr) {
+    x.push_back(cx);
+    y.push_back(cy);
+    r.push_back(cr);
+  }
+  void clear() {
+    x.clear();
+    y.clear();
+    r.clear();
+  }
+  int size() const { return x.size(); }
+};
+
+// segment from a to b; a circle of radius r is inside the capsule if its
+// center is closer than reach + r to the segment
+struct Capsule {
+  double ax, ay;
+  double bx, by;
+  double reach;
+
+  double distance(double x, double y) const;
+};
+
+// circles gathered by a query, contiguous for the narrow phase
+struct CircleQuery {
+  std::vector<int> index; // into the indexed CircleSet, ascending
+  CircleSet circles;
+  std::vector<uint64_t> mask; // scratch
+
+  void clear() {
+    index.clear();
+    circles.clear();
+  }
+};
+
+class BoardGrid {
+public:
+  // covers [-half_extent, half_extent]^2; circles reaching outside are
+  // not binned but checked by every query
+  BoardGrid(double half_extent, double cell_size);
+
+  // replaces the indexed circles with a copy of circles
+  void build(const CircleSet &circles);
+
+  // the circles inside the capsule, in index order (replaces out)
+  void query(const Capsule &capsule, CircleQuery &out) const;
+
+private:
+  int cellOf(double v) const;
+
+  double _half_extent;
+  double _cell_size;
+  int _cells; // per side
+  double _max_r;
+  CircleSet _circles;
+  int _words; // mask words per cell
+  std::vector<uint64_t> _cell_masks;
+  std::vector<uint64_t> _outside_mask;
+};
+
+#endif // BOARD_GRID_H
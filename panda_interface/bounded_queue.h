@@ -0,0 +1,76 @@
+/*
+Fixed-capacity blocking queue between pipeline stages (one thread per
+stage). The ring is allocated once; push blocks while the queue is full, so
+a slow stage holds back the one feeding it instead of letting work pile up.
+close() wakes every waiter for shutdown.
+*/
+
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+template <typename T> class BoundedQueue {
+public:
+  explicit BoundedQueue(int capacity)
+      : _items(capacity), _head(0), _size(0), _closed(false) {}
+
+  // false if the queue was closed
+  bool push(const T &item) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _not_full.wait(lock, [this] { return _closed || _size < capacity(); });
+    if (_closed) {
+      return false;
+    }
+    _items[(_head + _size++) % capacity()] = item;
+    _not_empty.notify_one();
+    return true;
+  }
+
+  // false once the queue is closed and drained
+  bool pop(T &item) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _not_empty.wait(lock, [this] { return _closed || _size > 0; });
+    return take(item);
+  }
+
+  // false if nothing is queued right now
+  bool tryPop(T &item) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return take(item);
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _closed = true;
+    _not_empty.notify_all();
+    _not_full.notify_all();
+  }
+
+  int capacity() const { return _items.size(); }
+
+private:
+  // with _mutex held
+  bool take(T &item) {
+    if (_size == 0) {
+      return false;
+    }
+    item = _items[_head];
+    _head = (_head + 1) % capacity();
+    _size--;
+    _not_full.notify_one();
+    return true;
+  }
+
+  std::vector<T> _items;
+  int _head;
+  int _size;
+  bool _closed;
+  std::mutex _mutex;
+  std::condition_variable _not_empty;
+  std::condition_variable _not_full;
+};
+
+#endif // BOUNDED_QUEUE_H
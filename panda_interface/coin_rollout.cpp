@@ -0,0 +1,286 @@
+#include "coin_rollout.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+using namespace std;
+
+void CoinBatch::resize(int worlds, int coins) {
+  this->worlds = worlds;
+  this->coins = coins;
+  const int n = worlds * coins;
+  x.resize(n);
+  y.resize(n);
+  vx.resize(n);
+  vy.resize(n);
+  state.resize(n);
+  struck.resize(n);
+  hit_opponent.resize(worlds);
+}
+
+int coinPoints(double x, double y) {
+  const double d = hypot(x, y);
+  if (d + COIN_R <= RING_15_R) {
+    return 15;
+  }
+  if (d + COIN_R <= RING_10_R) {
+    return 10;
+  }
+  return d <= BOARD_R ? 5 : 0;
+}
+
+CoinRollout::CoinRollout(const RolloutParams &params)
+    : _params(params), _x(1, 0), _y(1, 0), _identity(1, COIN_CUE),
+      _has_targets(false) {
+  allBoardPosts(_posts);
+}
+
+void CoinRollout::setBoard(const double *x, const double *y,
+                           const int *identity, int n) {
+  // slot 0 is the cue of the shot rolled out
+  _x.assign(1, 0);
+  _y.assign(1, 0);
+  _identity.assign(1, COIN_CUE);
+  _has_targets = false;
+  for (int i = 0; i < n; i++) {
+    if (identity[i] == COIN_CUE) {
+      continue;
+    }
+    _x.push_back(x[i]);
+    _y.push_back(y[i]);
+    _identity.push_back(identity[i]);
+    _has_targets |= identity[i] == COIN_HUMAN;
+  }
+}
+
+double CoinRollout::boardPoints() const {
+  double points = 0;
+  for (size_t i = 1; i < _x.size(); i++) {
+    const int p = coinPoints(_x[i], _y[i]);
+    points += _identity[i] == COIN_HUMAN ? -p : p;
+  }
+  return points;
+}
+
+void CoinRollout::expectedPoints(const ShotCandidate *shots, int count,
+                                 double *points, ThreadPool *pool) const {
+  // every shot sees the same noise (common random numbers), so the points of
+  // two shots differ by the shots and not by their draws
+  const int samples = max(1, _params.samples);
+  vector<double> speed_noise(samples), angle_noise(samples);
+  mt19937 rng(_params.seed);
+  normal_distribution<double> normal(0, 1);
+  for (int s = 0; s < samples; s++) {
+    speed_noise[s] = _params.speed_sigma * normal(rng);
+    angle_noise[s] = _params.angle_sigma * normal(rng);
+  }
+
+  auto run = [&](int k, int) {
+    thread_local CoinBatch batch;
+    thread_local vector<double> sx, sy, psi, speed, world_points;
+    sx.assign(samples, shots[k].x);
+    sy.assign(samples, shots[k].y);
+    psi.resize(samples);
+    speed.resize(samples);
+    world_points.resize(samples);
+    for (int s = 0; s < samples; s++) {
+      psi[s] = shots[k].psi + angle_noise[s];
+      speed[s] = _params.cue_speed * max(0.0, 1 + speed_noise[s]);
+    }
+    rollout(sx.data(), sy.data(), psi.data(), speed.data(), samples, batch,
+            world_points.data());
+    double sum = 0;
+    for (int s = 0; s < samples; s++) {
+      sum += world_points[s];
+    }
+    points[k] = sum / samples;
+  };
+  if (pool != nullptr) {
+    pool->parallelFor(count, run);
+  } else {
+    for (int k = 0; k < count; k++) {
+      run(k, 0);
+    }
+  }
+}
+
+void CoinRollout::rollout(const double *sx, const double *sy,
+                          const double *psi, const double *speed, int worlds,
+                          CoinBatch &batch, double *points) const {
+  const int coins = _x.size();
+  batch.resize(worlds, coins);
+  for (int w = 0; w < worlds; w++) {
+    const int base = w * coins;
+    copy(_x.begin(), _x.end(), batch.x.begin() + base);
+    copy(_y.begin(), _y.end(), batch.y.begin() + base);
+    fill_n(batch.vx.begin() + base, coins, 0.0);
+    fill_n(batch.vy.begin() + base, coins, 0.0);
+    fill_n(batch.state.begin() + base, coins, COIN_ON_BOARD);
+    fill_n(batch.struck.begin() + base, coins, 0);
+    batch.x[base] = sx[w];
+    batch.y[base] = sy[w];
+    batch.vx[base] = speed[w] * cos(psi[w]);
+    batch.vy[base] = speed[w] * sin(psi[w]);
+    batch.struck[base] = 1;
+    batch.hit_opponent[w] = 0;
+  }
+
+  const int steps = _params.max_time / _params.dt;
+  for (int k = 0; k < steps && step(batch) > 0; k++) {
+  }
+  for (int w = 0; w < worlds; w++) {
+    points[w] = score(batch, w);
+  }
+}
+
+/*
+One step of every world: each moving coin slides (semi-implicit, the
+friction taking speed off first) and may drop into the ditch or the hole,
+then every coin pair in contact with at least one of the two moving and
+every moving coin on a post is resolved, an impulse along the line of
+centers if they approach plus a push out of the overlap. Coins stop once
+friction would reverse them; no spin, no coin on coin friction.
+*/
+int CoinRollout::step(CoinBatch &batch) const {
+  const double dt = _params.dt;
+  const double dv = _params.friction * dt;
+  const double contact = 2 * COIN_R;
+  const double post_contact = COIN_R + POST_R;
+  const double edge2 = BOARD_R * BOARD_R;
+  const double hole2 = HOLE_R * HOLE_R;
+  const double hole_speed2 = _params.hole_speed * _params.hole_speed;
+  const double coin_impulse = 0.5 * (1 + _params.restitution);
+  const double post_impulse = 1 + _params.post_restitution;
+  const int coins = batch.coins;
+
+  int moving = 0;
+  for (int w = 0; w < batch.worlds; w++) {
+    double *x = &batch.x[w * coins];
+    double *y = &batch.y[w * coins];
+    double *vx = &batch.vx[w * coins];
+    double *vy = &batch.vy[w * coins];
+    uint8_t *state = &batch.state[w * coins];
+    uint8_t *struck = &batch.struck[w * coins];
+
+    for (int i = 0; i < coins; i++) {
+      if (state[i] != COIN_ON_BOARD || (vx[i] == 0 && vy[i] == 0)) {
+        continue;
+      }
+      const double v = sqrt(vx[i] * vx[i] + vy[i] * vy[i]);
+      if (v <= dv) {
+        vx[i] = vy[i] = 0;
+        continue;
+      }
+      const double f = 1 - dv / v;
+      vx[i] *= f;
+      vy[i] *= f;
+      x[i] += vx[i] * dt;
+      y[i] += vy[i] * dt;
+      const double r2 = x[i] * x[i] + y[i] * y[i];
+      if (r2 > edge2) {
+        state[i] = COIN_IN_DITCH;
+      } else if (r2 < hole2 && v * v < hole_speed2) {
+        state[i] = COIN_IN_HOLE;
+      }
+    }
+
+    for (int i = 0; i < coins; i++) {
+      if (state[i] != COIN_ON_BOARD) {
+        continue;
+      }
+      for (int j = i + 1; j < coins; j++) {
+        if (state[j] != COIN_ON_BOARD ||
+            (vx[i] == 0 && vy[i] == 0 && vx[j] == 0 && vy[j] == 0)) {
+          continue;
+        }
+        const double dx = x[j] - x[i];
+        const double dy = y[j] - y[i];
+        const double d2 = dx * dx + dy * dy;
+        if (d2 >= contact * contact) {
+          continue;
+        }
+        const double d = sqrt(d2);
+        const double nx = d > 0 ? dx / d : 1;
+        const double ny = d > 0 ? dy / d : 0;
+        const double approach = (vx[i] - vx[j]) * nx + (vy[i] - vy[j]) * ny;
+        if (approach > 0) {
+          const double impulse = coin_impulse * approach;
+          vx[i] -= impulse * nx;
+          vy[i] -= impulse * ny;
+          vx[j] += impulse * nx;
+          vy[j] += impulse * ny;
+        }
+        const double push = 0.5 * (contact - d);
+        x[i] -= push * nx;
+        y[i] -= push * ny;
+        x[j] += push * nx;
+        y[j] += push * ny;
+        if (struck[i] || struck[j]) {
+          if (_identity[i] == COIN_HUMAN || _identity[j] == COIN_HUMAN) {
+            batch.hit_opponent[w] = 1;
+          }
+          struck[i] = struck[j] = 1;
+        }
+      }
+    }
+
+    for (int i = 0; i < coins; i++) {
+      if (state[i] != COIN_ON_BOARD || (vx[i] == 0 && vy[i] == 0)) {
+        continue;
+      }
+      for (int p = 0; p < _posts.size(); p++) {
+        const double dx = x[i] - _posts.x[p];
+        const double dy = y[i] - _posts.y[p];
+        const double d2 = dx * dx + dy * dy;
+        if (d2 >= post_contact * post_contact || d2 == 0) {
+          continue;
+        }
+        const double d = sqrt(d2);
+        const double nx = dx / d;
+        const double ny = dy / d;
+        const double normal = vx[i] * nx + vy[i] * ny;
+        if (normal < 0) {
+          vx[i] -= post_impulse * normal * nx;
+          vy[i] -= post_impulse * normal * ny;
+        }
+        x[i] = _posts.x[p] + post_contact * nx;
+        y[i] = _posts.y[p] + post_contact * ny;
+      }
+      moving++;
+    }
+  }
+  return moving;
+}
+
+/*
+Crokinole's rules on the shot: if there are opponent coins on the board the
+shot has to hit one, directly or through other coins, else the cue and the
+robot coins it moved are removed; if there are none the cue has to end
+inside the 15 ring (or in the hole) to stay.
+*/
+double CoinRollout::score(const CoinBatch &batch, int world) const {
+  const int base = world * batch.coins;
+  const bool foul = _has_targets && !batch.hit_opponent[world];
+  double points = 0;
+  for (int i = 0; i < batch.coins; i++) {
+    const uint8_t state = batch.state[base + i];
+    if (state == COIN_IN_DITCH) {
+      continue;
+    }
+    const int p = state == COIN_IN_HOLE
+                      ? 20
+                      : coinPoints(batch.x[base + i], batch.y[base + i]);
+    if (_identity[i] == COIN_HUMAN) {
+      points -= p;
+      continue;
+    }
+    if ((foul && batch.struck[base + i]) ||
+        (i == 0 && !_has_targets && p < 15)) {
+      continue;
+    }
+    points += p;
+  }
+  return points;
+}
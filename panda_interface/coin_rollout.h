@@ -0,0 +1,113 @@
+/*
+Coin rollout: fixed-timestep 2D dynamics of the coins on the board, to score
+planned shots by the points they leave on the board instead of by the
+straight-line checks of the planner alone. Coins slide with a constant
+friction deceleration, collide with each other through restitution impulses
+(equal masses) and bounce off the eight posts. A coin whose center crosses
+the board edge drops into the ditch; one that crosses the 20 hole slowly
+enough drops into it.
+
+The coins of a batch of boards (worlds) are kept structure-of-arrays, world
+after world, and all worlds of a batch step together. expectedPoints runs
+one batch per candidate shot, each world the shot with its own execution
+noise, and spreads the candidates over a ThreadPool. Board frame, mm, mm/s.
+*/
+
+#ifndef COIN_ROLLOUT_H
+#define COIN_ROLLOUT_H
+
+#include "shot_planner.h"
+
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+// scoring zones: the 20 hole, the 15 ring (the posts stand on it) and the 10
+// ring; the 5 zone reaches to the board edge
+const double HOLE_R = 17.4625;
+const double RING_15_R = POST_RING_R;
+const double RING_10_R = 2 * POST_RING_R;
+
+// coin states in a rollout
+#define COIN_ON_BOARD 0
+#define COIN_IN_HOLE 1
+#define COIN_IN_DITCH 2
+
+struct RolloutParams {
+  double dt = 0.001;             // s
+  double max_time = 4;           // s, coins still moving stay where they are
+  double friction = 2000;        // sliding deceleration, mm/s^2
+  double restitution = 0.8;      // coin - coin
+  double post_restitution = 0.5; // coin - post
+  // coins faster than this pass over the 20 hole, mm/s
+  double hole_speed = 300;
+  // speed of the cue coin off the end effector, mm/s (about the controller's
+  // default hit velocity)
+  double cue_speed = 1350;
+  // execution noise of a shot: relative speed and angle (rad) standard
+  // deviations, and the rollouts per shot
+  double speed_sigma = 0.1;
+  double angle_sigma = 0.01;
+  int samples = 16;
+  unsigned seed = 1;
+};
+
+// coins of a batch of worlds, index world * coins + coin; coin 0 is the cue
+struct CoinBatch {
+  int worlds = 0;
+  int coins = 0;
+  std::vector<double> x, y;
+  std::vector<double> vx, vy;
+  std::vector<uint8_t> state;
+  // set in motion, directly or through other coins, by the cue
+  std::vector<uint8_t> struck;
+  // per world: a struck coin touched an opponent coin
+  std::vector<uint8_t> hit_opponent;
+
+  void resize(int worlds, int coins);
+};
+
+// points of a coin at rest at (x, y): the zone it is entirely inside, a coin
+// on a line scores the lower zone
+int coinPoints(double x, double y);
+
+class CoinRollout {
+public:
+  explicit CoinRollout(const RolloutParams &params = RolloutParams());
+
+  // replaces the board; cue coins on it are ignored, as by the planner
+  void setBoard(const double *x, const double *y, const int *identity, int n);
+
+  // robot minus human points of the board as it is
+  double boardPoints() const;
+
+  // robot minus human points after each shot (the cue at x, y shot at psi),
+  // averaged over params().samples rollouts with execution noise; the same
+  // shots on the same board always give the same points
+  void expectedPoints(const ShotCandidate *shots, int count, double *points,
+                      ThreadPool *pool = nullptr) const;
+
+  // rolls out one shot per world, until every coin has stopped or max_time,
+  // and fills the robot minus human points each world ends with
+  void rollout(const double *sx, const double *sy, const double *psi,
+               const double *speed, int worlds, CoinBatch &batch,
+               double *points) const;
+
+  const RolloutParams &params() const { return _params; }
+
+private:
+  // one timestep of every world; returns the coins still moving
+  int step(CoinBatch &batch) const;
+  // robot minus human points, after the foul rules, of one world at rest
+  double score(const CoinBatch &batch, int world) const;
+
+  RolloutParams _params;
+  // board coins (without the cue), structure-of-arrays
+  std::vector<double> _x, _y;
+  std::vector<int> _identity;
+  bool _has_targets;
+  CircleSet _posts;
+};
+
+#endif // COIN_ROLLOUT_H
@@ -0,0 +1,86 @@
+/*
+Keeps the board state in redis up to date: runs the VisionPipeline on the
+overhead camera and writes every voted coin list to BOARD_COINS_KEY as one
+binary message (see encodeCoinMessage), which readBoardCoins in
+src/coins_updater.py decodes. The state machine then reads the board
+without waiting for a capture.
+
+  ./coin_vision [--device <index>] [--window <frames>] [--roi]
+
+--roi detects on the board region only, coarse to fine (see VisionPipeline);
+the detection time per frame is printed on exit for comparing the two.
+*/
+
+#include "options.h"
+#include "redis/RedisClient.h"
+#include "redis_pipeline.h"
+#include "vision_pipeline.h"
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <signal.h>
+bool runloop = true;
+void sighandler(int sig) { runloop = false; }
+
+using namespace std;
+
+const string BOARD_COINS_KEY = "boardcoins";
+
+int main(int argc, char **argv) {
+  VisionConfig config;
+  config.device = optionValue(argc, argv, "--device", config.device);
+  config.window = optionValue(argc, argv, "--window", config.window);
+  config.roi = hasOption(argc, argv, "--roi");
+
+  auto redis_client = RedisClient();
+  redis_client.connect();
+
+  signal(SIGABRT, &sighandler);
+  signal(SIGTERM, &sighandler);
+  signal(SIGINT, &sighandler);
+
+  // written from the classify thread only
+  string message;
+  message.reserve(COIN_MESSAGE_HEADER_SIZE +
+                  VISION_MAX_COINS * COIN_MESSAGE_COIN_SIZE);
+  RedisPipeline redis_pipeline(redis_client);
+  redis_pipeline.addWrite(BOARD_COINS_KEY, &message);
+
+  VisionPipeline pipeline(config, [&](const CoinList &coins) {
+    encodeCoinMessage(coins, message);
+    redis_pipeline.write();
+  });
+  try {
+    pipeline.start();
+  } catch (const runtime_error &e) {
+    cerr << e.what() << endl;
+    return 1;
+  }
+
+  auto start = chrono::steady_clock::now();
+  while (runloop) {
+    this_thread::sleep_for(chrono::milliseconds(100));
+  }
+  pipeline.stop();
+
+  double elapsed =
+      chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  cout << "\n";
+  cout << "Vision pipeline run time  : " << elapsed << " seconds\n";
+  cout << "Vision pipeline frames    : " << pipeline.captured() << " captured, "
+       << pipeline.dropped() << " dropped, " << pipeline.classified()
+       << " classified\n";
+  cout << "Vision pipeline frequency : " << pipeline.classified() / elapsed
+       << "Hz\n";
+  const LatencyHistogram &detect = pipeline.detectTime();
+  cout << "Vision pipeline detection (" << (config.roi ? "roi" : "full frame")
+       << "), ms per frame : mean " << detect.mean() * 1e-6 << ", p50 "
+       << detect.percentile(50) * 1e-6 << ", p99 "
+       << detect.percentile(99) * 1e-6 << ", max " << detect.max() * 1e-6
+       << "\n";
+  return 0;
+}
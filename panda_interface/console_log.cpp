@@ -0,0 +1,132 @@
+#include "console_log.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+const int64_t NEVER = INT64_MIN / 2;
+}
+
+ConsoleLog::ConsoleLog(FILE *out)
+    : _out(out), _start(Clock::now()), _dropped(0), _running(false) {
+  _sites.reserve(CONSOLE_LOG_MAX_SITES);
+}
+
+ConsoleLog::~ConsoleLog() {
+  _running = false;
+  if (_thread.joinable()) {
+    _thread.join();
+  }
+}
+
+int ConsoleLog::site(const string &format, double min_interval) {
+  if (_running || _thread.joinable()) {
+    throw runtime_error("ConsoleLog: sites must be registered before start()");
+  }
+  if ((int)_sites.size() == CONSOLE_LOG_MAX_SITES) {
+    throw runtime_error("ConsoleLog: too many sites");
+  }
+  Site site = {format, (int64_t)(min_interval * 1e9), NEVER, 0, {0, 0, 0, 0}};
+  _sites.push_back(site);
+  return _sites.size() - 1;
+}
+
+void ConsoleLog::start() {
+  if (_running) {
+    return;
+  }
+  _start = Clock::now();
+  _running = true;
+  _thread = thread(&ConsoleLog::run, this);
+}
+
+void ConsoleLog::stop() {
+  if (!_running) {
+    return;
+  }
+  // a last line for every site that was rate limited since it printed
+  for (size_t i = 0; i < _sites.size(); i++) {
+    Site &s = _sites[i];
+    if (s.suppressed > 0) {
+      Record record = {(int)i, s.suppressed, -1, {0, 0, 0, 0}};
+      for (int k = 0; k < CONSOLE_LOG_MAX_ARGS; k++) {
+        record.args[k] = s.suppressed_args[k];
+      }
+      s.suppressed = 0;
+      push(record);
+    }
+  }
+  _running = false;
+  _thread.join();
+}
+
+void ConsoleLog::log(int site, double a0, double a1, double a2, double a3) {
+  Site &s = _sites[site];
+  const int64_t now =
+      chrono::duration_cast<chrono::nanoseconds>(Clock::now() - _start)
+          .count();
+  if (now - s.last_ns < s.min_interval_ns) {
+    s.suppressed++;
+    s.suppressed_args[0] = a0;
+    s.suppressed_args[1] = a1;
+    s.suppressed_args[2] = a2;
+    s.suppressed_args[3] = a3;
+    return;
+  }
+  s.last_ns = now;
+  Record record = {site, s.suppressed, now * 1e-9, {a0, a1, a2, a3}};
+  s.suppressed = 0;
+  push(record);
+}
+
+void ConsoleLog::push(const Record &record) {
+  if (!_queue.tryPush(record)) {
+    _dropped.store(_dropped.load(memory_order_relaxed) + 1,
+                   memory_order_relaxed);
+  }
+}
+
+void ConsoleLog::run() {
+  Record record;
+  uint64_t reported_dropped = 0;
+  while (true) {
+    // read the flag first so records pushed before stop() are printed
+    const bool running = _running;
+    bool printed = false;
+    while (_queue.tryPop(record)) {
+      print(record);
+      printed = true;
+    }
+    const uint64_t dropped = _dropped.load(memory_order_relaxed);
+    if (dropped != reported_dropped) {
+      fprintf(_out, "[console log: %llu messages dropped]\n",
+              (unsigned long long)(dropped - reported_dropped));
+      reported_dropped = dropped;
+      printed = true;
+    }
+    if (printed) {
+      fflush(_out);
+    }
+    if (!running) {
+      break;
+    }
+    this_thread::sleep_for(chrono::milliseconds(10));
+  }
+}
+
+void ConsoleLog::print(const Record &record) {
+  const Site &site = _sites[record.site];
+  char line[512];
+  snprintf(line, sizeof(line), site.format.c_str(), record.args[0],
+           record.args[1], record.args[2], record.args[3]);
+  if (record.stamp < 0) {
+    // flush of a rate limited site at stop(), args of the latest call
+    fprintf(_out, "%s  [last of %u suppressed repeats]\n", line,
+            record.suppressed);
+  } else if (record.suppressed > 0) {
+    fprintf(_out, "%s  [%u repeats suppressed]\n", line, record.suppressed);
+  } else {
+    fprintf(_out, "%s\n", line);
+  }
+}
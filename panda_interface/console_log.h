@@ -0,0 +1,83 @@
+/*
+Console messages from the control thread without stdio on it. Each message
+is a site registered up front: a printf format taking up to
+CONSOLE_LOG_MAX_ARGS doubles (%g prints integers as integers) and the
+shortest interval between two prints of it. log() only records the site,
+the arguments and a timestamp into a lock-free ring; a background thread
+formats and prints. A site logged again within its interval is counted
+instead of queued, and the count is printed with its next line, so a
+message repeated every tick costs a clock read and shows up once per
+interval. Records that find the ring full are dropped and counted.
+*/
+
+#ifndef CONSOLE_LOG_H
+#define CONSOLE_LOG_H
+
+#include "spsc_queue.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+const int CONSOLE_LOG_MAX_ARGS = 4;
+const int CONSOLE_LOG_MAX_SITES = 64;
+
+class ConsoleLog {
+public:
+  explicit ConsoleLog(FILE *out = stdout);
+  ~ConsoleLog();
+
+  // before start(): returns the site id, min_interval in seconds (0 prints
+  // every call); throws std::runtime_error once started or when full
+  int site(const std::string &format, double min_interval = 0);
+
+  void start();
+  // prints what is queued and the suppressed counts still pending; call from
+  // the logging thread, after its last log()
+  void stop();
+
+  // logging thread only
+  void log(int site, double a0 = 0, double a1 = 0, double a2 = 0,
+           double a3 = 0);
+
+  // records lost to a full ring
+  uint64_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Record {
+    int site;
+    uint32_t suppressed; // calls rate limited since the previous record
+    double stamp;        // seconds since start()
+    double args[CONSOLE_LOG_MAX_ARGS];
+  };
+
+  struct Site {
+    std::string format;
+    int64_t min_interval_ns;
+    // logging thread only
+    int64_t last_ns;
+    uint32_t suppressed;
+    double suppressed_args[CONSOLE_LOG_MAX_ARGS]; // of the latest one
+  };
+
+  void run();
+  void print(const Record &record);
+  void push(const Record &record);
+
+  FILE *_out;
+  std::vector<Site> _sites;
+  Clock::time_point _start;
+  SpscQueue<Record, 1024> _queue;
+  std::atomic<uint64_t> _dropped;
+
+  std::atomic<bool> _running;
+  std::thread _thread;
+};
+
+#endif // CONSOLE_LOG_H
@@ -4,21 +4,36 @@ panda arm. It utilizes operational space as well as
 joint space control formulations.
 The trajectories for each task are also computed here.
 1kHz control loop frequency
+(control law and trajectories in panda_controller.cpp, this file is its
+redis / shared memory loop)
 
 @authors: Varun Nayak, Lauren Luo, Angela Cheng, Connie Kang
 """
 
 #include "Sai2Model.h"
-#include "Sai2Primitives.h"
+#include "alloc_guard.h"
+#include "console_log.h"
 #include "redis/RedisClient.h"
+#include "loop_profiler.h"
+#include "mode_channel.h"
+#include "options.h"
+#include "panda_controller.h"
+#include "realtime.h"
+#include "redis_pipeline.h"
+#include "shm_transport.h"
+#include "state_bus.h"
+#include "telemetry.h"
 #include "timer/LoopTimer.h"
 
-#include <array>
+#include <chrono>
 #include <cmath>
 #include <iostream>
 #include <string>
+#include <vector>
 
+#include <sched.h>
 #include <signal.h>
+#include <unistd.h>
 bool runloop = true;
 void sighandler(int sig) { runloop = false; }
 
@@ -27,34 +42,8 @@ using namespace Eigen;
 
 const string robot_file = "./resources/panda_arm.urdf";
 
-#define JOINT_CONTROLLER 0
-#define POSORI_CONTROLLER 1
-#define JOINT_CONTROLLER_SHOT 2
-#define END_SHOT 3
-
-#define WAIT_MODE 0
-#define EXECUTE_MODE 1
-
-int mode = WAIT_MODE;
-
-int state = JOINT_CONTROLLER;
-
-// function prototypes
-bool robotReachedGoal(VectorXd x, VectorXd x_desired, VectorXd xdot,
-                      VectorXd xddot, VectorXd omega, VectorXd alpha);
-Vector3d calculatePointInTrajectory(double t);
-bool inRange(double t, double lower, double upper);
-Matrix3d calculateRotationInTrajectory(double t, double psi);
-
-// calculates time it takes to swing
-double flick_time(double swing_angle, double hit_velocity, double ee_length);
-double sinusoidal_trajectory(double angular_velocity, double t,
-                             double theta_mid, double swing_angle);
-double sinusoidal_velocity(double angular_velocity, double t, double theta_mid,
-                           double swing_angle);
-
-// double flick(double t, double time, double start_angle, double end_angle);
-void safetyChecks(VectorXd q, VectorXd dq, VectorXd tau, int dof);
+// console output of the control loop, printed from a background thread
+ConsoleLog console_log;
 
 // redis keys:
 // - read:
@@ -72,39 +61,20 @@ std::string ROBOT_GRAVITY_KEY;
 // state
 std::string MODE_CHANGE_KEY = "modechange";
 
-std::string SHOT_ANGLE_KEY = "shotangle";
-std::string SHOT_POS_KEY = "shotpos";
-
-// soft safety values
-const std::array<double, 7> joint_position_max = {2.7, 1.6, 2.7, -0.2,
-                                                  2.7, 3.6, 2.7};
-const std::array<double, 7> joint_position_min = {-2.7, -1.6, -2.7, -3.0,
-                                                  -2.7, 0.2,  -2.7};
-const std::array<double, 7> joint_velocity_limits = {2.0, 2.0, 2.0, 2.0,
-                                                     2.5, 2.5, 2.5};
-const std::array<double, 7> joint_torques_limits = {85, 85, 85, 85, 10, 10, 10};
-
-unsigned long long controller_counter = 0;
-
-// time slots for which pieces of the trajectory are executed
-double t_0 = 0;
-double t_1 = 4;
-double t_2 = 8;
-double t_3 = 12;
-double t_4 = 13;
-const double ee_length = 17.70 * 0.0254;
-double theta_mid = -1.03 + 0.2;
+// binary shot message, see mode_channel.h
+std::string SHOT_KEY = "shot";
 
-Vector4d cue_start_pos;
-
-bool centershot = false;
+// - loop timing snapshot
+std::string TIMING_KEY = "sai2::cs225a::panda_robot::timing::controller";
 
 const bool flag_simulation = false;
 // const bool flag_simulation = true;
 
 const bool inertia_regularization = true;
 
-int main() {
+int main(int argc, char **argv) {
+  // for the startup time reported before the first tick
+  const auto process_start = chrono::steady_clock::now();
 
   if (flag_simulation) {
     JOINT_ANGLES_KEY = "sai2::cs225a::panda_robot::sensors::q";
@@ -124,6 +94,35 @@ int main() {
   auto redis_client = RedisClient();
   redis_client.connect();
 
+  // --shm: exchange q, dq and torques with simviz_panda through shared memory
+  const bool use_shm = flag_simulation && hasOption(argc, argv, "--shm");
+  ShmTransport shm;
+  uint64_t state_step = 0;
+  if (use_shm && !shm.open()) {
+    return 1;
+  }
+  // --lockstep: run one tick per simulation state instead of on the timer,
+  // for simviz_panda --headless
+  const bool lockstep = use_shm && hasOption(argc, argv, "--lockstep");
+  uint64_t last_state_step = ~0ull;
+  unsigned long long lockstep_ticks = 0;
+  if (!flag_simulation && hasOption(argc, argv, "--shm")) {
+    cout << "--shm ignored on the real robot" << endl;
+  }
+  if (!lockstep && hasOption(argc, argv, "--lockstep")) {
+    cout << "--lockstep ignored, it needs --shm in simulation" << endl;
+  }
+
+  // --bus: publish a state snapshot per tick for get_pose --bus and other
+  // read-only tools, see state_bus.h
+  const bool use_bus = hasOption(argc, argv, "--bus");
+  StateBus state_bus;
+  StateBusSnapshot bus_snapshot;
+  unsigned long long bus_ticks = 0;
+  if (use_bus && !state_bus.openWriter()) {
+    return 1;
+  }
+
   // set up signal handler
   signal(SIGABRT, &sighandler);
   signal(SIGTERM, &sighandler);
@@ -131,54 +130,36 @@ int main() {
 
   // load robots
   auto robot = new Sai2Model::Sai2Model(robot_file, false);
-  robot->_q = redis_client.getEigenMatrixJSON(JOINT_ANGLES_KEY);
+  RedisPipeline redis_pipeline(redis_client);
+  if (use_shm) {
+    cout << "Waiting for simviz_panda on shared memory" << endl;
+    while (runloop && !shm.readState(robot->_q, robot->_dq, &state_step)) {
+      usleep(1000);
+    }
+  } else {
+    redis_pipeline.get(JOINT_ANGLES_KEY, robot->_q);
+  }
   VectorXd initial_q = robot->_q;
   robot->updateModel();
 
-  // prepare controller
   int dof = robot->dof();
-  VectorXd command_torques = VectorXd::Zero(dof);
-  MatrixXd N_prec = MatrixXd::Identity(dof, dof);
-
-  // pose task
-  const string control_link = "link7";
-  const Vector3d control_point =
-      Vector3d((-ee_length + 0.0254 / 2) * sin(M_PI / 4.0),
-               (ee_length + 0.0254 / 2) * cos(M_PI / 4.0), 0.1070 + 0.0254 * 1);
-  auto posori_task =
-      new Sai2Primitives::PosOriTask(robot, control_link, control_point);
-
-  // #ifdef USING_OTG
-  // posori_task->_use_interpolation_flag = true;
-  // #else
-  posori_task->_use_velocity_saturation_flag = true;
-  // #endif
-
-  VectorXd posori_task_torques = VectorXd::Zero(dof);
-  posori_task->_kp_pos = 400.0;
-  posori_task->_kv_pos = 25.0;
-  posori_task->_kp_ori = 400.0;
-  posori_task->_kv_ori = 25.0;
-
-  // joint task
-  auto joint_task = new Sai2Primitives::JointTask(robot);
-
-  // #ifdef USING_OTG
-  // 	joint_task->_use_interpolation_flag = true;
-  // #else
-  joint_task->_use_velocity_saturation_flag = true;
-  joint_task->_saturation_velocity = M_PI / 3 * VectorXd::Ones(dof);
-
-  VectorXd joint_task_torques = VectorXd::Zero(dof);
-  joint_task->_kp = 150.0;
-  joint_task->_kv = 20.0;
-
-  VectorXd q_init_desired = initial_q;
-  q_init_desired << 0.004, -0.44, 0.315, -1.63, 1.53, 2.15, -0.33;
-  joint_task->_desired_position = q_init_desired;
-
-  VectorXd safe_joint_positions = initial_q;
-  safe_joint_positions << 0.0, 0.0, 0.0, -1.6, 0.0, 1.9, 0.0;
+
+  // per-phase timing, snapshot published to redis once per second
+  LoopProfiler profiler("controller_panda",
+                        {"redis_read", "model_update", "task_model",
+                         "compute_torques", "redis_write"},
+                        1000);
+
+  // the control law; its console messages are registered here, before the
+  // log thread starts
+  PandaControllerParams controller_params;
+  controller_params.simulation = flag_simulation;
+  controller_params.inertia_regularization = inertia_regularization;
+  // --otg: minimum-jerk segments sized to the move instead of the fixed
+  // trajectory slots
+  controller_params.otg = hasOption(argc, argv, "--otg");
+  PandaController controller(robot, controller_params, console_log, &profiler);
+  const VectorXd *command_torques = &controller.torques();
 
   // create a timer
   LoopTimer timer;
@@ -187,433 +168,228 @@ int main() {
   double start_time = timer.elapsedTime(); // secs
   bool fTimerDidSleep = true;
 
-  // initialize position and velocity in cartesian space
-  Vector3d x;     // quantity to store current task space position
-  Vector3d xdot;  // quantiy to store current task space velocity]
-  Vector3d xddot; // linear acceleration
-  Vector3d omega;
-  Vector3d alpha;
-
-  double psi = 90 * M_PI / 180.0; // shot angle;
-  double hit_velocity;
-  double swing_angle;
-  double total_time = 1.3;
-  double shot_angular_velocity = 0;
-  double a;
-  double w;
-  double command_time;
+  // batched redis io: one MGET and one MSET per tick
+  if (!use_shm) {
+    redis_pipeline.addRead(JOINT_ANGLES_KEY, &robot->_q);
+    redis_pipeline.addRead(JOINT_VELOCITIES_KEY, &robot->_dq);
+  }
+  int massmatrix_read = -1;
+  if (!flag_simulation) {
+    massmatrix_read = redis_pipeline.addRead(MASSMATRIX_KEY, &robot->_M);
+  }
+  // mode commands (with the shot parameters) arrive on a side thread
+  ModeChannel mode_channel(MODE_CHANGE_KEY, SHOT_KEY);
+  mode_channel.start();
+  ModeCommand mode_command;
+
+  console_log.start();
+
+  // --binary: raw double encoding for the torque command (simulation only,
+  // the panda driver expects JSON)
+  if (hasOption(argc, argv, "--binary")) {
+    if (flag_simulation) {
+      redis_pipeline.setBinaryEncoding(true);
+    } else {
+      cout << "--binary ignored on the real robot" << endl;
+    }
+  }
 
-  while (runloop) {
-    // wait for next scheduled loop
-    timer.waitForNextLoop();
-    double time = timer.elapsedTime() - start_time;
+  if (!use_shm) {
+    redis_pipeline.addWrite(JOINT_TORQUES_COMMANDED_KEY, command_torques);
+  }
 
-    // read robot state from redis
-    robot->_q = redis_client.getEigenMatrixJSON(JOINT_ANGLES_KEY);
-    robot->_dq = redis_client.getEigenMatrixJSON(JOINT_VELOCITIES_KEY);
-
-    // update cartesian position of the robot from joint angles
-    robot->position(x, control_link, control_point); // position of end effector
-    robot->linearVelocity(xdot, control_link,
-                          control_point); // velocity of end effector
-    robot->linearAcceleration(xddot, control_link, control_point);
-    robot->angularVelocity(omega, control_link);
-    robot->angularAcceleration(alpha, control_link);
-
-    // calculate current time;
-    double dt = 0.001;
-    double t = controller_counter * dt;
-
-    if (mode == WAIT_MODE) {
-      // cout<<"in wait mode"<<endl;
-      joint_task->reInitializeTask();
-      N_prec.setIdentity();
-      joint_task->updateTaskModel(N_prec);
-      joint_task->computeTorques(joint_task_torques);
-      command_torques = joint_task_torques;
-
-      if (redis_client.get(MODE_CHANGE_KEY) == "execute") {
-        mode = EXECUTE_MODE;
-        printf("Going into EXECUTE_MODE\n");
-
-        std::string shot_pos = redis_client.get(SHOT_POS_KEY);
-        std::string shot_ang = redis_client.get(SHOT_ANGLE_KEY);
-
-        int delimiter = shot_pos.find(",");
-        cue_start_pos << 0.001 * stod(shot_pos.substr(0, delimiter)),
-            0.001 * stod((shot_pos).substr(delimiter + 1, shot_pos.length())),
-            0, 1;
-        cout << "desired cue pos in board frame: " << cue_start_pos << endl;
-
-        psi = stod(shot_ang);
-        std::cout << "psi: " << psi << endl;
-
-        if (psi <= 1.571 && psi >= 1.569) {
-          centershot = true;
-        }
-
-        // retrieve hit velocity through redis
-        swing_angle = 120 * M_PI / 180.0;
-
-        // angular velocity
-        shot_angular_velocity = hit_velocity / ee_length;
-        cout << "shot angular velocity is " << shot_angular_velocity << endl;
-        a = swing_angle / 2.0;
-        w = shot_angular_velocity / a;
-      }
+  profiler.startPublisher(TIMING_KEY);
+
+  // --record <file>: per-tick telemetry, --record-seconds of it at most
+  vector<string> telemetry_columns = {"time", "mode", "state"};
+  appendColumns(telemetry_columns, "q", dof);
+  appendColumns(telemetry_columns, "dq", dof);
+  appendColumns(telemetry_columns, "tau", dof);
+  appendColumns(telemetry_columns, "x_desired", 3);
+  // desired orientation as a quaternion, w x y z
+  appendColumns(telemetry_columns, "ori_desired", 4);
+  appendColumns(telemetry_columns, "x", 3);
+  telemetry_columns.push_back("period_us");
+  telemetry_columns.push_back("compute_us");
+  // inputs of the control law besides q / dq, for replay_panda: the execute
+  // command of the tick (shot_* are 0 without one) and, on hardware, the
+  // driver's mass matrix as read (row major)
+  const int telemetry_inputs = telemetry_columns.size();
+  telemetry_columns.push_back("execute");
+  const char *shot_columns[] = {"shot_seq", "shot_x", "shot_y", "shot_psi",
+                                "shot_hit_velocity", "shot_swing_angle"};
+  telemetry_columns.insert(telemetry_columns.end(), shot_columns,
+                           shot_columns + 6);
+  // present (and 1) only with --otg
+  if (controller_params.otg) {
+    telemetry_columns.push_back("otg");
+  }
+  if (!flag_simulation) {
+    appendColumns(telemetry_columns, "M", dof * dof);
+  }
+  TelemetryRecorder telemetry(
+      telemetry_columns,
+      1000 * optionValue(argc, argv, "--record-seconds", 600));
+  const char *record_path = optionString(argc, argv, "--record", nullptr);
+  if (record_path != nullptr && !telemetry.open(record_path)) {
+    return 1;
+  }
 
-    } else if (mode == EXECUTE_MODE) {
-
-      // update model
-      if (flag_simulation) {
-        robot->updateModel();
-      } else {
-        robot->updateKinematics();
-        robot->_M = redis_client.getEigenMatrixJSON(MASSMATRIX_KEY);
-        if (inertia_regularization) {
-          // robot->_M(4,4) += 0.07;
-          // robot->_M(5,5) += 0.07;
-          // robot->_M(6,6) += 0.07;
-        }
-        robot->_M_inv = robot->_M.inverse();
-      }
+  // --rt: SCHED_FIFO, pinning and locked memory for the control thread, after
+  // the helper threads above are running so they do not inherit it
+  enterRealtime(realtimeOptions(argc, argv), "controller_panda");
+
+  cout << "Controller startup: "
+       << chrono::duration<double, milli>(chrono::steady_clock::now() -
+                                          process_start)
+              .count()
+       << " ms to the first control tick" << endl;
 
-      // cout<<"z position is "<<x(2)<<endl;
-
-      if (state == JOINT_CONTROLLER) {
-        // update task model and set hierarchy
-        joint_task->_desired_position = q_init_desired;
-        N_prec.setIdentity();
-        joint_task->updateTaskModel(N_prec);
-        joint_task->_kp = 250.0;
-        // cout << "HERERERERERER" << endl;
-
-        if (inertia_regularization) {
-          robot->_M += 0.1 * MatrixXd::Identity(dof, dof);
-        }
-
-        // compute torques
-        joint_task->computeTorques(joint_task_torques);
-
-        command_torques = joint_task_torques;
-
-        if ((robot->_q - q_init_desired).norm() < 0.15) {
-          cout << "Reached JOINT Goal" << endl;
-          t = 0;
-          controller_counter = 0;
-          posori_task->_desired_position = calculatePointInTrajectory(t);
-          posori_task->_desired_orientation =
-              calculateRotationInTrajectory(t, psi);
-          joint_task->_kp = 300.0;
-          joint_task->_kv = 25.0;
-          posori_task->_kp_pos = 400.0;
-          posori_task->_kv_pos = 25.0;
-          posori_task->_kp_ori = 400.0;
-          posori_task->_kv_ori = 25.0;
-
-          state = POSORI_CONTROLLER;
-        }
+  // count heap allocations made by the control loop (-DPANDA_ALLOC_GUARD=ON)
+  AllocGuard::arm();
+
+  while (runloop) {
+    if (lockstep) {
+      // wait for the simulation to publish the next state
+      while (runloop && (!shm.readState(robot->_q, robot->_dq, &state_step) ||
+                         state_step == last_state_step)) {
+        sched_yield();
       }
+      if (!runloop) {
+        break;
+      }
+      last_state_step = state_step;
+      lockstep_ticks++;
+      fTimerDidSleep = true;
+    } else {
+      // wait for next scheduled loop
+      fTimerDidSleep = timer.waitForNextLoop();
+    }
+    profiler.startTick(fTimerDidSleep);
+    double time = timer.elapsedTime() - start_time;
 
-      else if (state == POSORI_CONTROLLER) {
-        // if the robot reaches the desired position and is at rest, come out of
-        // the loop
-        if (robotReachedGoal(x, calculatePointInTrajectory(100), xdot, xddot,
-                             omega, alpha) &&
-            t > t_4) // 100 is arbitrarily large, represents last point in traj
-        {
-          printf("Reached Final Goal \n");
-          printf("Going into WAIT_MODE..\n");
-          mode = WAIT_MODE;
-          redis_client.set(MODE_CHANGE_KEY, "wait");
-          state = JOINT_CONTROLLER;
-          joint_task->_desired_position = q_init_desired;
-        } else {
-          joint_task->_desired_position = safe_joint_positions;
-        }
-
-        if (t > t_3 && t < t_3 + total_time) {
-          cout << "Shooting" << endl;
-          state = JOINT_CONTROLLER_SHOT;
-          joint_task->reInitializeTask();
-          theta_mid = robot->_q(dof - 1);
-        }
-        joint_task->_use_velocity_saturation_flag = true;
-        // update task model and set hierarchy
-        N_prec.setIdentity();
-        posori_task->updateTaskModel(N_prec);
-        N_prec = posori_task->_N;
-        joint_task->updateTaskModel(N_prec);
-
-        if (inertia_regularization) {
-          posori_task->_Lambda += 0.1 * MatrixXd::Identity(6, 6);
-        }
-
-        posori_task->_desired_position = calculatePointInTrajectory(t);
-        posori_task->_desired_orientation =
-            calculateRotationInTrajectory(t, psi);
-        // compute torques
-        posori_task->computeTorques(posori_task_torques);
-        joint_task->computeTorques(joint_task_torques);
-
-        command_torques = posori_task_torques + joint_task_torques;
-        // command_torques = posori_task_torques;
-      } else if (state == JOINT_CONTROLLER_SHOT) {
-        joint_task->_kp = 400.0;
-        if (t > t_3 && t < t_4) {
-          joint_task->_desired_position(dof - 1) =
-              theta_mid + M_PI / 24; //+ swing_angle/2.0;
-          command_time = 0.0;
-          // cout<<"joint velocity is "<<robot->_dq(dof-1)<<endl;
-        } else if ((t - t_4) <= total_time) {
-          joint_task->_use_velocity_saturation_flag = true;
-          if (centershot) {
-            joint_task->_saturation_velocity << M_PI / 3, M_PI / 3, M_PI / 3,
-                M_PI / 3, M_PI / 2, M_PI / 2, 2.33;
-            cout << "slowing down for centershot" << endl;
-          } else {
-            joint_task->_saturation_velocity << M_PI / 3, M_PI / 3, M_PI / 3,
-                M_PI / 3, M_PI / 2, M_PI / 2, 3.0;
-          }
-          joint_task->_desired_position(dof - 1) = theta_mid - M_PI / 4;
-          command_time++;
-
-        }
-
-        N_prec.setIdentity();
-        joint_task->updateTaskModel(N_prec);
-        joint_task->_kp = 250.0;
-
-        if (inertia_regularization) {
-          robot->_M += 0.1 * MatrixXd::Identity(dof, dof);
-        }
-
-        // compute torques
-        joint_task->computeTorques(joint_task_torques);
-
-        command_torques = joint_task_torques;
-        if (t > (t_4 + total_time)) {
-
-          joint_task->_use_velocity_saturation_flag = true;
-          cout << "Done Shooting" << endl;
-          centershot = false;
-          posori_task->_desired_position = calculatePointInTrajectory(t);
-          posori_task->_desired_orientation =
-              calculateRotationInTrajectory(t, psi);
-          joint_task->_kp = 200.0;
-          joint_task->_kv = 20.0;
-          posori_task->_kp_pos = 200.0;
-          posori_task->_kv_pos = 20.0;
-          posori_task->_kp_ori = 200.0;
-          posori_task->_kv_ori = 20.0;
-          joint_task->_saturation_velocity = M_PI / 4 * VectorXd::Ones(dof);
-          state = POSORI_CONTROLLER;
-        }
+    // read robot state (and mass matrix as needed) from redis
+    if (massmatrix_read >= 0) {
+      redis_pipeline.setReadEnabled(massmatrix_read,
+                                    controller.needsMassMatrix());
+    }
+    redis_pipeline.read();
+    if (use_shm && !lockstep) {
+      shm.readState(robot->_q, robot->_dq, &state_step);
+    }
+    // commands that arrive during a shot are queued if the swing is done
+    // (pipelined turns, see the state machine's --pipeline) and dropped before
+    bool execute_command = mode_channel.poll(mode_command) &&
+                           mode_command.mode == MODE_COMMAND_EXECUTE;
+    profiler.mark(PHASE_REDIS_READ);
+
+    if (telemetry.recording()) {
+      // the inputs as read, before the model update regularizes _M
+      double *row = telemetry.row() + telemetry_inputs;
+      const ShotMessage &shot = mode_command.shot;
+      *row++ = execute_command;
+      *row++ = execute_command ? shot.seq : 0;
+      *row++ = execute_command ? shot.x : 0;
+      *row++ = execute_command ? shot.y : 0;
+      *row++ = execute_command ? shot.psi : 0;
+      *row++ = execute_command ? shot.hit_velocity : 0;
+      *row++ = execute_command ? shot.swing_angle : 0;
+      if (controller_params.otg) {
+        *row++ = 1;
       }
+      if (!flag_simulation) {
+        Map<Matrix<double, Dynamic, Dynamic, RowMajor>>(row, dof, dof) =
+            robot->_M;
+      }
+    }
 
-      // send to redis
+    controller.step(execute_command ? &mode_command : nullptr);
+    if (controller.shotDone()) {
+      mode_channel.post(MODE_EVENT_SHOT_DONE);
+    }
+    if (controller.shotFinished()) {
+      mode_channel.post(MODE_COMMAND_WAIT);
+    }
 
-      safetyChecks(robot->_q, robot->_dq, command_torques, dof);
+    // send torques to redis
+    redis_pipeline.write();
+    if (use_shm) {
+      shm.writeTorques(*command_torques, state_step);
+    }
+    profiler.mark(PHASE_REDIS_WRITE);
+    profiler.endTick();
+
+    // after the torques are out, consumers never hold up the loop
+    if (use_bus) {
+      fillSnapshot(bus_snapshot, bus_ticks++, controller.mode(),
+                   controller.state(), robot->_q, robot->_dq,
+                   *command_torques, controller.position(),
+                   controller.velocity(), controller.rotation());
+      state_bus.publish(bus_snapshot);
+    }
 
-      controller_counter++;
+    if (telemetry.recording()) {
+      double *row = telemetry.row();
+      *row++ = time;
+      *row++ = controller.mode();
+      *row++ = controller.state();
+      Map<VectorXd>(row, dof) = robot->_q;
+      row += dof;
+      Map<VectorXd>(row, dof) = robot->_dq;
+      row += dof;
+      Map<VectorXd>(row, dof) = *command_torques;
+      row += dof;
+      Map<VectorXd>(row, 3) = controller.posoriTask()->_desired_position;
+      row += 3;
+      const Quaterniond ori_desired(
+          controller.posoriTask()->_desired_orientation);
+      *row++ = ori_desired.w();
+      Map<VectorXd>(row, 3) = ori_desired.vec();
+      row += 3;
+      Map<VectorXd>(row, 3) = controller.position();
+      row += 3;
+      *row++ = profiler.lastPeriod() * 1e-3;
+      *row++ = profiler.lastCompute() * 1e-3;
+      telemetry.commit();
     }
-    redis_client.setEigenMatrixJSON(JOINT_TORQUES_COMMANDED_KEY,
-                                    command_torques);
   }
-
-  command_torques.setZero();
-  redis_client.setEigenMatrixJSON(JOINT_TORQUES_COMMANDED_KEY, command_torques);
+  AllocGuard::disarm();
+  profiler.stopPublisher();
+  mode_channel.stop();
+  console_log.stop();
+  telemetry.close();
+
+  const VectorXd zero_torques = VectorXd::Zero(dof);
+  if (use_shm) {
+    shm.writeTorques(zero_torques, state_step);
+  }
+  redis_client.setEigenMatrixJSON(JOINT_TORQUES_COMMANDED_KEY, zero_torques);
 
   double end_time = timer.elapsedTime();
   std::cout << "\n";
   std::cout << "Controller Loop run time  : " << end_time << " seconds\n";
-  std::cout << "Controller Loop updates   : " << timer.elapsedCycles() << "\n";
-  std::cout << "Controller Loop frequency : "
-            << timer.elapsedCycles() / end_time << "Hz\n";
-
-  return 0;
-}
-
-bool robotReachedGoal(VectorXd x, VectorXd x_desired, VectorXd xdot,
-                      VectorXd xddot, VectorXd omega, VectorXd alpha) {
-  double epsilon = 3;
-  double error_norm = 100 * xdot.norm() + 10 * (x - x_desired).norm() +
-                      1000 * xddot.norm() + 1000 * omega.norm() +
-                      1000 * alpha.norm();
-  if (error_norm < epsilon) {
-    return true;
+  const unsigned long long updates =
+      lockstep ? lockstep_ticks : timer.elapsedCycles();
+  std::cout << "Controller Loop updates   : " << updates << "\n";
+  std::cout << "Controller Loop frequency : " << updates / end_time << "Hz\n";
+  std::cout << "Controller model updates  : "
+            << controller.dynamics().updates() << " ("
+            << controller.dynamics().factorizations() << " factorizations)\n";
+  profiler.printSummary();
+  if (telemetry.written() > 0) {
+    std::cout << "Controller telemetry rows : " << telemetry.written()
+              << " written to " << record_path << " ("
+              << telemetry.dropped() + telemetry.overflowed() << " lost)\n";
   }
-  return false;
-}
-
-/*
-This function returns the desired point in the operational space
-that the robot needs to track. The plan is to divide it into sections
-parametrized by 't'.
-
-From calibration and shot planner, we need (all expressed in robot frame)
-1) Home position (xh, yh, zh)
-2) Position of cue coin (xc,yc,zc) (also pre-determined)
-3) Desired position of cue coin (xcd, ycd, zcd) (get from  shot planner over
-redis when mode changes) 4) Backup and Flick Trajectory expressed in the robot
-frame (get required params from shot planner and tranform it)
-*/
-Vector3d calculatePointInTrajectory(double t) {
-  // diameter of board is 20.125 in, convert to m:
-  double r = 20.125 / 2 * 0.0254;
-
-  double x_offset = 0.7385; // need to calibrate
-  double y_offset = 0.1070 + 0.035;
-  double z_offset = 0.3120; // need to calibrate
-  Vector3d xh;
-  xh << 0.2859, 0.2787, 0.4300; // calibrate this
-  // Vector3d xc; xc << 0.5,0.35,0.5;
-  Vector3d xc;
-  xc << r * sin(-M_PI / 4) + x_offset, r * cos(-M_PI / 4) + y_offset,
-      z_offset; // calibrate this
-  // Vector3d xcd; xcd << r*sin(-1.75*M_PI/4)+x_offset,
-  // r*cos(-1.75*M_PI/4)+y_offset, z_offset; //calculate this - get from redis
-  MatrixXd T = MatrixXd::Zero(4, 4);
-  T << 0, 1, 0, x_offset, -1, 0, 0, y_offset, 0, 0, 1, z_offset, 0, 0, 0, 1;
-
-  VectorXd xcd = VectorXd::Zero(3);
-  VectorXd xcd_4d = VectorXd::Zero(4);
-  xcd_4d = T * cue_start_pos; // calculate this - get from redis
-  xcd = xcd_4d.head(3);
-  // std::cout << "xcd: " << xcd << std::endl;
-
-  Vector3d x;
-
-  if (inRange(t, t_0, t_1)) {
-    // home position to cue coin position
-    x = xh + (xc - xh) * (t - t_0) / (t_1 - t_0);
-  } else if (inRange(t, t_1, t_2)) {
-
-    // x = xc;
-    // Move cue coin from home to desired position
-    double x0 = xc(0);
-    double y0 = xc(1);
-    double xf = xcd(0);
-    double yf = xcd(1);
-
-    double t0 = atan2(x0 - x_offset, y0 - y_offset);
-    double tf = atan2(xf - x_offset, yf - y_offset);
-
-    double old_range = t_2 - t_1;
-    double new_range = tf - t0;
-    double new_t = (((t - t_1) * (new_range)) / old_range) + t0;
-
-    x << r * sin(new_t) + x_offset, r * cos(new_t) + y_offset, xc(2);
-  } else if (inRange(t, t_2, t_3)) {
-    x = xcd;
-
-  } else if (inRange(t, t_3, t_4)) {
-    x = xcd; // shooting
-  } else {
-    x = xh;
-    // cout<<"going home"<<endl;
+  if (console_log.dropped() > 0) {
+    std::cout << "Controller console messages dropped : "
+              << console_log.dropped() << "\n";
   }
-
-  return x;
-}
-
-/*
-From calibration and shot planner, we need:
-1) Orientation in home position (point straight and flat maybe?)
-2) Angle to which to turn to once we reach the cue coin position (get from shot
-planner over redis) 3) Angle to which to point to for the backup and shot (get
-from shot planner over redis)
-*/
-Matrix3d calculateRotationInTrajectory(double t, double psi) {
-  Matrix3d rot;
-  Matrix3d home_orientation;
-  // psi = psi + M_PI/8;
-
-  home_orientation << 0.7360145, 0.6763110, 0.0297644, -0.0413102, 0.0009846,
-      0.9991459, 0.6757041, -0.7366155, 0.0286632;
-
-  if (inRange(t, t_0, t_1)) {
-    rot = AngleAxisd(-M_PI / 4 * (t - t_0) / (t_1 - t_0), Vector3d::UnitZ())
-              .toRotationMatrix() *
-          home_orientation;
-  } else if (inRange(t, t_1, t_2)) {
-    // rotate -90 degrees to gather the coin
-    rot = AngleAxisd(-M_PI / 4, Vector3d::UnitZ()).toRotationMatrix() *
-          home_orientation;
-
-  } else if (inRange(t, t_2, t_3)) {
-    // double psi; psi = 135*M_PI/180.0; //get psi from redis
-    Matrix3d hit_rot;
-    hit_rot << cos(-M_PI / 2 + psi), -sin(-M_PI / 2 + psi), 0,
-        sin(-M_PI / 2 + psi), cos(-M_PI / 2 + psi), 0, 0, 0, 1;
-    rot = hit_rot * home_orientation;
-
-  } else if (inRange(t, t_3, t_4)) {
-    // double psi; psi = 135*M_PI/180.0; //get psi from redis
-    Matrix3d hit_rot;
-    hit_rot << cos(-M_PI / 2 + psi), -sin(-M_PI / 2 + psi), 0,
-        sin(-M_PI / 2 + psi), cos(-M_PI / 2 + psi), 0, 0, 0, 1;
-    rot = hit_rot * home_orientation;
-  } else {
-    rot = home_orientation;
+  if (AllocGuard::enabled()) {
+    std::cout << "Controller Loop heap allocations : " << AllocGuard::count()
+              << " (" << (double)AllocGuard::count() / timer.elapsedCycles()
+              << " per tick)\n";
   }
 
-  return rot;
-}
-
-double flick_time(double swing_angle, double hit_velocity, double ee_length) {
-  double time;
-  double angle_range;
-  angle_range = swing_angle;
-  time = angle_range * ee_length / hit_velocity;
-  return time;
-}
-
-double sinusoidal_trajectory(double angular_velocity, double t,
-                             double theta_mid, double swing_angle) {
-  double pos;
-  double a;
-  double w;
-  a = swing_angle / 2.0;
-  w = angular_velocity / a;
-  pos = -a * sin(w * t - M_PI / 2.0) + theta_mid;
-  return pos;
-}
-
-double sinusoidal_velocity(double angular_velocity, double t, double theta_mid,
-                           double swing_angle) {
-  double vel;
-  double a;
-  double w;
-  a = swing_angle / 2.0;
-  w = angular_velocity / a;
-  vel = -a * w * cos(w * t - M_PI / 2.0);
-  return vel;
-}
-
-// return true if t lies in between lower and upper limits
-bool inRange(double t, double lower, double upper) {
-  return ((t < upper) && (t >= lower));
+  return 0;
 }
-
-// soft limit safetycheck as per the driver
-void safetyChecks(VectorXd q, VectorXd dq, VectorXd tau, int dof) {
-  for (int i = 0; i < dof; i++) {
-    if (q[i] > joint_position_max[i])
-      cout << "------!! VIOLATED MAX JOINT POSITION SOFT LIMIT !!------- for "
-              "joint "
-           << i + 1 << endl;
-    if (q[i] < joint_position_min[i])
-      cout << "------!! VIOLATED MIN JOINT POSITION SOFT LIMIT !!------- for "
-              "joint"
-           << i + 1 << endl;
-    if (abs(dq[i]) > joint_velocity_limits[i])
-      cout << "------!! VIOLATED MAX JOINT VELOCITY SOFT LIMIT !!------- for "
-              "joint"
-           << i + 1 << endl;
-    if (abs(tau[i]) > joint_torques_limits[i])
-      cout
-          << "------!! VIOLATED MAX JOINT TORQUE SOFT LIMIT !!------- for joint"
-          << i + 1 << endl;
-  }
-}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#include "dynamics_cache.h"
+
+using namespace Eigen;
+
+DynamicsCache::DynamicsCache(Sai2Model::Sai2Model *robot, bool compute_inertia,
+                             const VectorXd &regularization, double q_tolerance)
+    : _robot(robot), _compute_inertia(compute_inertia),
+      _regularization(regularization), _q_tolerance(q_tolerance),
+      _valid(false), _q_factored(VectorXd::Zero(robot->dof())),
+      _M(MatrixXd::Zero(robot->dof(), robot->dof())), _ldlt(robot->dof()),
+      _updates(0), _factorizations(0) {}
+
+void DynamicsCache::update(bool inertia_fresh) {
+  _updates++;
+  const bool moved =
+      !_valid ||
+      (_robot->_q - _q_factored).lpNorm<Infinity>() > _q_tolerance;
+  bool refactor;
+  if (_compute_inertia) {
+    if (moved) {
+      _robot->updateModel();
+    } else {
+      _robot->updateKinematics();
+    }
+    refactor = moved;
+  } else {
+    _robot->updateKinematics();
+    refactor = moved && inertia_fresh;
+  }
+
+  if (!refactor) {
+    if (_valid) {
+      // an external read may have replaced it with the raw matrix
+      _robot->_M = _M;
+    }
+    return;
+  }
+
+  _robot->_M.diagonal() += _regularization;
+  _M = _robot->_M;
+  _ldlt.compute(_M);
+  _robot->_M_inv.setIdentity();
+  _ldlt.solveInPlace(_robot->_M_inv);
+  _q_factored = _robot->_q;
+  _valid = true;
+  _factorizations++;
+}
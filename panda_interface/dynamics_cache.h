@@ -0,0 +1,58 @@
+/*
+Once-per-tick model update for the controllers. The mass matrix is
+regularized (constant added to its diagonal) and factored with LDLT, and the
+inverse both task models read (_M_inv) is solved from that one
+factorization instead of a dense inverse. While q stays within a tolerance
+of the configuration the factorization belongs to (the arm at rest in
+WAIT_MODE) only the kinematics are updated and the inertia terms are kept.
+
+Where the inertia comes from:
+  - computed: the cache calls updateModel() itself (simulation)
+  - external: _M is written before update() (the panda driver's mass matrix
+    read through redis on hardware); pass inertia_fresh = false on ticks
+    the read was skipped
+*/
+
+#ifndef DYNAMICS_CACHE_H
+#define DYNAMICS_CACHE_H
+
+#include "Sai2Model.h"
+
+#include <Eigen/Dense>
+
+class DynamicsCache {
+public:
+  // regularization: added to the diagonal of _M before it is factored;
+  // q_tolerance: largest joint change (rad) for which the inertia is reused
+  DynamicsCache(Sai2Model::Sai2Model *robot, bool compute_inertia,
+                const Eigen::VectorXd &regularization,
+                double q_tolerance = 1e-4);
+
+  // kinematics every call; regularized _M, its factorization and _M_inv
+  // when q moved or on the first call
+  void update(bool inertia_fresh = true);
+  // forces a refactorization on the next update
+  void invalidate() { _valid = false; }
+
+  // factorization of the regularized _M
+  const Eigen::LDLT<Eigen::MatrixXd> &factorization() const { return _ldlt; }
+  // updates / updates that refactored
+  unsigned long long updates() const { return _updates; }
+  unsigned long long factorizations() const { return _factorizations; }
+
+private:
+  Sai2Model::Sai2Model *_robot;
+  bool _compute_inertia;
+  Eigen::VectorXd _regularization;
+  double _q_tolerance;
+
+  bool _valid;
+  Eigen::VectorXd _q_factored;
+  Eigen::MatrixXd _M; // regularized, as factored
+  Eigen::LDLT<Eigen::MatrixXd> _ldlt;
+
+  unsigned long long _updates;
+  unsigned long long _factorizations;
+};
+
+#endif // DYNAMICS_CACHE_H
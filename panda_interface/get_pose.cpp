@@ -2,12 +2,19 @@
 Prints out the pose and joint configuration of the robot in the world frame,
 used for calibration purposes
 No control input is applied
+  ./get_pose [--bus]
+With --bus it reads the state snapshots of controller_panda --bus (shared
+memory, see state_bus.h) instead of querying redis and computing the pose
+itself; the position is then the controller's control point
 
 @authors: Varun Nayak
 """
 
 #include "Sai2Model.h"
 #include "redis/RedisClient.h"
+#include "redis_pipeline.h"
+#include "options.h"
+#include "state_bus.h"
 #include "timer/LoopTimer.h"
 #include "Sai2Primitives.h"
 
@@ -16,6 +23,7 @@ No control input is applied
 #include <array>
 
 #include <signal.h>
+#include <unistd.h>
 bool runloop = true;
 void sighandler(int sig)
 { runloop = false; }
@@ -29,6 +37,7 @@ std::string JOINT_VELOCITIES_KEY;
 std::string JOINT_TORQUES_SENSED_KEY;
 
 void safetyChecks(VectorXd q,int dof);
+int printFromBus(const VectorXd& jmin, const VectorXd& jmax);
 // redis keys:
 // - read:
 
@@ -47,7 +56,7 @@ std::string ROBOT_GRAVITY_KEY;
 double ee_length = 0.253;
 
 
-int main() {
+int main(int argc, char** argv) {
 
 	
 	JOINT_ANGLES_KEY  = "sai2::FrankaPanda::sensors::q";
@@ -60,18 +69,23 @@ jmax << 2.7, 1.6, 2.7, -0.2, 2.7, 3.6, 2.7;
 Eigen::VectorXd jmin; jmin.resize(7);
 jmin << -2.7, -1.6, -2.7, -3.0, -2.7, 0.2, -2.7;
 
-	// start redis client
-	auto redis_client = RedisClient();
-	redis_client.connect();
-
 	// set up signal handler
 	signal(SIGABRT, &sighandler);
 	signal(SIGTERM, &sighandler);
 	signal(SIGINT, &sighandler);
 
+	if (hasOption(argc, argv, "--bus")) {
+		return printFromBus(jmin, jmax);
+	}
+
+	// start redis client
+	auto redis_client = RedisClient();
+	redis_client.connect();
+
 	// load robots
 	auto robot = new Sai2Model::Sai2Model(robot_file, false);
-	robot->_q = redis_client.getEigenMatrixJSON(JOINT_ANGLES_KEY);
+	RedisPipeline redis_pipeline(redis_client);
+	redis_pipeline.get(JOINT_ANGLES_KEY, robot->_q);
 	VectorXd initial_q = robot->_q;
 	robot->updateModel();
 
@@ -94,14 +108,17 @@ jmin << -2.7, -1.6, -2.7, -3.0, -2.7, 0.2, -2.7;
 	double start_time = timer.elapsedTime(); //secs
 	bool fTimerDidSleep = true;
 
+	// batched redis io: q and dq in one MGET
+	redis_pipeline.addRead(JOINT_ANGLES_KEY, &robot->_q);
+	redis_pipeline.addRead(JOINT_VELOCITIES_KEY, &robot->_dq);
+
 	while (runloop) {
 		// wait for next scheduled loop
 		timer.waitForNextLoop();
 		double time = timer.elapsedTime() - start_time;
 
 		// read robot state from redis
-		robot->_q = redis_client.getEigenMatrixJSON(JOINT_ANGLES_KEY);
-		robot->_dq = redis_client.getEigenMatrixJSON(JOINT_VELOCITIES_KEY);
+		redis_pipeline.read();
 
 		robot->updateKinematics();
 		robot->position(x,control_link,control_point); //position of end effector
@@ -122,6 +139,43 @@ jmin << -2.7, -1.6, -2.7, -3.0, -2.7, 0.2, -2.7;
 	return 0;
 }
 
+// the same printout from the controller's state bus, at the same rate
+int printFromBus(const VectorXd& jmin, const VectorXd& jmax)
+{
+	StateBus bus;
+	cout << "Waiting for controller_panda --bus" << endl;
+	while (runloop && !bus.openReader()) {
+		usleep(100000);
+	}
+
+	LoopTimer timer;
+	timer.initializeTimer();
+	timer.setLoopFrequency(5);
+	StateBusSnapshot snapshot;
+	uint32_t last_version = 0;
+	while (runloop) {
+		timer.waitForNextLoop();
+		if (!bus.read(snapshot)) {
+			continue;
+		}
+		if (bus.version() == last_version) {
+			cout << "(no new state from the controller)" << endl;
+		}
+		last_version = bus.version();
+
+		Map<const VectorXd> q(snapshot.q, snapshot.dof);
+		Map<const Vector3d> x(snapshot.x);
+		Map<const Matrix<double, 3, 3, RowMajor>> R(snapshot.rotation);
+		cout << setprecision(4) << fixed << "\n\n---------------------\n Position of EE = \n" << x.transpose() << "\n"<< endl;
+		cout << setprecision(2) << fixed << "JOINT ANGLES: \n" << jmin.transpose() << endl << q.transpose() << endl << jmax.transpose() << endl << "\n";
+		safetyChecks(q, snapshot.dof);
+		cout << setprecision(4) << fixed << "\n Rotation Matrix = \n" << R << "\n---------------------\n" << endl;
+		cout << "mode " << snapshot.mode << ", state " << snapshot.state << ", tick " << snapshot.tick
+		     << ", " << setprecision(1) << 1e3 * (ShmTransport::now() - snapshot.timestamp) << " ms old" << endl;
+	}
+	return 0;
+}
+
 void safetyChecks(VectorXd q,int dof)
 {
 	for(int i = 0; i < dof; i++)
@@ -0,0 +1,211 @@
+#include "loop_profiler.h"
+#include "redis/RedisClient.h"
+
+#include <cstdio>
+
+using namespace std;
+
+//------------------------------------------------------------------------------
+LatencyHistogram::LatencyHistogram() : _count(0), _sum(0), _max(0) {
+  for (int i = 0; i < NUM_BUCKETS; i++) {
+    _buckets[i].store(0, memory_order_relaxed);
+  }
+}
+
+int LatencyHistogram::bucketIndex(uint64_t ns) {
+  if (ns < (uint64_t)SUB_BUCKETS) {
+    return ns;
+  }
+  int exponent = 63 - __builtin_clzll(ns);
+  if (exponent > MAX_EXPONENT) {
+    return NUM_BUCKETS - 1;
+  }
+  int sub = (ns >> (exponent - SUB_BUCKET_BITS)) - SUB_BUCKETS;
+  return SUB_BUCKETS + (exponent - SUB_BUCKET_BITS) * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::bucketValue(int index) {
+  if (index < SUB_BUCKETS) {
+    return index;
+  }
+  int exponent = (index - SUB_BUCKETS) / SUB_BUCKETS + SUB_BUCKET_BITS;
+  int sub = (index - SUB_BUCKETS) % SUB_BUCKETS;
+  uint64_t width = 1ull << (exponent - SUB_BUCKET_BITS);
+  return (SUB_BUCKETS + sub) * width + width / 2;
+}
+
+// single writer: plain load/store pairs instead of locked read-modify-writes
+void LatencyHistogram::record(uint64_t ns) {
+  atomic<uint64_t> &bucket = _buckets[bucketIndex(ns)];
+  bucket.store(bucket.load(memory_order_relaxed) + 1, memory_order_relaxed);
+  _sum.store(_sum.load(memory_order_relaxed) + ns, memory_order_relaxed);
+  if (ns > _max.load(memory_order_relaxed)) {
+    _max.store(ns, memory_order_relaxed);
+  }
+  _count.store(_count.load(memory_order_relaxed) + 1, memory_order_release);
+}
+
+uint64_t LatencyHistogram::count() const {
+  return _count.load(memory_order_acquire);
+}
+
+uint64_t LatencyHistogram::max() const {
+  return _max.load(memory_order_relaxed);
+}
+
+double LatencyHistogram::mean() const {
+  uint64_t n = count();
+  return n == 0 ? 0.0 : (double)_sum.load(memory_order_relaxed) / n;
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+  uint64_t n = count();
+  if (n == 0) {
+    return 0;
+  }
+  uint64_t target = (uint64_t)(p / 100.0 * n);
+  uint64_t seen = 0;
+  for (int i = 0; i < NUM_BUCKETS; i++) {
+    seen += _buckets[i].load(memory_order_relaxed);
+    if (seen > target) {
+      return min(bucketValue(i), max());
+    }
+  }
+  return max();
+}
+
+//------------------------------------------------------------------------------
+LoopProfiler::LoopProfiler(const string &name, const vector<string> &phases,
+                           double loop_frequency)
+    : _name(name), _phase_names(phases), _loop_frequency(loop_frequency),
+      _first_tick(true), _phase_acc(phases.size(), 0), _last_period(0),
+      _last_compute(0), _phases(phases.size()),
+      _ticks(0), _deadline_misses(0), _publishing(false) {}
+
+LoopProfiler::~LoopProfiler() { stopPublisher(); }
+
+void LoopProfiler::startTick(bool timer_did_sleep) {
+  _tick_start = Clock::now();
+  _last_mark = _tick_start;
+  if (!_first_tick) {
+    const int64_t period =
+        chrono::duration_cast<chrono::nanoseconds>(_tick_start -
+                                                   _last_tick_start)
+            .count();
+    const int64_t nominal = (int64_t)(1e9 / _loop_frequency);
+    _period.record(period);
+    _last_period = period;
+    _jitter.record(period > nominal ? period - nominal : nominal - period);
+    if (!timer_did_sleep) {
+      _deadline_misses.store(_deadline_misses.load(memory_order_relaxed) + 1,
+                             memory_order_relaxed);
+    }
+  }
+  _first_tick = false;
+  _last_tick_start = _tick_start;
+}
+
+void LoopProfiler::mark(int phase) {
+  Clock::time_point now = Clock::now();
+  _phase_acc[phase] +=
+      chrono::duration_cast<chrono::nanoseconds>(now - _last_mark).count();
+  _last_mark = now;
+}
+
+void LoopProfiler::endTick() {
+  Clock::time_point now = Clock::now();
+  for (size_t i = 0; i < _phases.size(); i++) {
+    _phases[i].record(_phase_acc[i]);
+    _phase_acc[i] = 0;
+  }
+  _last_compute =
+      chrono::duration_cast<chrono::nanoseconds>(now - _tick_start).count();
+  _compute.record(_last_compute);
+  _ticks.store(_ticks.load(memory_order_relaxed) + 1, memory_order_release);
+}
+
+uint64_t LoopProfiler::deadlineMisses() const {
+  return _deadline_misses.load(memory_order_relaxed);
+}
+
+void LoopProfiler::startPublisher(const string &redis_key, double rate_hz) {
+  if (_publishing) {
+    return;
+  }
+  _publishing = true;
+  _publisher = thread([this, redis_key, rate_hz]() {
+    RedisClient redis_client;
+    redis_client.connect();
+    const auto period = chrono::duration<double>(1.0 / rate_hz);
+    auto next = Clock::now();
+    while (_publishing) {
+      next += chrono::duration_cast<Clock::duration>(period);
+      while (_publishing && Clock::now() < next) {
+        this_thread::sleep_for(chrono::milliseconds(10));
+      }
+      redis_client.set(redis_key, snapshotJSON());
+    }
+  });
+}
+
+void LoopProfiler::stopPublisher() {
+  _publishing = false;
+  if (_publisher.joinable()) {
+    _publisher.join();
+  }
+}
+
+namespace {
+void appendHistogram(string &out, const string &name,
+                     const LatencyHistogram &h) {
+  char buf[256];
+  snprintf(buf, sizeof(buf),
+           "\"%s\":{\"mean_us\":%.2f,\"p50_us\":%.2f,\"p99_us\":%.2f,"
+           "\"p999_us\":%.2f,\"max_us\":%.2f}",
+           name.c_str(), h.mean() * 1e-3, h.percentile(50) * 1e-3,
+           h.percentile(99) * 1e-3, h.percentile(99.9) * 1e-3, h.max() * 1e-3);
+  out += buf;
+}
+} // namespace
+
+string LoopProfiler::snapshotJSON() const {
+  char buf[128];
+  string out = "{\"loop\":\"" + _name + "\"";
+  snprintf(buf, sizeof(buf),
+           ",\"budget_us\":%.1f,\"ticks\":%llu,\"deadline_misses\":%llu,",
+           1e6 / _loop_frequency,
+           (unsigned long long)_ticks.load(memory_order_acquire),
+           (unsigned long long)deadlineMisses());
+  out += buf;
+  appendHistogram(out, "period", _period);
+  out += ",";
+  appendHistogram(out, "jitter", _jitter);
+  out += ",";
+  appendHistogram(out, "compute", _compute);
+  for (size_t i = 0; i < _phases.size(); i++) {
+    out += ",";
+    appendHistogram(out, _phase_names[i], _phases[i]);
+  }
+  out += "}";
+  return out;
+}
+
+void LoopProfiler::printSummary(ostream &os) const {
+  char buf[160];
+  os << _name << " timing (us)      mean     p50     p99   p99.9     max\n";
+  auto line = [&](const string &name, const LatencyHistogram &h) {
+    snprintf(buf, sizeof(buf), "  %-20s %8.1f%8.1f%8.1f%8.1f%8.1f\n",
+             name.c_str(), h.mean() * 1e-3, h.percentile(50) * 1e-3,
+             h.percentile(99) * 1e-3, h.percentile(99.9) * 1e-3,
+             h.max() * 1e-3);
+    os << buf;
+  };
+  line("period", _period);
+  line("wakeup jitter", _jitter);
+  line("compute", _compute);
+  for (size_t i = 0; i < _phases.size(); i++) {
+    line(_phase_names[i], _phases[i]);
+  }
+  os << _name << " missed deadlines : " << deadlineMisses() << " / "
+     << _ticks.load() << "\n";
+}
@@ -0,0 +1,109 @@
+/*
+Per-phase timing for the 1 kHz loops.
+The loop thread calls startTick / mark / endTick; durations go into log-linear
+(HDR-style) histograms made of relaxed atomics, so recording is a handful of
+clock reads and plain stores with no locks or allocation. Wake-up jitter is
+the deviation of each period from the nominal 1 / loop_frequency. A
+background thread publishes a JSON snapshot (percentiles, deadline misses)
+to redis at a low rate, and printSummary() is meant for the exit report.
+*/
+
+#ifndef LOOP_PROFILER_H
+#define LOOP_PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// log-linear histogram of nanosecond values, single writer / many readers
+class LatencyHistogram {
+public:
+  // 16 linear sub-buckets per power of two (~6% resolution), up to 2^35 ns
+  static const int SUB_BUCKET_BITS = 4;
+  static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  static const int MAX_EXPONENT = 34;
+  static const int NUM_BUCKETS =
+      SUB_BUCKETS + (MAX_EXPONENT - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+  LatencyHistogram();
+
+  // writer side
+  void record(uint64_t ns);
+
+  // reader side
+  uint64_t count() const;
+  uint64_t max() const;
+  double mean() const;
+  uint64_t percentile(double p) const;
+
+  static int bucketIndex(uint64_t ns);
+  static uint64_t bucketValue(int index);
+
+private:
+  std::atomic<uint64_t> _buckets[NUM_BUCKETS];
+  std::atomic<uint64_t> _count;
+  std::atomic<uint64_t> _sum;
+  std::atomic<uint64_t> _max;
+};
+
+class LoopProfiler {
+public:
+  LoopProfiler(const std::string &name, const std::vector<std::string> &phases,
+               double loop_frequency);
+  ~LoopProfiler();
+
+  // call right after LoopTimer::waitForNextLoop(); a tick where the timer did
+  // not sleep is counted as a missed deadline
+  void startTick(bool timer_did_sleep);
+  // attributes the time since the previous mark (or startTick) to phase
+  void mark(int phase);
+  void endTick();
+
+  // publishes a snapshot to redis_key every 1/rate_hz seconds from its own
+  // thread and redis connection
+  void startPublisher(const std::string &redis_key, double rate_hz = 1.0);
+  void stopPublisher();
+
+  std::string snapshotJSON() const;
+  void printSummary(std::ostream &os = std::cout) const;
+
+  uint64_t deadlineMisses() const;
+  const LatencyHistogram &period() const { return _period; }
+  const LatencyHistogram &jitter() const { return _jitter; }
+  // loop thread: period and compute time of the latest tick, ns
+  uint64_t lastPeriod() const { return _last_period; }
+  uint64_t lastCompute() const { return _last_compute; }
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  std::string _name;
+  std::vector<std::string> _phase_names;
+  double _loop_frequency; // reported as the per-tick budget
+
+  // owned by the loop thread
+  Clock::time_point _tick_start;
+  Clock::time_point _last_mark;
+  Clock::time_point _last_tick_start;
+  bool _first_tick;
+  std::vector<uint64_t> _phase_acc;
+  uint64_t _last_period;
+  uint64_t _last_compute;
+
+  // shared with readers
+  std::vector<LatencyHistogram> _phases;
+  LatencyHistogram _compute; // startTick .. endTick
+  LatencyHistogram _period;  // wake-up to wake-up
+  LatencyHistogram _jitter;  // |period - nominal period|
+  std::atomic<uint64_t> _ticks;
+  std::atomic<uint64_t> _deadline_misses;
+
+  std::atomic<bool> _publishing;
+  std::thread _publisher;
+};
+
+#endif // LOOP_PROFILER_H
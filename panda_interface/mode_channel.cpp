@@ -0,0 +1,189 @@
+#include "mode_channel.h"
+#include "redis/RedisClient.h"
+
+#include <cstring>
+#include <iostream>
+
+#include <poll.h>
+
+using namespace std;
+
+namespace {
+// longest the side thread waits on the subscription before it checks for
+// posted modes again
+const int POLL_TIMEOUT_MS = 10;
+
+const char *modeName(int mode) {
+  return mode == MODE_EVENT_SHOT_DONE
+             ? "shot_done"
+             : mode == MODE_COMMAND_EXECUTE ? "execute" : "wait";
+}
+
+uint32_t getU32(const char *p) {
+  uint32_t v = 0;
+  for (int b = 3; b >= 0; b--) {
+    v = (v << 8) | (unsigned char)p[b];
+  }
+  return v;
+}
+
+double getF64(const char *p) {
+  uint64_t bits = 0;
+  for (int b = 7; b >= 0; b--) {
+    bits = (bits << 8) | (unsigned char)p[b];
+  }
+  double v;
+  memcpy(&v, &bits, sizeof(v));
+  return v;
+}
+} // namespace
+
+bool decodeShotMessage(const char *str, size_t len, ShotMessage &shot) {
+  if (len != (size_t)SHOT_MESSAGE_SIZE || str[0] != 'S' || str[1] != 'H' ||
+      str[2] != 'T' || (unsigned char)str[3] != SHOT_MESSAGE_VERSION) {
+    return false;
+  }
+  shot.seq = getU32(str + 4);
+  shot.x = getF64(str + 8);
+  shot.y = getF64(str + 16);
+  shot.psi = getF64(str + 24);
+  shot.hit_velocity = getF64(str + 32);
+  shot.swing_angle = getF64(str + 40);
+  return true;
+}
+
+ModeChannel::ModeChannel(const string &mode_key, const string &shot_key)
+    : _mode_key(mode_key), _shot_key(shot_key), _seen(0), _outgoing(0),
+      _running(false) {}
+
+ModeChannel::~ModeChannel() { stop(); }
+
+void ModeChannel::start() {
+  if (_running) {
+    return;
+  }
+  _running = true;
+  _thread = thread(&ModeChannel::run, this);
+}
+
+void ModeChannel::stop() {
+  if (!_running) {
+    return;
+  }
+  _running = false;
+  _thread.join();
+}
+
+bool ModeChannel::poll(ModeCommand &command) {
+  if (_mailbox.version() == _seen) {
+    return false;
+  }
+  // a newer command may land in between, it is returned by the next call
+  _mailbox.load(command);
+  _seen = command.seq;
+  return true;
+}
+
+void ModeChannel::post(int mode) {
+  _outgoing.fetch_or(1u << mode, memory_order_release);
+}
+
+void ModeChannel::deliver(redisContext *redis, const char *mode, size_t len) {
+  ModeCommand command = {};
+  command.mode = MODE_COMMAND_WAIT;
+  if (len == 7 && strncmp(mode, "execute", len) == 0) {
+    // the state machine sets the shot before publishing "execute"
+    redisReply *reply =
+        (redisReply *)redisCommand(redis, "GET %s", _shot_key.c_str());
+    bool valid = reply != nullptr && reply->type == REDIS_REPLY_STRING &&
+                 decodeShotMessage(reply->str, reply->len, command.shot);
+    if (reply != nullptr) {
+      freeReplyObject(reply);
+    }
+    if (!valid) {
+      cerr << "ModeChannel: \"execute\" without a valid " << _shot_key
+           << " message, ignored" << endl;
+      return;
+    }
+    command.mode = MODE_COMMAND_EXECUTE;
+  } else if (!(len == 4 && strncmp(mode, "wait", len) == 0)) {
+    return;
+  }
+  // single writer, so the version after this store is known
+  command.seq = _mailbox.version() + 1;
+  _mailbox.store(command);
+}
+
+void ModeChannel::run() {
+  // a subscribed connection cannot send other commands
+  RedisClient subscriber, publisher;
+  subscriber.connect();
+  publisher.connect();
+  redisContext *sub = subscriber.context_.get();
+  redisContext *pub = publisher.context_.get();
+
+  // subscribe before reading the key, so nothing published in between is
+  // missed
+  redisReply *reply =
+      (redisReply *)redisCommand(sub, "SUBSCRIBE %s", _mode_key.c_str());
+  if (reply == nullptr) {
+    cerr << "ModeChannel: SUBSCRIBE failed, no mode commands" << endl;
+    return;
+  }
+  freeReplyObject(reply);
+  reply = (redisReply *)redisCommand(pub, "GET %s", _mode_key.c_str());
+  if (reply != nullptr) {
+    if (reply->type == REDIS_REPLY_STRING) {
+      deliver(pub, reply->str, reply->len);
+    }
+    freeReplyObject(reply);
+  }
+
+  while (_running) {
+    const unsigned pending = _outgoing.exchange(0, memory_order_acquire);
+    for (int mode :
+         {MODE_EVENT_SHOT_DONE, MODE_COMMAND_WAIT, MODE_COMMAND_EXECUTE}) {
+      if (!(pending & (1u << mode))) {
+        continue;
+      }
+      // the key for readers that poll it (modes only), the channel for those
+      // that listen
+      const char *name = modeName(mode);
+      for (const char *command : {"SET %s %s", "PUBLISH %s %s"}) {
+        if (mode == MODE_EVENT_SHOT_DONE && command[0] == 'S') {
+          continue;
+        }
+        reply = (redisReply *)redisCommand(pub, command, _mode_key.c_str(),
+                                           name);
+        if (reply != nullptr) {
+          freeReplyObject(reply);
+        }
+      }
+    }
+
+    void *message = nullptr;
+    if (redisGetReplyFromReader(sub, &message) != REDIS_OK) {
+      cerr << "ModeChannel: bad reply on the subscription" << endl;
+      break;
+    }
+    if (message == nullptr) {
+      // nothing buffered: wait for the socket (or the next posted mode)
+      pollfd fd = {sub->fd, POLLIN, 0};
+      if (::poll(&fd, 1, POLL_TIMEOUT_MS) > 0 &&
+          redisBufferRead(sub) != REDIS_OK) {
+        cerr << "ModeChannel: subscription connection lost" << endl;
+        break;
+      }
+      continue;
+    }
+    // ["message", channel, payload]
+    reply = (redisReply *)message;
+    if (reply->type == REDIS_REPLY_ARRAY && reply->elements == 3 &&
+        reply->element[0]->type == REDIS_REPLY_STRING &&
+        strcmp(reply->element[0]->str, "message") == 0 &&
+        reply->element[2]->type == REDIS_REPLY_STRING) {
+      deliver(pub, reply->element[2]->str, reply->element[2]->len);
+    }
+    freeReplyObject(reply);
+  }
+}
@@ -0,0 +1,90 @@
+/*
+Mode commands from the state machine, off the control thread.
+A side thread subscribes to the mode channel (same name as MODE_CHANGE_KEY);
+when "execute" is published it fetches the shot message (set before the
+publish), decodes it and stores the command in a seqlock mailbox. The
+control thread only checks the mailbox version each tick, so it never
+waits on redis for commands.
+
+The controller's own mode changes (back to "wait") and events ("shot_done"
+once the swing is over, so planning the next shot can overlap the return)
+go the other way: post() is a single atomic or, and the side thread sets
+the mode key (for mode changes) and publishes on the channel for the state
+machine.
+*/
+
+#ifndef MODE_CHANNEL_H
+#define MODE_CHANNEL_H
+
+#include "seqlock.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+struct redisContext;
+
+#define MODE_COMMAND_WAIT 0
+#define MODE_COMMAND_EXECUTE 1
+// controller to state machine only, published but not set on the mode key
+#define MODE_EVENT_SHOT_DONE 2
+
+// shot message: "SHT" magic, u8 version, u32 seq, then f64 x, y (cue start
+// position, mm in the board frame), psi (rad), hit velocity (m/s, 0 for the
+// controller's default) and swing angle (rad), all little-endian
+const int SHOT_MESSAGE_SIZE = 48;
+const unsigned char SHOT_MESSAGE_VERSION = 1;
+
+struct ShotMessage {
+  uint32_t seq; // set by the planner, one per shot
+  double x, y;
+  double psi;
+  double hit_velocity;
+  double swing_angle;
+};
+
+// false if str is not a shot message of this version
+bool decodeShotMessage(const char *str, size_t len, ShotMessage &shot);
+
+struct ModeCommand {
+  uint32_t seq; // mailbox version this command was stored as
+  int mode;     // MODE_COMMAND_*
+  ShotMessage shot; // for MODE_COMMAND_EXECUTE
+};
+
+class ModeChannel {
+public:
+  ModeChannel(const std::string &mode_key, const std::string &shot_key);
+  ~ModeChannel();
+
+  // connects and starts the side thread; the current value of the mode key
+  // is delivered as the first command
+  void start();
+  void stop();
+
+  // control thread: true (and the newest command) if one arrived since the
+  // last call
+  bool poll(ModeCommand &command);
+  // control thread: announce a mode change (MODE_COMMAND_*) or
+  // MODE_EVENT_SHOT_DONE to the state machine; several posted before the
+  // side thread gets to them go out as shot_done, then wait
+  void post(int mode);
+
+private:
+  void run();
+  // fetches the shot message for an "execute" and stores the command
+  void deliver(redisContext *redis, const char *mode, size_t len);
+
+  std::string _mode_key;
+  std::string _shot_key;
+
+  Seqlock<ModeCommand> _mailbox; // written by the side thread only
+  uint32_t _seen;                // control thread only, last seq returned
+  std::atomic<unsigned> _outgoing; // bit per mode / event to post
+
+  std::atomic<bool> _running;
+  std::thread _thread;
+};
+
+#endif // MODE_CHANNEL_H
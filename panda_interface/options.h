@@ -0,0 +1,68 @@
+/*
+Minimal command line switches shared by the executables, e.g.
+  ./controller_panda --binary
+*/
+
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// true if the switch (e.g. "--binary") was passed
+inline bool hasOption(int argc, char **argv, const char *name) {
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], name) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// value following the switch (e.g. "--rt-cpu 3"), or default_value
+inline double optionValue(int argc, char **argv, const char *name,
+                          double default_value) {
+  for (int i = 1; i < argc - 1; i++) {
+    if (strcmp(argv[i], name) == 0) {
+      return atof(argv[i + 1]);
+    }
+  }
+  return default_value;
+}
+
+// string following the switch, or default_value
+inline const char *optionString(int argc, char **argv, const char *name,
+                                const char *default_value) {
+  for (int i = 1; i < argc - 1; i++) {
+    if (strcmp(argv[i], name) == 0) {
+      return argv[i + 1];
+    }
+  }
+  return default_value;
+}
+
+// comma separated values following the switch (e.g. "--shot-time 1.1,1.3"),
+// or default_value
+inline std::vector<double> optionList(int argc, char **argv, const char *name,
+                                      const std::vector<double> &default_value) {
+  for (int i = 1; i < argc - 1; i++) {
+    if (strcmp(argv[i], name) == 0) {
+      std::vector<double> values;
+      const char *p = argv[i + 1];
+      while (*p != '\0') {
+        char *end;
+        const double value = strtod(p, &end);
+        if (end == p) {
+          break;
+        }
+        values.push_back(value);
+        p = *end == ',' ? end + 1 : end;
+      }
+      return values.empty() ? default_value : values;
+    }
+  }
+  return default_value;
+}
+
+#endif // OPTIONS_H
@@ -0,0 +1,584 @@
+#include "panda_controller.h"
+#include "alloc_guard.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+using namespace std;
+using namespace Eigen;
+
+namespace {
+const string control_link = "link7";
+const Vector3d control_point =
+    Vector3d((-PANDA_EE_LENGTH + 0.0254 / 2) * sin(M_PI / 4.0),
+             (PANDA_EE_LENGTH + 0.0254 / 2) * cos(M_PI / 4.0),
+             0.1070 + 0.0254 * 1);
+
+// operational space trajectory baked per tick while the arm moves to
+// q_init_desired
+const int trajectory_bake_samples = 500;
+
+// soft safety values
+const std::array<double, 7> joint_position_max = {2.7, 1.6, 2.7, -0.2,
+                                                  2.7, 3.6, 2.7};
+const std::array<double, 7> joint_position_min = {-2.7, -1.6, -2.7, -3.0,
+                                                  -2.7, 0.2,  -2.7};
+const std::array<double, 7> joint_velocity_limits = {2.0, 2.0, 2.0, 2.0,
+                                                     2.5, 2.5, 2.5};
+const std::array<double, 7> joint_torques_limits = {85, 85, 85, 85, 10, 10, 10};
+
+#define SOFT_LIMIT_POSITION_MAX 0
+#define SOFT_LIMIT_POSITION_MIN 1
+#define SOFT_LIMIT_VELOCITY 2
+#define SOFT_LIMIT_TORQUE 3
+const double soft_limit_log_interval = 0.5; // s
+
+// OTG: the back swing is done once the last joint is this close to its goal
+// (rad) and slower than backswing_velocity (rad/s); rate floor near limits
+const double backswing_tolerance = 0.02;
+const double backswing_velocity = 0.1;
+const double otg_min_rate = 0.1;
+
+bool inRange(double t, double lower, double upper);
+
+// desired pose from the baked table, closed form until it is complete
+void desiredPoseInTrajectory(const TrajectoryTable &table, double t,
+                             const Vector4d &cue_start_pos, double psi,
+                             const TrajectorySlots &slots, Vector3d &x,
+                             Matrix3d &rot);
+} // namespace
+
+//------------------------------------------------------------------------------
+PandaController::PandaController(Sai2Model::Sai2Model *robot,
+                                 const PandaControllerParams &params,
+                                 ConsoleLog &log, LoopProfiler *profiler)
+    : _robot(robot), _params(params), _log(log), _profiler(profiler),
+      _dof(robot->dof()), _first_step(true), _mode(WAIT_MODE),
+      _state(JOINT_CONTROLLER), _shot_finished(false), _shot_done(false),
+      _controller_counter(0),
+      _posori_task_torques(VectorXd::Zero(_dof)),
+      _joint_task_torques(VectorXd::Zero(_dof)),
+      _command_torques(VectorXd::Zero(_dof)),
+      // regularized mass matrix factored once per tick and shared by both
+      // task models; in simulation the model is computed here, on hardware
+      // _M is the driver's, set by the caller in EXECUTE_MODE
+      _dynamics(robot, params.simulation,
+                VectorXd::Constant(_dof, params.inertia_regularization ? 0.1
+                                                                       : 0.0)),
+      // posori / joint task models, fixed-size for the 7 joints of the panda
+      _task_models(robot),
+      _trajectory_table(params.slots.t_0, params.slots.t_4, 0.001),
+      _trajectory_reported(false), _otg(params.otg_limits),
+      _x(Vector3d::Zero()),
+      _xdot(Vector3d::Zero()), _xddot(Vector3d::Zero()),
+      _omega(Vector3d::Zero()), _alpha(Vector3d::Zero()),
+      _rotation(Matrix3d::Identity()),
+      _cue_start_pos(Vector4d::Zero()), _psi(90 * M_PI / 180.0),
+      _shot_angular_velocity(0), _shot_speed(0), _theta_mid(-1.03 + 0.2),
+      _shot_start(0), _swing_start(params.slots.t_4), _centershot(false),
+      _swing_done(false), _has_queued_shot(false),
+      _soft_limit_violations(0) {
+  if (!_task_models.fixed()) {
+    cout << "Robot has " << _dof << " joints, using dynamic task models"
+         << endl;
+  }
+
+  // pose task
+  _posori_task =
+      new Sai2Primitives::PosOriTask(robot, control_link, control_point);
+
+  // with params.otg the goal comes from ShotTrajectory; the saturation stays
+  // on as a safety net either way
+  _posori_task->_use_velocity_saturation_flag = true;
+
+  _posori_task->_kp_pos = 400.0;
+  _posori_task->_kv_pos = 25.0;
+  _posori_task->_kp_ori = 400.0;
+  _posori_task->_kv_ori = 25.0;
+
+  // joint task
+  _joint_task = new Sai2Primitives::JointTask(robot);
+
+  _joint_task->_use_velocity_saturation_flag = true;
+  _joint_task->_saturation_velocity = M_PI / 3 * VectorXd::Ones(_dof);
+
+  _joint_task->_kp = 150.0;
+  _joint_task->_kv = 20.0;
+
+  _q_init_desired << 0.004, -0.44, 0.315, -1.63, 1.53, 2.15, -0.33;
+  _joint_task->_desired_position = _q_init_desired;
+
+  _safe_joint_positions << 0.0, 0.0, 0.0, -1.6, 0.0, 1.9, 0.0;
+
+  // console messages; the ones repeated every tick of a state are rate
+  // limited
+  _log_execute = log.site("Going into EXECUTE_MODE");
+  _log_shot =
+      log.site("shot %g: desired cue pos in board frame: %g %g, psi: %g");
+  _log_angular_velocity = log.site("shot angular velocity is %g");
+  _log_trajectory = log.site("Trajectory table baked: %g samples in %g ms");
+  _log_otg = log.site(
+      "OTG segments: to cue %g s, along arc %g s, aim %g s, home %g s");
+  _log_joint_goal = log.site("Reached JOINT Goal");
+  _log_final_goal = log.site("Reached Final Goal\nGoing into WAIT_MODE..");
+  _log_queued = log.site("shot %g queued");
+  _log_next_shot =
+      log.site("Reached Final Goal\nGoing into the queued shot..");
+  _log_shooting = log.site("Shooting", 1.0);
+  _log_centershot = log.site("slowing down for centershot", 1.0);
+  _log_done_shooting = log.site("Done Shooting");
+  const char *soft_limit_formats[4] = {
+      "------!! VIOLATED MAX JOINT POSITION SOFT LIMIT !!------- for joint %g",
+      "------!! VIOLATED MIN JOINT POSITION SOFT LIMIT !!------- for joint %g",
+      "------!! VIOLATED MAX JOINT VELOCITY SOFT LIMIT !!------- for joint %g",
+      "------!! VIOLATED MAX JOINT TORQUE SOFT LIMIT !!------- for joint %g"};
+  // one site per limit and joint, so each violation is rate limited on its own
+  for (int limit = 0; limit < 4; limit++) {
+    for (int i = 0; i < 7; i++) {
+      _log_soft_limit[limit][i] =
+          log.site(soft_limit_formats[limit], soft_limit_log_interval);
+    }
+  }
+}
+
+PandaController::~PandaController() {
+  delete _posori_task;
+  delete _joint_task;
+}
+
+void PandaController::setGains(const PosOriGains &gains) {
+  _joint_task->_kp = gains.joint_kp;
+  _joint_task->_kv = gains.joint_kv;
+  _posori_task->_kp_pos = gains.kp_pos;
+  _posori_task->_kv_pos = gains.kv_pos;
+  _posori_task->_kp_ori = gains.kp_ori;
+  _posori_task->_kv_ori = gains.kv_ori;
+}
+
+void PandaController::startShot(const ShotMessage &shot) {
+  _mode = EXECUTE_MODE;
+  _swing_done = false;
+  _log.log(_log_execute);
+
+  _cue_start_pos << 0.001 * shot.x, 0.001 * shot.y, 0, 1;
+  _psi = shot.psi;
+  _log.log(_log_shot, shot.seq, _cue_start_pos(0), _cue_start_pos(1), _psi);
+
+  if (_psi <= 1.571 && _psi >= 1.569) {
+    _centershot = true;
+  }
+
+  // the trajectory is fixed from here on
+  if (_params.otg) {
+    _otg.plan(_cue_start_pos, _psi);
+    _log.log(_log_otg, _otg.duration(OTG_TO_CUE),
+             _otg.duration(OTG_ALONG_ARC), _otg.duration(OTG_AIM),
+             _otg.duration(OTG_HOME));
+    // nothing to bake
+    _trajectory_reported = true;
+  } else {
+    const double shot_psi = _psi;
+    _trajectory_table.reset(
+        [this](double t_sample) {
+          return calculatePointInTrajectory(t_sample, _cue_start_pos,
+                                            _params.slots);
+        },
+        [this, shot_psi](double t_sample) {
+          return calculateRotationInTrajectory(t_sample, shot_psi,
+                                               _params.slots);
+        });
+    _trajectory_reported = false;
+  }
+
+  const double hit_velocity = shot.hit_velocity > 0
+                                  ? shot.hit_velocity
+                                  : _params.default_hit_velocity;
+  // swing_angle only sets the shape of the sinusoidal swing, which the shot
+  // does not use (yet)
+  _shot_angular_velocity = hit_velocity / PANDA_EE_LENGTH;
+  _shot_speed = _centershot ? _params.centershot_velocity * PANDA_EE_LENGTH
+                            : hit_velocity;
+  _log.log(_log_angular_velocity, _shot_angular_velocity);
+}
+
+void PandaController::startApproach() {
+  _controller_counter = 0;
+  _otg.start(OTG_TO_CUE);
+  desiredPose(0);
+  setGains(_params.approach);
+  _state = POSORI_CONTROLLER;
+}
+
+const VectorXd &PandaController::step(const ModeCommand *execute) {
+  _shot_finished = false;
+  _shot_done = false;
+  if (_first_step) {
+    _robot->updateModel();
+    _first_step = false;
+  }
+
+  // update cartesian position of the robot from joint angles
+  _robot->position(_x, control_link, control_point); // position of end effector
+  _robot->linearVelocity(_xdot, control_link,
+                         control_point); // velocity of end effector
+  _robot->linearAcceleration(_xddot, control_link, control_point);
+  _robot->angularVelocity(_omega, control_link);
+  _robot->angularAcceleration(_alpha, control_link);
+  _robot->rotation(_rotation, control_link);
+
+  // calculate current time;
+  double dt = 0.001;
+  double t = _controller_counter * dt;
+  const TrajectorySlots &slots = _params.slots;
+
+  if (_mode == WAIT_MODE) {
+    // the arm is at rest here, so this is usually kinematics only (_M is not
+    // read from the driver in WAIT_MODE)
+    _dynamics.update(false);
+    mark(PHASE_MODEL_UPDATE);
+    _joint_task->reInitializeTask();
+    _task_models.updateJoint(_joint_task);
+    mark(PHASE_TASK_MODEL);
+    _joint_task->computeTorques(_joint_task_torques);
+    _command_torques = _joint_task_torques;
+    mark(PHASE_TORQUES);
+
+    if (execute != nullptr) {
+      startShot(execute->shot);
+    }
+
+  } else if (_mode == EXECUTE_MODE) {
+    // the next shot, once there is no going back on this one
+    if (execute != nullptr && _swing_done) {
+      _queued_shot = execute->shot;
+      _has_queued_shot = true;
+      _log.log(_log_queued, _queued_shot.seq);
+    }
+
+    // update model (on hardware _M was filled in by the caller)
+    _dynamics.update();
+    mark(PHASE_MODEL_UPDATE);
+
+    if (!_trajectory_reported &&
+        _trajectory_table.bakeStep(trajectory_bake_samples)) {
+      _log.log(_log_trajectory, _trajectory_table.size(),
+               _trajectory_table.bakeTime() * 1e3);
+      _trajectory_reported = true;
+    }
+
+    if (_state == JOINT_CONTROLLER) {
+      // update task model and set hierarchy
+      _joint_task->_desired_position = _q_init_desired;
+      _task_models.updateJoint(_joint_task);
+      _joint_task->_kp = 250.0;
+      mark(PHASE_TASK_MODEL);
+
+      // compute torques
+      _joint_task->computeTorques(_joint_task_torques);
+
+      _command_torques = _joint_task_torques;
+      mark(PHASE_TORQUES);
+
+      if ((_robot->_q - _q_init_desired).norm() < 0.15) {
+        _log.log(_log_joint_goal);
+        t = 0;
+        startApproach();
+      }
+    }
+
+    else if (_state == POSORI_CONTROLLER) {
+      // the OTG moves on to the next segment as each completes, up to the
+      // aim; home follows the shot
+      if (_params.otg && _otg.advance(dt, otgRate()) &&
+          _otg.segment() < OTG_AIM) {
+        _otg.start(_otg.segment() + 1);
+      }
+      const bool returned =
+          _params.otg ? _otg.segment() == OTG_HOME && _otg.complete()
+                      : t > slots.t_4;
+      // shoot once aimed: at t_3, or when the aim segment is done and the
+      // end effector has settled on it
+      const bool aimed =
+          _params.otg
+              ? _otg.segment() == OTG_AIM && _otg.complete() &&
+                    (((_x - _posori_task->_desired_position).norm() <
+                          _params.otg_limits.settle_position &&
+                      _xdot.norm() < _params.otg_limits.settle_velocity) ||
+                     _otg.overtime() >= _params.otg_limits.settle_timeout)
+              : t > slots.t_3 && t < slots.t_3 + _params.shot_time;
+
+      // if the robot reaches the desired position and is at rest, come out of
+      // the loop, or go on with the queued shot
+      // 100 is arbitrarily large, represents last point in traj
+      const bool home =
+          returned &&
+          robotReachedGoal(
+              _x, calculatePointInTrajectory(100, _cue_start_pos, slots),
+              _xdot, _xddot, _omega, _alpha);
+      if (home && _has_queued_shot) {
+        // at rest at home, where the approach starts
+        _log.log(_log_next_shot);
+        _has_queued_shot = false;
+        startShot(_queued_shot);
+        t = 0;
+        startApproach();
+        _joint_task->_desired_position = _safe_joint_positions;
+      } else if (home) {
+        _log.log(_log_final_goal);
+        _mode = WAIT_MODE;
+        _shot_finished = true;
+        _state = JOINT_CONTROLLER;
+        _joint_task->_desired_position = _q_init_desired;
+      } else {
+        _joint_task->_desired_position = _safe_joint_positions;
+      }
+
+      if (aimed) {
+        _log.log(_log_shooting);
+        _state = JOINT_CONTROLLER_SHOT;
+        _joint_task->reInitializeTask();
+        _theta_mid = _robot->_q(_dof - 1);
+        _shot_start = t;
+        _swing_start = _params.otg ? numeric_limits<double>::infinity()
+                                   : slots.t_4;
+      }
+      _joint_task->_use_velocity_saturation_flag = true;
+      // update task model and set hierarchy
+      _task_models.updatePosOriJoint(_posori_task, _joint_task);
+
+      if (_params.inertia_regularization) {
+        _posori_task->_Lambda.diagonal().array() += 0.1;
+      }
+      mark(PHASE_TASK_MODEL);
+
+      desiredPose(t);
+      // compute torques
+      _posori_task->computeTorques(_posori_task_torques);
+      _joint_task->computeTorques(_joint_task_torques);
+
+      _command_torques = _posori_task_torques + _joint_task_torques;
+      mark(PHASE_TORQUES);
+    } else if (_state == JOINT_CONTROLLER_SHOT) {
+      _joint_task->_kp = 400.0;
+      // the swing starts at t_4, or with the OTG once the back swing is done
+      // (at the latest t_4 - t_3 into it)
+      if (_params.otg && t < _swing_start &&
+          ((fabs(_robot->_q(_dof - 1) - (_theta_mid + _params.backswing)) <
+                backswing_tolerance &&
+            fabs(_robot->_dq(_dof - 1)) < backswing_velocity) ||
+           t - _shot_start >= slots.t_4 - slots.t_3)) {
+        _swing_start = t;
+      }
+      if (t < _swing_start) {
+        _joint_task->_desired_position(_dof - 1) =
+            _theta_mid + _params.backswing; //+ swing_angle/2.0;
+      } else if ((t - _swing_start) <= _params.shot_time) {
+        _joint_task->_use_velocity_saturation_flag = true;
+        if (_centershot) {
+          _joint_task->_saturation_velocity << M_PI / 3, M_PI / 3, M_PI / 3,
+              M_PI / 3, M_PI / 2, M_PI / 2, _params.centershot_velocity;
+          _log.log(_log_centershot);
+        } else {
+          _joint_task->_saturation_velocity << M_PI / 3, M_PI / 3, M_PI / 3,
+              M_PI / 3, M_PI / 2, M_PI / 2, _shot_angular_velocity;
+        }
+        _joint_task->_desired_position(_dof - 1) =
+            _theta_mid - _params.follow_through;
+      }
+
+      _task_models.updateJoint(_joint_task);
+      _joint_task->_kp = 250.0;
+      mark(PHASE_TASK_MODEL);
+
+      // compute torques
+      _joint_task->computeTorques(_joint_task_torques);
+
+      _command_torques = _joint_task_torques;
+      mark(PHASE_TORQUES);
+      if (t > (_swing_start + _params.shot_time)) {
+
+        _joint_task->_use_velocity_saturation_flag = true;
+        _log.log(_log_done_shooting);
+        _centershot = false;
+        _swing_done = true;
+        _shot_done = true;
+        _otg.start(OTG_HOME);
+        desiredPose(t);
+        setGains(_params.retreat);
+        _joint_task->_saturation_velocity = M_PI / 4 * VectorXd::Ones(_dof);
+        _state = POSORI_CONTROLLER;
+      }
+    }
+
+    safetyChecks();
+
+    _controller_counter++;
+  }
+  return _command_torques;
+}
+
+void PandaController::desiredPose(double t) {
+  if (_params.otg) {
+    _otg.pose(_posori_task->_desired_position,
+              _posori_task->_desired_orientation);
+  } else {
+    desiredPoseInTrajectory(_trajectory_table, t, _cue_start_pos, _psi,
+                            _params.slots, _posori_task->_desired_position,
+                            _posori_task->_desired_orientation);
+  }
+}
+
+// 1 up to otg_limits.slowdown of the closest soft velocity / torque limit
+// (the torques of the last step), then down linearly to otg_min_rate at it
+double PandaController::otgRate() const {
+  double ratio = 0;
+  for (int i = 0; i < _dof; i++) {
+    ratio = max(ratio, abs(_robot->_dq[i]) / joint_velocity_limits[i]);
+    ratio = max(ratio, abs(_command_torques[i]) / joint_torques_limits[i]);
+  }
+  const double slowdown = _params.otg_limits.slowdown;
+  if (ratio <= slowdown) {
+    return 1;
+  }
+  return max(otg_min_rate, (1 - ratio) / (1 - slowdown));
+}
+
+// soft limit safetycheck as per the driver
+void PandaController::safetyChecks() {
+  const VectorXd &q = _robot->_q;
+  const VectorXd &dq = _robot->_dq;
+  const VectorXd &tau = _command_torques;
+  bool violated[4];
+  bool any = false;
+  for (int i = 0; i < _dof; i++) {
+    violated[SOFT_LIMIT_POSITION_MAX] = q[i] > joint_position_max[i];
+    violated[SOFT_LIMIT_POSITION_MIN] = q[i] < joint_position_min[i];
+    violated[SOFT_LIMIT_VELOCITY] = abs(dq[i]) > joint_velocity_limits[i];
+    violated[SOFT_LIMIT_TORQUE] = abs(tau[i]) > joint_torques_limits[i];
+    for (int limit = 0; limit < 4; limit++) {
+      if (violated[limit]) {
+        _log.log(_log_soft_limit[limit][i], i + 1);
+        any = true;
+      }
+    }
+  }
+  _soft_limit_violations += any;
+}
+
+//------------------------------------------------------------------------------
+bool robotReachedGoal(const Vector3d &x, const Vector3d &x_desired,
+                      const Vector3d &xdot, const Vector3d &xddot,
+                      const Vector3d &omega, const Vector3d &alpha) {
+  ScopedNoAlloc no_alloc;
+  double epsilon = 3;
+  double error_norm = 100 * xdot.norm() + 10 * (x - x_desired).norm() +
+                      1000 * xddot.norm() + 1000 * omega.norm() +
+                      1000 * alpha.norm();
+  if (error_norm < epsilon) {
+    return true;
+  }
+  return false;
+}
+
+/*
+This function returns the desired point in the operational space
+that the robot needs to track. The plan is to divide it into sections
+parametrized by 't'.
+
+From calibration and shot planner, we need (all expressed in robot frame)
+1) Home position (xh, yh, zh)
+2) Position of cue coin (xc,yc,zc) (also pre-determined)
+3) Desired position of cue coin (xcd, ycd, zcd) (get from  shot planner over
+redis when mode changes) 4) Backup and Flick Trajectory expressed in the robot
+frame (get required params from shot planner and tranform it)
+*/
+Vector3d calculatePointInTrajectory(double t, const Vector4d &cue_start_pos,
+                                    const TrajectorySlots &slots) {
+  const double t_0 = slots.t_0, t_1 = slots.t_1, t_2 = slots.t_2,
+               t_3 = slots.t_3, t_4 = slots.t_4;
+  ScopedNoAlloc no_alloc;
+  const ShotWaypoints waypoints(cue_start_pos);
+  const Vector3d &xh = waypoints.home;
+  const Vector3d &xc = waypoints.cue;
+  const Vector3d &xcd = waypoints.start;
+
+  Vector3d x;
+
+  if (inRange(t, t_0, t_1)) {
+    // home position to cue coin position
+    x = xh + (xc - xh) * (t - t_0) / (t_1 - t_0);
+  } else if (inRange(t, t_1, t_2)) {
+    // Move cue coin from home to desired position along the arc
+    double t0 = waypoints.cue_angle;
+    double tf = waypoints.start_angle;
+
+    double old_range = t_2 - t_1;
+    double new_range = tf - t0;
+    double new_t = (((t - t_1) * (new_range)) / old_range) + t0;
+
+    x = waypoints.arcPoint(new_t);
+  } else if (inRange(t, t_2, t_3)) {
+    x = xcd;
+
+  } else if (inRange(t, t_3, t_4)) {
+    x = xcd; // shooting
+  } else {
+    x = xh;
+    // cout<<"going home"<<endl;
+  }
+
+  return x;
+}
+
+/*
+From calibration and shot planner, we need:
+1) Orientation in home position (point straight and flat maybe?)
+2) Angle to which to turn to once we reach the cue coin position (get from shot
+planner over redis) 3) Angle to which to point to for the backup and shot (get
+from shot planner over redis)
+*/
+Matrix3d calculateRotationInTrajectory(double t, double psi,
+                                       const TrajectorySlots &slots) {
+  const double t_0 = slots.t_0, t_1 = slots.t_1, t_2 = slots.t_2,
+               t_3 = slots.t_3, t_4 = slots.t_4;
+  ScopedNoAlloc no_alloc;
+  Matrix3d rot;
+
+  if (inRange(t, t_0, t_1)) {
+    rot = AngleAxisd(-M_PI / 4 * (t - t_0) / (t_1 - t_0), Vector3d::UnitZ())
+              .toRotationMatrix() *
+          homeOrientation();
+  } else if (inRange(t, t_1, t_2)) {
+    // rotate -45 degrees to gather the coin
+    rot = cueOrientation();
+  } else if (inRange(t, t_2, t_3) || inRange(t, t_3, t_4)) {
+    // aim and shoot along psi
+    rot = aimOrientation(psi);
+  } else {
+    rot = homeOrientation();
+  }
+
+  return rot;
+}
+
+namespace {
+void desiredPoseInTrajectory(const TrajectoryTable &table, double t,
+                             const Vector4d &cue_start_pos, double psi,
+                             const TrajectorySlots &slots, Vector3d &x,
+                             Matrix3d &rot) {
+  if (table.ready()) {
+    table.lookup(t, x, rot);
+  } else {
+    x = calculatePointInTrajectory(t, cue_start_pos, slots);
+    rot = calculateRotationInTrajectory(t, psi, slots);
+  }
+}
+
+// return true if t lies in between lower and upper limits
+bool inRange(double t, double lower, double upper) {
+  return ((t < upper) && (t >= lower));
+}
+} // namespace
@@ -0,0 +1,240 @@
+/*
+Control law of controller_panda: the WAIT_MODE / EXECUTE_MODE state machine
+(JOINT_CONTROLLER -> POSORI_CONTROLLER -> JOINT_CONTROLLER_SHOT ->
+POSORI_CONTROLLER), the shot trajectory and the soft limit checks. The
+trajectory runs on the fixed TrajectorySlots, or with params.otg on the
+minimum-jerk segments of a ShotTrajectory, advancing as they complete.
+It has no I/O: each step() works on the robot model's _q / _dq (and _M on
+hardware, see needsMassMatrix()) as set by the caller, plus the mode command
+that arrived with them, and returns the torques. Ticks are counted, not
+timed, so the same inputs always give the same torques; controller_panda
+drives it from redis / shared memory at 1 kHz, replay_panda from a
+recording.
+Turns can be pipelined: an execute command that arrives once the swing of
+the current shot is done (shotDone()) is queued, and when the arm is back
+home the queued shot starts straight at its approach to the cue coin, in
+POSORI_CONTROLLER, without going through WAIT_MODE.
+*/
+
+#ifndef PANDA_CONTROLLER_H
+#define PANDA_CONTROLLER_H
+
+#include "Sai2Model.h"
+#include "Sai2Primitives.h"
+#include "console_log.h"
+#include "dynamics_cache.h"
+#include "loop_profiler.h"
+#include "mode_channel.h"
+#include "shot_trajectory.h"
+#include "task_models.h"
+#include "trajectory_table.h"
+
+#include <Eigen/Dense>
+
+#include <cmath>
+
+#define JOINT_CONTROLLER 0
+#define POSORI_CONTROLLER 1
+#define JOINT_CONTROLLER_SHOT 2
+#define END_SHOT 3
+
+#define WAIT_MODE 0
+#define EXECUTE_MODE 1
+
+// loop timing phases of controller_panda; step() marks the middle three
+#define PHASE_REDIS_READ 0
+#define PHASE_MODEL_UPDATE 1
+#define PHASE_TASK_MODEL 2
+#define PHASE_TORQUES 3
+#define PHASE_REDIS_WRITE 4
+
+const double PANDA_EE_LENGTH = 17.70 * 0.0254;
+
+// time slots (s) of the shot trajectory: home to the cue coin [t_0, t_1), cue
+// coin to its start position [t_1, t_2), turn to psi [t_2, t_3), back swing
+// from t_3 and the shot at t_4
+struct TrajectorySlots {
+  double t_0 = 0;
+  double t_1 = 4;
+  double t_2 = 8;
+  double t_3 = 12;
+  double t_4 = 13;
+};
+
+// gains of one POSORI_CONTROLLER segment
+struct PosOriGains {
+  double joint_kp, joint_kv;
+  double kp_pos, kv_pos;
+  double kp_ori, kv_ori;
+};
+
+struct PandaControllerParams {
+  // the model computes _M (simulation) instead of the driver supplying it
+  bool simulation = false;
+  bool inertia_regularization = true;
+  // to the cue and through the shot / back home after it
+  PosOriGains approach = {300, 25, 400, 25, 400, 25};
+  PosOriGains retreat = {200, 20, 200, 20, 200, 20};
+  // used when the shot message leaves them at 0
+  double default_hit_velocity = 3.0 * PANDA_EE_LENGTH;
+  double default_swing_angle = 120 * M_PI / 180.0;
+
+  TrajectorySlots slots;
+  // JOINT_CONTROLLER_SHOT: length (s), last joint back swing / follow
+  // through from where it was at t_3 (rad), and its saturation velocity in
+  // a center shot (rad/s, other shots use hit velocity / ee length)
+  double shot_time = 1.3;
+  double backswing = M_PI / 24;
+  double follow_through = M_PI / 4;
+  double centershot_velocity = 2.33;
+
+  // online trajectory generation instead of the slots: t_3 - t_4 is then
+  // only the longest the back swing may take
+  bool otg = false;
+  OtgLimits otg_limits;
+};
+
+// shot trajectory: desired end effector position at time t for the cue coin
+// start position (board frame, m, homogeneous) and orientation for the shot
+// angle psi, both closed form
+Eigen::Vector3d
+calculatePointInTrajectory(double t, const Eigen::Vector4d &cue_start_pos,
+                           const TrajectorySlots &slots = TrajectorySlots());
+Eigen::Matrix3d
+calculateRotationInTrajectory(double t, double psi,
+                              const TrajectorySlots &slots = TrajectorySlots());
+// true once the end effector is at x_desired and at rest
+bool robotReachedGoal(const Eigen::Vector3d &x, const Eigen::Vector3d &x_desired,
+                      const Eigen::Vector3d &xdot, const Eigen::Vector3d &xddot,
+                      const Eigen::Vector3d &omega,
+                      const Eigen::Vector3d &alpha);
+
+class PandaController {
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  typedef Eigen::Matrix<double, 7, 1> Vector7d;
+
+  // robot: model with the current state, used for the initial task goals;
+  // registers its console sites on log, so call before log.start();
+  // profiler (optional) gets the model / task model / torque phase marks
+  PandaController(Sai2Model::Sai2Model *robot,
+                  const PandaControllerParams &params, ConsoleLog &log,
+                  LoopProfiler *profiler = nullptr);
+  ~PandaController();
+
+  // true if the caller has to provide the driver's _M before the next step
+  bool needsMassMatrix() const {
+    return !_params.simulation && _mode == EXECUTE_MODE;
+  }
+
+  // one tick; execute is the execute command that arrived this tick or
+  // nullptr. In EXECUTE_MODE it is queued if the swing is done, else
+  // dropped. The first step computes the whole model from the state it is
+  // given, so a replay from the first recorded row starts from the same model
+  const Eigen::VectorXd &step(const ModeCommand *execute);
+
+  // true if the last step finished the shot (back in WAIT_MODE); a shot
+  // followed by a queued one never finishes this way
+  bool shotFinished() const { return _shot_finished; }
+  // true if the last step ended the swing of the shot, the arm going home
+  bool shotDone() const { return _shot_done; }
+  bool hasQueuedShot() const { return _has_queued_shot; }
+
+  int mode() const { return _mode; }
+  int state() const { return _state; }
+  const Eigen::VectorXd &torques() const { return _command_torques; }
+  // end effector position / velocity / orientation at the start of the last
+  // step
+  const Eigen::Vector3d &position() const { return _x; }
+  const Eigen::Vector3d &velocity() const { return _xdot; }
+  const Eigen::Matrix3d &rotation() const { return _rotation; }
+  // end effector speed the current (or last) shot is swung at, m/s
+  double shotSpeed() const { return _shot_speed; }
+  // steps that violated a soft limit
+  unsigned long long softLimitViolations() const {
+    return _soft_limit_violations;
+  }
+  const Sai2Primitives::PosOriTask *posoriTask() const { return _posori_task; }
+  const DynamicsCache &dynamics() const { return _dynamics; }
+  const PandaControllerParams &params() const { return _params; }
+
+private:
+  void mark(int phase) {
+    if (_profiler != nullptr) {
+      _profiler->mark(phase);
+    }
+  }
+  void startShot(const ShotMessage &shot);
+  // from the home pose (t = 0) into the approach of the current shot
+  void startApproach();
+  void setGains(const PosOriGains &gains);
+  // sets the posori task goal from the OTG or the slots at time t
+  void desiredPose(double t);
+  // rate of OTG time, lowered near the soft joint velocity / torque limits
+  double otgRate() const;
+  void safetyChecks();
+
+  Sai2Model::Sai2Model *_robot;
+  PandaControllerParams _params;
+  ConsoleLog &_log;
+  LoopProfiler *_profiler;
+  int _dof;
+
+  bool _first_step;
+  int _mode;
+  int _state;
+  bool _shot_finished;
+  bool _shot_done;
+  unsigned long long _controller_counter;
+
+  Sai2Primitives::PosOriTask *_posori_task;
+  Sai2Primitives::JointTask *_joint_task;
+  Eigen::VectorXd _posori_task_torques;
+  Eigen::VectorXd _joint_task_torques;
+  Eigen::VectorXd _command_torques;
+  Vector7d _q_init_desired;
+  Vector7d _safe_joint_positions;
+  DynamicsCache _dynamics;
+  TaskModels<7> _task_models;
+  TrajectoryTable _trajectory_table;
+  bool _trajectory_reported;
+  ShotTrajectory _otg;
+
+  // end effector state
+  Eigen::Vector3d _x, _xdot, _xddot, _omega, _alpha;
+  Eigen::Matrix3d _rotation;
+
+  // current shot
+  Eigen::Vector4d _cue_start_pos;
+  double _psi;
+  double _shot_angular_velocity;
+  double _shot_speed;
+  double _theta_mid;
+  // JOINT_CONTROLLER_SHOT start and end of the back swing, controller time
+  double _shot_start;
+  double _swing_start;
+  bool _centershot;
+  // the swing of the current shot is over, the arm is going home
+  bool _swing_done;
+  // next shot, arrived after the swing
+  bool _has_queued_shot;
+  ShotMessage _queued_shot;
+  unsigned long long _soft_limit_violations;
+
+  // console sites
+  int _log_execute;
+  int _log_shot;
+  int _log_angular_velocity;
+  int _log_trajectory;
+  int _log_otg;
+  int _log_joint_goal;
+  int _log_final_goal;
+  int _log_queued;
+  int _log_next_shot;
+  int _log_shooting;
+  int _log_centershot;
+  int _log_done_shooting;
+  int _log_soft_limit[4][7]; // one per limit and joint
+};
+
+#endif // PANDA_CONTROLLER_H
@@ -0,0 +1,211 @@
+#include "ray_kernel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RAY_KERNEL_AVX2
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define RAY_KERNEL_NEON
+#endif
+
+namespace {
+bool force_scalar = false;
+
+// circles [begin, n), keeps best / best_travel if nothing earlier is found
+void firstHitScalar(const double *x, const double *y, const double *r,
+                    int begin, int n, double ox, double oy, double ux,
+                    double uy, double radius, int skip, int &best,
+                    double &best_travel) {
+  for (int i = begin; i < n; i++) {
+    double dx = x[i] - ox;
+    double dy = y[i] - oy;
+    double p = dx * ux + dy * uy;
+    double nx = p * ux - dx;
+    double ny = p * uy - dy;
+    double n2 = nx * nx + ny * ny;
+    double r_sum = r[i] + radius;
+    if (p >= 0 && sqrt(n2) < r_sum && i != skip) {
+      double travel = p - sqrt(r_sum * r_sum - n2);
+      if (travel < best_travel) {
+        best_travel = travel;
+        best = i;
+      }
+    }
+  }
+}
+
+// lowest travel across lanes, lowest index on ties
+void reduceLanes(const double *travel, const double *index, int lanes,
+                 int &best, double &best_travel) {
+  for (int l = 0; l < lanes; l++) {
+    if (index[l] < 0) {
+      continue;
+    }
+    if (travel[l] < best_travel ||
+        (travel[l] == best_travel && (int)index[l] < best)) {
+      best_travel = travel[l];
+      best = (int)index[l];
+    }
+  }
+}
+
+#ifdef RAY_KERNEL_AVX2
+__attribute__((target("avx2"))) int
+firstHitAVX2(const double *x, const double *y, const double *r, int n,
+             double ox, double oy, double ux, double uy, double radius,
+             int skip, int &best, double &best_travel) {
+  const __m256d vox = _mm256_set1_pd(ox);
+  const __m256d voy = _mm256_set1_pd(oy);
+  const __m256d vux = _mm256_set1_pd(ux);
+  const __m256d vuy = _mm256_set1_pd(uy);
+  const __m256d vradius = _mm256_set1_pd(radius);
+  const __m256d vskip = _mm256_set1_pd(skip);
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d four = _mm256_set1_pd(4);
+  __m256d index = _mm256_set_pd(3, 2, 1, 0);
+  __m256d lane_travel =
+      _mm256_set1_pd(std::numeric_limits<double>::infinity());
+  __m256d lane_index = _mm256_set1_pd(-1);
+
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(x + i), vox);
+    __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(y + i), voy);
+    __m256d p = _mm256_add_pd(_mm256_mul_pd(dx, vux), _mm256_mul_pd(dy, vuy));
+    __m256d nx = _mm256_sub_pd(_mm256_mul_pd(p, vux), dx);
+    __m256d ny = _mm256_sub_pd(_mm256_mul_pd(p, vuy), dy);
+    __m256d n2 = _mm256_add_pd(_mm256_mul_pd(nx, nx), _mm256_mul_pd(ny, ny));
+    __m256d r_sum = _mm256_add_pd(_mm256_loadu_pd(r + i), vradius);
+    __m256d hit = _mm256_and_pd(
+        _mm256_and_pd(_mm256_cmp_pd(p, zero, _CMP_GE_OQ),
+                      _mm256_cmp_pd(_mm256_sqrt_pd(n2), r_sum, _CMP_LT_OQ)),
+        _mm256_cmp_pd(index, vskip, _CMP_NEQ_OQ));
+    // non-hits give NaN here, masked out below
+    __m256d travel = _mm256_sub_pd(
+        p, _mm256_sqrt_pd(_mm256_sub_pd(_mm256_mul_pd(r_sum, r_sum), n2)));
+    __m256d better =
+        _mm256_and_pd(hit, _mm256_cmp_pd(travel, lane_travel, _CMP_LT_OQ));
+    lane_travel = _mm256_blendv_pd(lane_travel, travel, better);
+    lane_index = _mm256_blendv_pd(lane_index, index, better);
+    index = _mm256_add_pd(index, four);
+  }
+
+  double travel[4], idx[4];
+  _mm256_storeu_pd(travel, lane_travel);
+  _mm256_storeu_pd(idx, lane_index);
+  reduceLanes(travel, idx, 4, best, best_travel);
+  return i;
+}
+#endif
+
+#ifdef RAY_KERNEL_NEON
+int firstHitNEON(const double *x, const double *y, const double *r, int n,
+                 double ox, double oy, double ux, double uy, double radius,
+                 int skip, int &best, double &best_travel) {
+  const float64x2_t vox = vdupq_n_f64(ox);
+  const float64x2_t voy = vdupq_n_f64(oy);
+  const float64x2_t vux = vdupq_n_f64(ux);
+  const float64x2_t vuy = vdupq_n_f64(uy);
+  const float64x2_t vradius = vdupq_n_f64(radius);
+  const float64x2_t vskip = vdupq_n_f64(skip);
+  const float64x2_t zero = vdupq_n_f64(0);
+  const float64x2_t two = vdupq_n_f64(2);
+  const double first_index[2] = {0, 1};
+  float64x2_t index = vld1q_f64(first_index);
+  float64x2_t lane_travel =
+      vdupq_n_f64(std::numeric_limits<double>::infinity());
+  float64x2_t lane_index = vdupq_n_f64(-1);
+
+  int i = 0;
+  for (; i + 2 <= n; i += 2) {
+    float64x2_t dx = vsubq_f64(vld1q_f64(x + i), vox);
+    float64x2_t dy = vsubq_f64(vld1q_f64(y + i), voy);
+    float64x2_t p = vaddq_f64(vmulq_f64(dx, vux), vmulq_f64(dy, vuy));
+    float64x2_t nx = vsubq_f64(vmulq_f64(p, vux), dx);
+    float64x2_t ny = vsubq_f64(vmulq_f64(p, vuy), dy);
+    float64x2_t n2 = vaddq_f64(vmulq_f64(nx, nx), vmulq_f64(ny, ny));
+    float64x2_t r_sum = vaddq_f64(vld1q_f64(r + i), vradius);
+    uint64x2_t hit = vandq_u64(
+        vandq_u64(vcgeq_f64(p, zero), vcltq_f64(vsqrtq_f64(n2), r_sum)),
+        vreinterpretq_u64_u32(
+            vmvnq_u32(vreinterpretq_u32_u64(vceqq_f64(index, vskip)))));
+    float64x2_t travel =
+        vsubq_f64(p, vsqrtq_f64(vsubq_f64(vmulq_f64(r_sum, r_sum), n2)));
+    uint64x2_t better = vandq_u64(hit, vcltq_f64(travel, lane_travel));
+    lane_travel = vbslq_f64(better, travel, lane_travel);
+    lane_index = vbslq_f64(better, index, lane_index);
+    index = vaddq_f64(index, two);
+  }
+
+  double travel[2], idx[2];
+  vst1q_f64(travel, lane_travel);
+  vst1q_f64(idx, lane_index);
+  reduceLanes(travel, idx, 2, best, best_travel);
+  return i;
+}
+#endif
+} // namespace
+
+void setRayKernelScalar(bool scalar) { force_scalar = scalar; }
+
+int firstHit(const double *x, const double *y, const double *r, int n,
+             double ox, double oy, double ux, double uy, double radius,
+             int skip, RayHit *hit) {
+  int best = -1;
+  double best_travel = std::numeric_limits<double>::infinity();
+  int done = 0;
+  if (ux == 0 && uy == 0) {
+    // not moving
+    done = n;
+  } else if (!force_scalar) {
+#if defined(RAY_KERNEL_AVX2)
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    if (has_avx2) {
+      done = firstHitAVX2(x, y, r, n, ox, oy, ux, uy, radius, skip, best,
+                          best_travel);
+    }
+#elif defined(RAY_KERNEL_NEON)
+    done = firstHitNEON(x, y, r, n, ox, oy, ux, uy, radius, skip, best,
+                        best_travel);
+#endif
+  }
+  firstHitScalar(x, y, r, done, n, ox, oy, ux, uy, radius, skip, best,
+                 best_travel);
+
+  if (hit != nullptr) {
+    hit->index = best;
+    hit->travel = best_travel;
+    if (best >= 0) {
+      // contact point, r / (r + radius) of the way from the circle center
+      // to the moving coin's center at contact
+      double mx = ox + best_travel * ux;
+      double my = oy + best_travel * uy;
+      double k = r[best] / (r[best] + radius);
+      hit->cx = x[best] + k * (mx - x[best]);
+      hit->cy = y[best] + k * (my - y[best]);
+    }
+  }
+  return best;
+}
+
+double minClearance(const double *x, const double *y, const double *r, int n,
+                    double ox, double oy, double ux, double uy, double radius,
+                    double max_travel, int skip) {
+  double clearance = std::numeric_limits<double>::infinity();
+  for (int i = 0; i < n; i++) {
+    double dx = x[i] - ox;
+    double dy = y[i] - oy;
+    double p = dx * ux + dy * uy;
+    if (p < 0 || p > max_travel || i == skip) {
+      continue;
+    }
+    double nx = p * ux - dx;
+    double ny = p * uy - dy;
+    clearance = std::min(clearance, sqrt(nx * nx + ny * ny) - r[i] - radius);
+  }
+  return clearance;
+}
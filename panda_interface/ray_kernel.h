@@ -0,0 +1,37 @@
+/*
+Ray / circle first-hit kernel for tracing coin paths.
+A coin of radius r moving from an origin along a unit direction is tested
+against a whole structure-of-arrays set of circles (coins, posts) at once;
+the result is the circle it touches first and the contact point. The same
+hit test as collide() in src/coin.py: the circle must lie ahead of the coin
+(non-negative projection) and closer to the path than the two radii.
+
+AVX2 (selected at runtime on x86-64) and NEON (aarch64) versions process 4
+and 2 circles per step, with a scalar loop for the tail and for other CPUs.
+*/
+
+#ifndef RAY_KERNEL_H
+#define RAY_KERNEL_H
+
+struct RayHit {
+  int index;     // circle hit first, -1 if none
+  double travel; // distance the coin center moves until contact
+  double cx, cy; // contact point, on the circle's boundary
+};
+
+// skip: index of a circle to ignore (e.g. the target itself), or -1
+int firstHit(const double *x, const double *y, const double *r, int n,
+             double ox, double oy, double ux, double uy, double radius,
+             int skip, RayHit *hit);
+
+// smallest gap between the swept coin and any circle ahead of it whose
+// projection along the path is at most max_travel past the origin (the gap
+// is negative for circles the coin runs into); +inf if there are none
+double minClearance(const double *x, const double *y, const double *r, int n,
+                    double ox, double oy, double ux, double uy, double radius,
+                    double max_travel, int skip);
+
+// forces the scalar path, for testing the SIMD versions against it
+void setRayKernelScalar(bool scalar);
+
+#endif // RAY_KERNEL_H
@@ -0,0 +1,86 @@
+#include "realtime.h"
+#include "options.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <alloca.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+using namespace std;
+
+namespace {
+const int DEFAULT_PRIORITY = 80;
+const size_t DEFAULT_STACK_PREFAULT = 512 * 1024;
+
+// touches the pages below the current frame, which stay resident once the
+// memory is locked
+__attribute__((noinline)) void prefaultStack(size_t bytes) {
+  volatile char *stack = (volatile char *)alloca(bytes);
+  for (size_t i = 0; i < bytes; i += 4096) {
+    stack[i] = 0;
+  }
+}
+} // namespace
+
+RealtimeOptions realtimeOptions(int argc, char **argv) {
+  RealtimeOptions options;
+  options.enabled = hasOption(argc, argv, "--rt");
+  options.priority =
+      (int)optionValue(argc, argv, "--rt-priority", DEFAULT_PRIORITY);
+  options.cpu = (int)optionValue(argc, argv, "--rt-cpu", -1);
+  options.stack_prefault = DEFAULT_STACK_PREFAULT;
+  return options;
+}
+
+bool enterRealtime(const RealtimeOptions &options, const char *name) {
+  if (!options.enabled) {
+    return true;
+  }
+  bool ok = true;
+
+  // keep freed heap memory mapped instead of trimming / unmapping it, so
+  // locked pages are reused rather than faulted in again
+  mallopt(M_TRIM_THRESHOLD, -1);
+  mallopt(M_MMAP_MAX, 0);
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    cerr << name << ": mlockall failed (" << strerror(errno)
+         << "), check ulimit -l" << endl;
+    ok = false;
+  }
+  prefaultStack(options.stack_prefault);
+
+  if (options.cpu >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(options.cpu, &cpus);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (err != 0) {
+      cerr << name << ": cannot pin to cpu " << options.cpu << " ("
+           << strerror(err) << ")" << endl;
+      ok = false;
+    }
+  }
+
+  sched_param param;
+  memset(&param, 0, sizeof(param));
+  param.sched_priority = options.priority;
+  int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+  if (err != 0) {
+    cerr << name << ": cannot set SCHED_FIFO priority " << options.priority
+         << " (" << strerror(err) << "), check CAP_SYS_NICE / ulimit -r"
+         << endl;
+    ok = false;
+  }
+
+  cout << name << ": real-time mode, SCHED_FIFO " << options.priority;
+  if (options.cpu >= 0) {
+    cout << " on cpu " << options.cpu;
+  }
+  cout << (ok ? "" : " (incomplete, see above)") << endl;
+  return ok;
+}
@@ -0,0 +1,32 @@
+/*
+Opt-in real-time setup for the 1 kHz loops (--rt). The loop thread switches
+to SCHED_FIFO, optionally pins itself to one (ideally isolated) core, and the
+process memory is locked with its stack prefaulted, so a tick never waits on
+the CFS scheduler, a page fault or a migration. Threads inherit the policy
+and affinity of their creator, so helper threads (redis publishers, mode
+channel) must be started before enterRealtime().
+
+Needs CAP_SYS_NICE (or an rtprio limit) and a large enough memlock limit;
+every step that fails is reported and the loop continues without it.
+*/
+
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <cstddef>
+
+struct RealtimeOptions {
+  bool enabled;
+  int priority;          // SCHED_FIFO priority, 1..99
+  int cpu;               // core to pin the loop thread to, -1 for none
+  size_t stack_prefault; // bytes of stack touched up front
+};
+
+// --rt, --rt-priority <1..99> (default 80), --rt-cpu <index>
+RealtimeOptions realtimeOptions(int argc, char **argv);
+
+// applies options to the calling thread (and locks the process memory);
+// false if any step failed
+bool enterRealtime(const RealtimeOptions &options, const char *name);
+
+#endif // REALTIME_H
@@ -0,0 +1,393 @@
+#include "redis_pipeline.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+using namespace Eigen;
+
+RedisPipeline::RedisPipeline(RedisClient &redis_client)
+    : _redis_client(redis_client), _binary(false), _argv(1), _argv_len(1) {}
+
+int RedisPipeline::addRead(const string &key, VectorXd *value) {
+  _reads.push_back({key, EIGEN_VECTOR, value, true, false});
+  _argv.resize(1 + max(_reads.size(), 2 * _writes.size()));
+  _argv_len.resize(_argv.size());
+  _read_index.resize(_reads.size());
+  return _reads.size() - 1;
+}
+
+int RedisPipeline::addRead(const string &key, MatrixXd *value) {
+  int handle = addRead(key, (VectorXd *)nullptr);
+  _reads[handle].type = EIGEN_MATRIX;
+  _reads[handle].value = value;
+  return handle;
+}
+
+int RedisPipeline::addRead(const string &key, string *value) {
+  int handle = addRead(key, (VectorXd *)nullptr);
+  _reads[handle].type = STRING;
+  _reads[handle].value = value;
+  return handle;
+}
+
+int RedisPipeline::addWrite(const string &key, const VectorXd *value) {
+  _writes.push_back({key, EIGEN_VECTOR, value, true, string()});
+  _writes.back().buffer.reserve(512);
+  _argv.resize(1 + max(_reads.size(), 2 * _writes.size()));
+  _argv_len.resize(_argv.size());
+  return _writes.size() - 1;
+}
+
+int RedisPipeline::addWrite(const string &key, const string *value) {
+  int handle = addWrite(key, (const VectorXd *)nullptr);
+  _writes[handle].type = STRING;
+  _writes[handle].value = value;
+  return handle;
+}
+
+void RedisPipeline::setBinaryEncoding(bool binary) { _binary = binary; }
+
+void RedisPipeline::setReadEnabled(int handle, bool enabled) {
+  _reads[handle].enabled = enabled;
+}
+
+void RedisPipeline::setWriteEnabled(int handle, bool enabled) {
+  _writes[handle].enabled = enabled;
+}
+
+bool RedisPipeline::readValid(int handle) const {
+  return _reads[handle].valid;
+}
+
+void RedisPipeline::read() {
+  int argc = 0;
+  _argv[argc] = "MGET";
+  _argv_len[argc++] = 4;
+  int n = 0;
+  for (int i = 0; i < (int)_reads.size(); i++) {
+    if (!_reads[i].enabled) {
+      continue;
+    }
+    _argv[argc] = _reads[i].key.c_str();
+    _argv_len[argc++] = _reads[i].key.size();
+    _read_index[n++] = i;
+  }
+  if (n == 0) {
+    return;
+  }
+
+  redisReply *reply = (redisReply *)redisCommandArgv(
+      _redis_client.context_.get(), argc, _argv.data(), _argv_len.data());
+  if (reply == nullptr) {
+    throw runtime_error("RedisPipeline: MGET failed, connection lost");
+  }
+  if (reply->type != REDIS_REPLY_ARRAY || (int)reply->elements != n) {
+    freeReplyObject(reply);
+    throw runtime_error("RedisPipeline: unexpected MGET reply");
+  }
+
+  for (int k = 0; k < n; k++) {
+    ReadEntry &entry = _reads[_read_index[k]];
+    const redisReply *element = reply->element[k];
+    entry.valid = (element->type == REDIS_REPLY_STRING);
+    if (!entry.valid) {
+      continue;
+    }
+    switch (entry.type) {
+    case EIGEN_VECTOR:
+      entry.valid =
+          decode(element->str, element->len, *(VectorXd *)entry.value);
+      break;
+    case EIGEN_MATRIX:
+      entry.valid =
+          decode(element->str, element->len, *(MatrixXd *)entry.value);
+      break;
+    case STRING:
+      ((string *)entry.value)->assign(element->str, element->len);
+      break;
+    }
+  }
+  freeReplyObject(reply);
+}
+
+bool RedisPipeline::get(const string &key, VectorXd &value) {
+  const char *argv[2] = {"GET", key.c_str()};
+  const size_t argv_len[2] = {3, key.size()};
+  redisReply *reply = (redisReply *)redisCommandArgv(
+      _redis_client.context_.get(), 2, argv, argv_len);
+  if (reply == nullptr) {
+    throw runtime_error("RedisPipeline: GET failed, connection lost");
+  }
+  bool valid = (reply->type == REDIS_REPLY_STRING) &&
+               decode(reply->str, reply->len, value);
+  freeReplyObject(reply);
+  return valid;
+}
+
+void RedisPipeline::write() {
+  int argc = 0;
+  _argv[argc] = "MSET";
+  _argv_len[argc++] = 4;
+  for (auto &entry : _writes) {
+    if (!entry.enabled) {
+      continue;
+    }
+    const string *payload = &entry.buffer;
+    if (entry.type == STRING) {
+      payload = (const string *)entry.value;
+    } else if (_binary) {
+      encodeBinary(*(const VectorXd *)entry.value, entry.buffer);
+    } else {
+      encodeJSON(*(const VectorXd *)entry.value, entry.buffer);
+    }
+    _argv[argc] = entry.key.c_str();
+    _argv_len[argc++] = entry.key.size();
+    _argv[argc] = payload->data();
+    _argv_len[argc++] = payload->size();
+  }
+  if (argc == 1) {
+    return;
+  }
+
+  redisReply *reply = (redisReply *)redisCommandArgv(
+      _redis_client.context_.get(), argc, _argv.data(), _argv_len.data());
+  if (reply == nullptr) {
+    throw runtime_error("RedisPipeline: MSET failed, connection lost");
+  }
+  freeReplyObject(reply);
+}
+
+namespace {
+
+bool isSeparator(char c) {
+  return c == '[' || c == ']' || c == ',' || c == ' ';
+}
+
+// counts the numbers in a JSON array and the number of nested rows
+int countNumbers(const char *str, size_t len, int &rows) {
+  int numbers = 0, depth = 0;
+  bool in_number = false;
+  rows = 0;
+  for (size_t i = 0; i < len; i++) {
+    char c = str[i];
+    if (c == '[' && ++depth == 2) {
+      rows++;
+    } else if (c == ']') {
+      depth--;
+    }
+    if (isSeparator(c)) {
+      in_number = false;
+    } else if (!in_number) {
+      in_number = true;
+      numbers++;
+    }
+  }
+  return numbers;
+}
+
+// reads the next number, skipping brackets and commas
+bool nextNumber(const char *&p, const char *end, double &number) {
+  while (p < end && isSeparator(*p)) {
+    p++;
+  }
+  char *next = nullptr;
+  number = strtod(p, &next);
+  if (next == p) {
+    return false;
+  }
+  p = next;
+  return true;
+}
+
+} // namespace
+
+// parses "[a,b,c]" (column vector) or "[[a,b],[c,d]]" (row-major matrix)
+bool RedisPipeline::decodeJSON(const char *str, size_t len, MatrixXd &value) {
+  int rows = 0;
+  int numbers = countNumbers(str, len, rows);
+  if (numbers == 0) {
+    return false;
+  }
+  int cols = 1;
+  if (rows == 0) {
+    rows = numbers;
+  } else if (numbers % rows != 0) {
+    return false;
+  } else {
+    cols = numbers / rows;
+  }
+  if (value.rows() != rows || value.cols() != cols) {
+    value.resize(rows, cols);
+  }
+
+  const char *p = str;
+  for (int k = 0; k < numbers; k++) {
+    if (!nextNumber(p, str + len, value(k / cols, k % cols))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool RedisPipeline::decodeJSON(const char *str, size_t len, VectorXd &value) {
+  int rows = 0;
+  int numbers = countNumbers(str, len, rows);
+  if (numbers == 0) {
+    return false;
+  }
+  if (value.size() != numbers) {
+    value.resize(numbers);
+  }
+
+  const char *p = str;
+  for (int k = 0; k < numbers; k++) {
+    if (!nextNumber(p, str + len, value(k))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void RedisPipeline::encodeJSON(const MatrixXd &value, string &out) {
+  char number[32];
+  out.clear();
+  out.push_back('[');
+  for (int i = 0; i < value.rows(); i++) {
+    if (i > 0) {
+      out.push_back(',');
+    }
+    out.push_back('[');
+    for (int j = 0; j < value.cols(); j++) {
+      if (j > 0) {
+        out.push_back(',');
+      }
+      int n = snprintf(number, sizeof(number), "%.17g", value(i, j));
+      out.append(number, n);
+    }
+    out.push_back(']');
+  }
+  out.push_back(']');
+}
+
+void RedisPipeline::encodeJSON(const VectorXd &value, string &out) {
+  char number[32];
+  out.clear();
+  out.push_back('[');
+  for (int i = 0; i < value.size(); i++) {
+    if (i > 0) {
+      out.push_back(',');
+    }
+    int n = snprintf(number, sizeof(number), "%.17g", value(i));
+    out.append(number, n);
+  }
+  out.push_back(']');
+}
+
+namespace {
+
+bool hostIsLittleEndian() {
+  const uint16_t one = 1;
+  return *(const unsigned char *)&one == 1;
+}
+
+void putU16(char *p, uint16_t v) {
+  p[0] = (char)(v & 0xff);
+  p[1] = (char)(v >> 8);
+}
+
+uint16_t getU16(const char *p) {
+  return (uint16_t)((unsigned char)p[0] | ((unsigned char)p[1] << 8));
+}
+
+// copies n doubles, swapping byte order on big-endian hosts
+void copyLittleEndian(char *dst, const char *src, int n) {
+  memcpy(dst, src, n * sizeof(double));
+  if (!hostIsLittleEndian()) {
+    for (int k = 0; k < n; k++) {
+      char *d = dst + k * sizeof(double);
+      for (int b = 0; b < (int)sizeof(double) / 2; b++) {
+        std::swap(d[b], d[sizeof(double) - 1 - b]);
+      }
+    }
+  }
+}
+
+void encodeBinaryData(const double *data, int rows, int cols, string &out) {
+  out.resize(RedisPipeline::BINARY_HEADER_SIZE + rows * cols * sizeof(double));
+  char *p = &out[0];
+  p[0] = 'E';
+  p[1] = 'G';
+  p[2] = 'N';
+  p[3] = (char)RedisPipeline::BINARY_VERSION;
+  putU16(p + 4, rows);
+  putU16(p + 6, cols);
+  copyLittleEndian(p + RedisPipeline::BINARY_HEADER_SIZE, (const char *)data,
+                   rows * cols);
+}
+
+} // namespace
+
+bool RedisPipeline::isBinary(const char *str, size_t len) {
+  return len >= (size_t)BINARY_HEADER_SIZE && str[0] == 'E' &&
+         str[1] == 'G' && str[2] == 'N';
+}
+
+bool RedisPipeline::decodeBinary(const char *str, size_t len,
+                                 MatrixXd &value) {
+  if (!isBinary(str, len) || (unsigned char)str[3] != BINARY_VERSION) {
+    return false;
+  }
+  int rows = getU16(str + 4);
+  int cols = getU16(str + 6);
+  if (len != BINARY_HEADER_SIZE + rows * cols * sizeof(double)) {
+    return false;
+  }
+  if (value.rows() != rows || value.cols() != cols) {
+    value.resize(rows, cols);
+  }
+  copyLittleEndian((char *)value.data(), str + BINARY_HEADER_SIZE,
+                   rows * cols);
+  return true;
+}
+
+bool RedisPipeline::decodeBinary(const char *str, size_t len,
+                                 VectorXd &value) {
+  if (!isBinary(str, len) || (unsigned char)str[3] != BINARY_VERSION) {
+    return false;
+  }
+  int size = getU16(str + 4) * getU16(str + 6);
+  if (len != BINARY_HEADER_SIZE + size * sizeof(double)) {
+    return false;
+  }
+  if (value.size() != size) {
+    value.resize(size);
+  }
+  copyLittleEndian((char *)value.data(), str + BINARY_HEADER_SIZE, size);
+  return true;
+}
+
+void RedisPipeline::encodeBinary(const MatrixXd &value, string &out) {
+  encodeBinaryData(value.data(), value.rows(), value.cols(), out);
+}
+
+void RedisPipeline::encodeBinary(const VectorXd &value, string &out) {
+  encodeBinaryData(value.data(), value.size(), 1, out);
+}
+
+bool RedisPipeline::decode(const char *str, size_t len, MatrixXd &value) {
+  if (isBinary(str, len)) {
+    return decodeBinary(str, len, value);
+  }
+  return decodeJSON(str, len, value);
+}
+
+bool RedisPipeline::decode(const char *str, size_t len, VectorXd &value) {
+  if (isBinary(str, len)) {
+    return decodeBinary(str, len, value);
+  }
+  return decodeJSON(str, len, value);
+}
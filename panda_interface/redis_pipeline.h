@@ -0,0 +1,105 @@
+/*
+Batched redis I/O for the control loops.
+Keys are registered once before the loop, then every tick costs a single
+MGET for all reads and a single MSET for all writes (one round-trip each way).
+Values are decoded into / encoded from the registered buffers in place, so
+the steady state does not allocate.
+
+Eigen values are JSON by default (what the Franka driver and the python side
+speak). With setBinaryEncoding(true) they are written as a small header
+followed by raw little-endian doubles; reads accept either format.
+*/
+
+#ifndef REDIS_PIPELINE_H
+#define REDIS_PIPELINE_H
+
+#include "redis/RedisClient.h"
+
+#include <Eigen/Dense>
+
+#include <string>
+#include <vector>
+
+class RedisPipeline {
+public:
+  explicit RedisPipeline(RedisClient &redis_client);
+
+  // register a key to be fetched by read(), returns a handle for setReadEnabled
+  int addRead(const std::string &key, Eigen::VectorXd *value);
+  int addRead(const std::string &key, Eigen::MatrixXd *value);
+  int addRead(const std::string &key, std::string *value);
+
+  // register a key to be sent by write(), returns a handle for setWriteEnabled
+  int addWrite(const std::string &key, const Eigen::VectorXd *value);
+  int addWrite(const std::string &key, const std::string *value);
+
+  // write Eigen values in the binary format instead of JSON
+  void setBinaryEncoding(bool binary);
+
+  // disabled entries are left out of the batch (e.g. mass matrix in WAIT_MODE)
+  void setReadEnabled(int handle, bool enabled);
+  void setWriteEnabled(int handle, bool enabled);
+
+  // true if the key existed in redis during the last read()
+  bool readValid(int handle) const;
+
+  // one MGET for every enabled read entry
+  void read();
+  // one MSET for every enabled write entry
+  void write();
+
+  // one-off GET outside the batch (e.g. initial q), accepts either format
+  bool get(const std::string &key, Eigen::VectorXd &value);
+
+  // JSON helpers compatible with RedisClient::getEigenMatrixJSON /
+  // setEigenMatrixJSON that reuse the destination storage
+  static bool decodeJSON(const char *str, size_t len, Eigen::MatrixXd &value);
+  static bool decodeJSON(const char *str, size_t len, Eigen::VectorXd &value);
+  static void encodeJSON(const Eigen::MatrixXd &value, std::string &out);
+  static void encodeJSON(const Eigen::VectorXd &value, std::string &out);
+
+  // binary format: "EGN" magic, u8 version, u16 rows, u16 cols, then
+  // rows*cols doubles in column-major order, all little-endian
+  static const int BINARY_HEADER_SIZE = 8;
+  static const unsigned char BINARY_VERSION = 1;
+  static bool isBinary(const char *str, size_t len);
+  static bool decodeBinary(const char *str, size_t len, Eigen::MatrixXd &value);
+  static bool decodeBinary(const char *str, size_t len, Eigen::VectorXd &value);
+  static void encodeBinary(const Eigen::MatrixXd &value, std::string &out);
+  static void encodeBinary(const Eigen::VectorXd &value, std::string &out);
+
+  // binary or JSON, whichever the payload is
+  static bool decode(const char *str, size_t len, Eigen::MatrixXd &value);
+  static bool decode(const char *str, size_t len, Eigen::VectorXd &value);
+
+private:
+  enum EntryType { EIGEN_VECTOR, EIGEN_MATRIX, STRING };
+
+  struct ReadEntry {
+    std::string key;
+    EntryType type;
+    void *value;
+    bool enabled;
+    bool valid;
+  };
+
+  struct WriteEntry {
+    std::string key;
+    EntryType type;
+    const void *value;
+    bool enabled;
+    std::string buffer; // encoded payload, capacity kept between ticks
+  };
+
+  RedisClient &_redis_client;
+  bool _binary;
+  std::vector<ReadEntry> _reads;
+  std::vector<WriteEntry> _writes;
+
+  // argv scratch space for redisCommandArgv, sized once at registration
+  std::vector<const char *> _argv;
+  std::vector<size_t> _argv_len;
+  std::vector<int> _read_index;
+};
+
+#endif // REDIS_PIPELINE_H
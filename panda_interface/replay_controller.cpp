@@ -0,0 +1,195 @@
+/*
+Replays a controller_panda --record recording through the control law, with
+no redis, timer or robot, as fast as the CPU allows:
+  ./replay_panda <recording> [--tolerance <Nm>]
+Every recorded tick's q / dq (and on hardware the driver's mass matrix) and
+execute command are fed to PandaController in order, and the torques it
+returns are compared with the ones recorded. The default tolerance is 0, so
+any change to the control law that changes its output shows up; the exit
+status is 1 if a tick differs. The per-tick cost of the control law is
+printed with the loop profiler's phases.
+The recording has to start at the controller's first tick and have no lost
+rows (see the controller's exit report).
+*/
+
+#include "Sai2Model.h"
+#include "alloc_guard.h"
+#include "console_log.h"
+#include "loop_profiler.h"
+#include "mode_channel.h"
+#include "options.h"
+#include "panda_controller.h"
+#include "telemetry.h"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace Eigen;
+
+const string robot_file = "./resources/panda_arm.urdf";
+
+// same as controller_panda
+const bool inertia_regularization = true;
+
+ConsoleLog console_log;
+
+int main(int argc, char **argv) {
+  if (argc < 2 || argv[1][0] == '-') {
+    cerr << "usage: " << argv[0] << " <recording> [--tolerance <Nm>]" << endl;
+    return 1;
+  }
+  const double tolerance = optionValue(argc, argv, "--tolerance", 0);
+
+  auto robot = new Sai2Model::Sai2Model(robot_file, false);
+  const int dof = robot->dof();
+
+  TelemetryFile recording;
+  vector<const double *> q, dq, tau, M, shot;
+  const double *execute = nullptr;
+  bool simulation = false;
+  bool otg = false;
+  try {
+    recording.open(argv[1]);
+    for (int i = 0; i < dof; i++) {
+      q.push_back(recording.column("q" + to_string(i)));
+      dq.push_back(recording.column("dq" + to_string(i)));
+      tau.push_back(recording.column("tau" + to_string(i)));
+    }
+    execute = recording.column("execute");
+    const char *shot_columns[] = {"shot_seq",          "shot_x",
+                                  "shot_y",            "shot_psi",
+                                  "shot_hit_velocity", "shot_swing_angle"};
+    for (int k = 0; k < 6; k++) {
+      shot.push_back(recording.column(shot_columns[k]));
+    }
+    // the mass matrix is only recorded on hardware, in simulation the model
+    // computes it
+    simulation = recording.find("M0") < 0;
+    otg = recording.find("otg") >= 0;
+    for (int k = 0; !simulation && k < dof * dof; k++) {
+      M.push_back(recording.column("M" + to_string(k)));
+    }
+  } catch (const runtime_error &e) {
+    cerr << e.what() << endl;
+    cerr << argv[1] << " is not a controller_panda recording" << endl;
+    return 1;
+  }
+  const uint64_t rows = recording.rows();
+  if (rows == 0) {
+    cerr << argv[1] << " has no rows" << endl;
+    return 1;
+  }
+  cout << "Replaying " << rows << " ticks of " << argv[1] << " ("
+       << (simulation ? "simulation" : "hardware") << (otg ? ", otg" : "")
+       << ")" << endl;
+
+  // start from the recorded state, as controller_panda starts from the first
+  // one it reads
+  for (int i = 0; i < dof; i++) {
+    robot->_q(i) = q[i][0];
+    robot->_dq(i) = dq[i][0];
+  }
+  robot->updateModel();
+
+  LoopProfiler profiler(
+      "replay_panda",
+      {"input", "model_update", "task_model", "compute_torques", "compare"},
+      1000);
+  PandaControllerParams controller_params;
+  controller_params.simulation = simulation;
+  controller_params.inertia_regularization = inertia_regularization;
+  controller_params.otg = otg;
+  PandaController controller(robot, controller_params, console_log, &profiler);
+  console_log.start();
+
+  ModeCommand command;
+  command.seq = 0;
+  command.mode = MODE_COMMAND_EXECUTE;
+  double max_difference = 0;
+  uint64_t mismatches = 0;
+  uint64_t first_mismatch = rows;
+  int first_mismatch_joint = 0;
+
+  AllocGuard::arm();
+  const auto start = chrono::steady_clock::now();
+  for (uint64_t row = 0; row < rows; row++) {
+    profiler.startTick(true);
+    for (int i = 0; i < dof; i++) {
+      robot->_q(i) = q[i][row];
+      robot->_dq(i) = dq[i][row];
+    }
+    if (controller.needsMassMatrix()) {
+      for (int r = 0; r < dof; r++) {
+        for (int c = 0; c < dof; c++) {
+          robot->_M(r, c) = M[r * dof + c][row];
+        }
+      }
+    }
+    const bool execute_command = execute[row] != 0;
+    if (execute_command) {
+      command.shot.seq = shot[0][row];
+      command.shot.x = shot[1][row];
+      command.shot.y = shot[2][row];
+      command.shot.psi = shot[3][row];
+      command.shot.hit_velocity = shot[4][row];
+      command.shot.swing_angle = shot[5][row];
+    }
+    // controller_panda's phases, with the redis io replaced by the
+    // recording
+    profiler.mark(PHASE_REDIS_READ);
+
+    const VectorXd &torques =
+        controller.step(execute_command ? &command : nullptr);
+
+    bool mismatch = false;
+    for (int i = 0; i < dof; i++) {
+      const double difference = fabs(torques(i) - tau[i][row]);
+      if (difference > max_difference) {
+        max_difference = difference;
+      }
+      // NaN differences count as mismatches too
+      if (!(difference <= tolerance)) {
+        if (!mismatch && mismatches == 0) {
+          first_mismatch = row;
+          first_mismatch_joint = i;
+        }
+        mismatch = true;
+      }
+    }
+    mismatches += mismatch;
+    profiler.mark(PHASE_REDIS_WRITE);
+    profiler.endTick();
+  }
+  const double elapsed =
+      chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  AllocGuard::disarm();
+  console_log.stop();
+
+  std::cout << "\n";
+  std::cout << "Replay ticks              : " << rows << " in " << elapsed
+            << " seconds (" << rows / elapsed << " ticks/s, "
+            << rows / elapsed / 1000 << "x real time)\n";
+  std::cout << "Replay model updates      : " << controller.dynamics().updates()
+            << " (" << controller.dynamics().factorizations()
+            << " factorizations)\n";
+  profiler.printSummary();
+  if (AllocGuard::enabled()) {
+    std::cout << "Replay heap allocations   : " << AllocGuard::count() << " ("
+              << (double)AllocGuard::count() / rows << " per tick)\n";
+  }
+  std::cout << "Replay max torque diff    : " << max_difference << " Nm\n";
+  if (mismatches > 0) {
+    std::cout << "Replay MISMATCH           : " << mismatches << " of " << rows
+              << " ticks differ by more than " << tolerance
+              << " Nm, first at tick " << first_mismatch << " (joint "
+              << first_mismatch_joint + 1 << ")\n";
+    return 1;
+  }
+  std::cout << "Replay matches the recording\n";
+  return 0;
+}
@@ -0,0 +1,53 @@
+/*
+Single-writer seqlock for trivially copyable data.
+The writer never blocks; readers retry if they raced with a write. Safe to
+place in shared memory (no pointers, lock-free atomics only).
+*/
+
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+template <typename T> class Seqlock {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "Seqlock data must be trivially copyable");
+
+public:
+  Seqlock() : _seq(0) { memset(&_data, 0, sizeof(T)); }
+
+  // writer side (exactly one writer)
+  void store(const T &value) {
+    uint32_t seq = _seq.load(std::memory_order_relaxed);
+    _seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&_data, &value, sizeof(T));
+    _seq.store(seq + 2, std::memory_order_release);
+  }
+
+  // reader side, returns false if nothing was ever stored
+  bool load(T &value) const {
+    uint32_t seq0, seq1;
+    do {
+      seq0 = _seq.load(std::memory_order_acquire);
+      memcpy(&value, &_data, sizeof(T));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      seq1 = _seq.load(std::memory_order_relaxed);
+    } while ((seq0 & 1) || seq0 != seq1);
+    return seq0 != 0;
+  }
+
+  // number of completed stores
+  uint32_t version() const {
+    return _seq.load(std::memory_order_acquire) / 2;
+  }
+
+private:
+  std::atomic<uint32_t> _seq;
+  T _data;
+};
+
+#endif // SEQLOCK_H
@@ -5,7 +5,11 @@ Code to test end-effector orientation control
 """
 
 #include "Sai2Model.h"
+#include "dynamics_cache.h"
 #include "redis/RedisClient.h"
+#include "redis_pipeline.h"
+#include "loop_profiler.h"
+#include "options.h"
 #include "timer/LoopTimer.h"
 #include "Sai2Primitives.h"
 
@@ -25,6 +29,13 @@ const string robot_file = "./resources/panda_arm.urdf";
 #define JOINT_CONTROLLER      0
 #define POSORI_CONTROLLER     1
 
+// loop timing phases
+#define PHASE_REDIS_READ      0
+#define PHASE_MODEL_UPDATE    1
+#define PHASE_TASK_MODEL      2
+#define PHASE_TORQUES         3
+#define PHASE_REDIS_WRITE     4
+
 int state = JOINT_CONTROLLER;
 
 // redis keys:
@@ -40,6 +51,9 @@ std::string MASSMATRIX_KEY;
 std::string CORIOLIS_KEY;
 std::string ROBOT_GRAVITY_KEY;
 
+// - loop timing snapshot
+std::string TIMING_KEY = "sai2::cs225a::panda_robot::timing::set_orientation";
+
 unsigned long long controller_counter = 0;
 
 //const bool flag_simulation = false;
@@ -47,7 +61,7 @@ unsigned long long controller_counter = 0;
 
 const bool inertia_regularization = true;
 
-int main() {
+int main(int argc, char** argv) {
 
 	if(flag_simulation)
 	{
@@ -78,7 +92,8 @@ int main() {
 
 	// load robots
 	auto robot = new Sai2Model::Sai2Model(robot_file, false);
-	robot->_q = redis_client.getEigenMatrixJSON(JOINT_ANGLES_KEY);
+	RedisPipeline redis_pipeline(redis_client);
+	redis_pipeline.get(JOINT_ANGLES_KEY, robot->_q);
 	VectorXd initial_q = robot->_q;
 	robot->updateModel();
 
@@ -122,6 +137,15 @@ int main() {
 	q_init_desired *= M_PI/180.0;
 	joint_task->_desired_position = q_init_desired;
 
+	// mass matrix factored once per tick for both task models; on hardware the
+	// last three joints are regularized before factoring
+	VectorXd M_regularization = VectorXd::Zero(dof);
+	if(!flag_simulation && inertia_regularization)
+	{
+		M_regularization.tail(3).setConstant(0.07);
+	}
+	DynamicsCache dynamics(robot, flag_simulation, M_regularization);
+
 	// create a timer
 	LoopTimer timer;
 	timer.initializeTimer();
@@ -129,43 +153,50 @@ int main() {
 	double start_time = timer.elapsedTime(); //secs
 	bool fTimerDidSleep = true;
 
+	// batched redis io: one MGET and one MSET per tick
+	redis_pipeline.addRead(JOINT_ANGLES_KEY, &robot->_q);
+	redis_pipeline.addRead(JOINT_VELOCITIES_KEY, &robot->_dq);
+	if(!flag_simulation)
+	{
+		redis_pipeline.addRead(MASSMATRIX_KEY, &robot->_M);
+	}
+	redis_pipeline.addWrite(JOINT_TORQUES_COMMANDED_KEY, &command_torques);
+	if(flag_simulation)
+	{
+		redis_pipeline.setBinaryEncoding(hasOption(argc, argv, "--binary"));
+	}
+
+	// per-phase timing, snapshot published to redis once per second
+	LoopProfiler profiler("set_orientation_panda",
+		{"redis_read", "model_update", "task_model", "compute_torques", "redis_write"}, 1000);
+	profiler.startPublisher(TIMING_KEY);
+
 	while (runloop) {
 		// wait for next scheduled loop
-		timer.waitForNextLoop();
+		fTimerDidSleep = timer.waitForNextLoop();
+		profiler.startTick(fTimerDidSleep);
 		double time = timer.elapsedTime() - start_time;
 
 		// read robot state from redis
-		robot->_q = redis_client.getEigenMatrixJSON(JOINT_ANGLES_KEY);
-		robot->_dq = redis_client.getEigenMatrixJSON(JOINT_VELOCITIES_KEY);
+		redis_pipeline.read();
+		profiler.mark(PHASE_REDIS_READ);
 
-		// update model
-		if(flag_simulation)
-		{
-			robot->updateModel();
-		}
-		else
-		{
-			robot->updateKinematics();
-			robot->_M = redis_client.getEigenMatrixJSON(MASSMATRIX_KEY);
-			if(inertia_regularization)
-			{
-				robot->_M(4,4) += 0.07;
-				robot->_M(5,5) += 0.07;
-				robot->_M(6,6) += 0.07;
-			}
-			robot->_M_inv = robot->_M.inverse();
-		}
+		// update model (on hardware _M was filled in by the batched read)
+		dynamics.update();
+		profiler.mark(PHASE_MODEL_UPDATE);
 
 		if(state == JOINT_CONTROLLER)
 		{
 			// update task model and set hierarchy
 			N_prec.setIdentity();
 			joint_task->updateTaskModel(N_prec);
+			profiler.mark(PHASE_TASK_MODEL);
 
 			// compute torques
 			joint_task->computeTorques(joint_task_torques);
 
 			command_torques = joint_task_torques;
+			profiler.mark(PHASE_TORQUES);
 
 			if( (robot->_q - q_init_desired).norm() < 0.15 )
 			{
@@ -191,26 +222,32 @@ int main() {
 			posori_task->updateTaskModel(N_prec);
 			N_prec = posori_task->_N;
 			joint_task->updateTaskModel(N_prec);
+			profiler.mark(PHASE_TASK_MODEL);
 
 			// compute torques
 			posori_task->computeTorques(posori_task_torques);
 			joint_task->computeTorques(joint_task_torques);
 
 			command_torques = posori_task_torques + joint_task_torques;
+			profiler.mark(PHASE_TORQUES);
 		}
 
 		// send to redis
-		redis_client.setEigenMatrixJSON(JOINT_TORQUES_COMMANDED_KEY, command_torques);
+		redis_pipeline.write();
+		profiler.mark(PHASE_REDIS_WRITE);
+		profiler.endTick();
 
 		controller_counter++;
 
 	}
+	profiler.stopPublisher();
 
 	double end_time = timer.elapsedTime();
     std::cout << "\n";
     std::cout << "Controller Loop run time  : " << end_time << " seconds\n";
     std::cout << "Controller Loop updates   : " << timer.elapsedCycles() << "\n";
     std::cout << "Controller Loop frequency : " << timer.elapsedCycles()/end_time << "Hz\n";
+    profiler.printSummary();
 
 
 	return 0;
@@ -0,0 +1,207 @@
+#include "shm_transport.h"
+
+#include <cerrno>
+#include <chrono>
+#include <iostream>
+#include <new>
+#include <thread>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace Eigen;
+
+namespace {
+const uint32_t SHM_MAGIC = 0x43524f4b; // "CROK"
+const uint32_t SHM_VERSION = 2;
+} // namespace
+
+struct ShmTransport::Region {
+  std::atomic<uint32_t> magic; // set last, once the slots are constructed
+  uint32_t version;
+  std::atomic<int32_t> state_writer; // pid, 0 for none
+  std::atomic<int32_t> command_writer;
+  alignas(64) Seqlock<ShmRobotState> state;
+  alignas(64) Seqlock<ShmTorqueCommand> command;
+};
+
+ShmTransport::ShmTransport()
+    : _region(nullptr), _writes_state(false), _writes_command(false),
+      _state_writer(0), _command_writer(0) {}
+
+ShmTransport::~ShmTransport() { close(); }
+
+bool ShmTransport::open(const string &name) {
+  bool created = true;
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+  if (fd < 0) {
+    created = false;
+    fd = shm_open(name.c_str(), O_RDWR, 0666);
+  }
+  if (fd < 0) {
+    cerr << "ShmTransport: cannot open " << name << endl;
+    return false;
+  }
+  if (created && ftruncate(fd, sizeof(Region)) != 0) {
+    cerr << "ShmTransport: cannot size " << name << endl;
+    ::close(fd);
+    return false;
+  }
+  // wait for the creating process to size the region
+  struct stat st;
+  while (fstat(fd, &st) == 0 && st.st_size < (off_t)sizeof(Region)) {
+    this_thread::sleep_for(chrono::milliseconds(1));
+  }
+
+  void *p = mmap(nullptr, sizeof(Region), PROT_READ | PROT_WRITE, MAP_SHARED,
+                 fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    cerr << "ShmTransport: cannot map " << name << endl;
+    return false;
+  }
+  _region = (Region *)p;
+  _writes_state = _writes_command = false;
+  _state_writer = _command_writer = 0;
+
+  if (created) {
+    _region->state_writer.store(0, memory_order_relaxed);
+    _region->command_writer.store(0, memory_order_relaxed);
+    new (&_region->state) Seqlock<ShmRobotState>();
+    new (&_region->command) Seqlock<ShmTorqueCommand>();
+    _region->version = SHM_VERSION;
+    _region->magic.store(SHM_MAGIC, memory_order_release);
+  } else {
+    while (_region->magic.load(memory_order_acquire) != SHM_MAGIC) {
+      this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    if (_region->version != SHM_VERSION) {
+      cerr << "ShmTransport: version mismatch in " << name
+           << ", remove /dev/shm" << name << endl;
+      close();
+      return false;
+    }
+  }
+  return true;
+}
+
+void ShmTransport::close() {
+  if (_region != nullptr) {
+    munmap(_region, sizeof(Region));
+    _region = nullptr;
+  }
+}
+
+void ShmTransport::unlink(const string &name) { shm_unlink(name.c_str()); }
+
+bool ShmTransport::writerAlive(const atomic<int32_t> &writer,
+                               int32_t &checked_pid) {
+  const int32_t pid = writer.load(memory_order_acquire);
+  if (pid == checked_pid) {
+    return pid != 0;
+  }
+  // a new writer, checked once
+  if (pid == 0 || (kill(pid, 0) != 0 && errno != EPERM)) {
+    return false;
+  }
+  checked_pid = pid;
+  return true;
+}
+
+double ShmTransport::now() {
+  return chrono::duration<double>(
+             chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void ShmTransport::writeState(const VectorXd &q, const VectorXd &dq,
+                              uint64_t step) {
+  int dof = min((int)q.size(), SHM_MAX_DOF);
+  _state_scratch.step = step;
+  _state_scratch.timestamp = now();
+  _state_scratch.dof = dof;
+  for (int i = 0; i < dof; i++) {
+    _state_scratch.q[i] = q(i);
+    _state_scratch.dq[i] = dq(i);
+  }
+  if (!_writes_state) {
+    // take over the slot from an earlier simulation
+    new (&_region->state) Seqlock<ShmRobotState>();
+    _region->state_writer.store(getpid(), memory_order_release);
+    _writes_state = true;
+  }
+  _region->state.store(_state_scratch);
+}
+
+bool ShmTransport::readState(VectorXd &q, VectorXd &dq, uint64_t *step,
+                             double *timestamp) {
+  if (!writerAlive(_region->state_writer, _state_writer) ||
+      !_region->state.load(_state_scratch)) {
+    return false;
+  }
+  int dof = _state_scratch.dof;
+  if (q.size() != dof) {
+    q.resize(dof);
+  }
+  if (dq.size() != dof) {
+    dq.resize(dof);
+  }
+  for (int i = 0; i < dof; i++) {
+    q(i) = _state_scratch.q[i];
+    dq(i) = _state_scratch.dq[i];
+  }
+  if (step != nullptr) {
+    *step = _state_scratch.step;
+  }
+  if (timestamp != nullptr) {
+    *timestamp = _state_scratch.timestamp;
+  }
+  return true;
+}
+
+void ShmTransport::writeTorques(const VectorXd &tau, uint64_t step) {
+  int dof = min((int)tau.size(), SHM_MAX_DOF);
+  _command_scratch.step = step;
+  _command_scratch.timestamp = now();
+  _command_scratch.dof = dof;
+  for (int i = 0; i < dof; i++) {
+    _command_scratch.tau[i] = tau(i);
+  }
+  if (!_writes_command) {
+    // take over the slot from an earlier controller
+    new (&_region->command) Seqlock<ShmTorqueCommand>();
+    _region->command_writer.store(getpid(), memory_order_release);
+    _writes_command = true;
+  }
+  _region->command.store(_command_scratch);
+}
+
+bool ShmTransport::readTorques(VectorXd &tau, uint64_t *step) {
+  if (!writerAlive(_region->command_writer, _command_writer) ||
+      !_region->command.load(_command_scratch)) {
+    return false;
+  }
+  int dof = _command_scratch.dof;
+  if (tau.size() != dof) {
+    tau.resize(dof);
+  }
+  for (int i = 0; i < dof; i++) {
+    tau(i) = _command_scratch.tau[i];
+  }
+  if (step != nullptr) {
+    *step = _command_scratch.step;
+  }
+  return true;
+}
+
+uint32_t ShmTransport::stateVersion() const {
+  return _region->state.version();
+}
+
+uint32_t ShmTransport::commandVersion() const {
+  return _region->command.version();
+}
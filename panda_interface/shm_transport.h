@@ -0,0 +1,88 @@
+/*
+Shared-memory transport between simviz_panda and controller_panda when both
+run on the same machine (--shm). Replaces the q / dq / torque redis keys with
+two seqlock slots in a POSIX shared memory region:
+  - state:   q, dq written by the simulation
+  - command: torques written by the controller
+Each slot carries the step counter of the simulation tick it belongs to and a
+steady-clock timestamp. Mode and shot keys still go through redis.
+
+The region outlives the processes. A process takes over a slot on its first
+write: it re-creates the seqlock in place and records its pid as the writer.
+Until then, and whenever the recorded writer is no longer running, the reads
+of that slot return false, so a state or command left by an earlier run is
+never used.
+*/
+
+#ifndef SHM_TRANSPORT_H
+#define SHM_TRANSPORT_H
+
+#include "seqlock.h"
+
+#include <Eigen/Dense>
+
+#include <cstdint>
+#include <string>
+
+const int SHM_MAX_DOF = 7;
+const std::string SHM_DEFAULT_NAME = "/crokinole_panda";
+
+struct ShmRobotState {
+  uint64_t step;    // simulation tick that produced this state
+  double timestamp; // steady clock, seconds
+  int32_t dof;
+  double q[SHM_MAX_DOF];
+  double dq[SHM_MAX_DOF];
+};
+
+struct ShmTorqueCommand {
+  uint64_t step; // state step the torques were computed from
+  double timestamp;
+  int32_t dof;
+  double tau[SHM_MAX_DOF];
+};
+
+class ShmTransport {
+public:
+  ShmTransport();
+  ~ShmTransport();
+
+  // maps the region, creating and initializing it if it does not exist yet
+  bool open(const std::string &name = SHM_DEFAULT_NAME);
+  void close();
+  // removes the region name (mapped processes keep their mapping)
+  static void unlink(const std::string &name = SHM_DEFAULT_NAME);
+
+  // simulation side
+  void writeState(const Eigen::VectorXd &q, const Eigen::VectorXd &dq,
+                  uint64_t step);
+  bool readTorques(Eigen::VectorXd &tau, uint64_t *step = nullptr);
+
+  // controller side
+  bool readState(Eigen::VectorXd &q, Eigen::VectorXd &dq,
+                 uint64_t *step = nullptr, double *timestamp = nullptr);
+  void writeTorques(const Eigen::VectorXd &tau, uint64_t step);
+
+  // number of states / commands published so far, cheap to poll
+  uint32_t stateVersion() const;
+  uint32_t commandVersion() const;
+
+  static double now();
+
+private:
+  struct Region;
+  // false until the writer recorded in writer (last checked: checked_pid) is
+  // a running process
+  static bool writerAlive(const std::atomic<int32_t> &writer,
+                          int32_t &checked_pid);
+
+  Region *_region;
+  bool _writes_state;
+  bool _writes_command;
+  int32_t _state_writer;   // last writer pid found running
+  int32_t _command_writer;
+  ShmRobotState _state_scratch;
+  ShmTorqueCommand _command_scratch;
+};
+
+#endif // SHM_TRANSPORT_H
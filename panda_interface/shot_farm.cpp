@@ -0,0 +1,278 @@
+/*
+Monte-Carlo shot farm for tuning the shot: every combination of the given
+parameter values (a grid) is run against the same set of shots, each run a
+headless Sai2Simulation + PandaController pair in-process (no redis, no
+graphics, no timer), spread over all cores and as fast as they integrate.
+  ./shot_farm [--shots <n>] [--seed <n>] [--threads <n>]
+              [--hit-velocity <m/s,..>] [--shot-time <s,..>]
+              [--centershot-velocity <rad/s,..>] [--backswing <deg,..>]
+              [--follow-through <deg,..>] [--t3 <s,..>] [--t4 <s,..>]
+              [--otg] [--max-time <s>] [--speed-tolerance <fraction>]
+              [--direction-tolerance <deg>] [--csv <file>]
+Run from bin/panda_interface so ./resources is found. The shots are the
+center shot plus random cue start positions on the starting arc and
+angles in the planner's range. A shot succeeds if it is back in WAIT_MODE
+within --max-time of simulated time without a soft limit violation, and
+the peak end effector speed in JOINT_CONTROLLER_SHOT is within
+--speed-tolerance of the speed the controller swings at and in the shot
+direction within --direction-tolerance. The time column is the mean
+simulated time until the arm is back in WAIT_MODE.
+*/
+
+#include "Sai2Model.h"
+#include "Sai2Simulation.h"
+#include "console_log.h"
+#include "mode_channel.h"
+#include "options.h"
+#include "panda_controller.h"
+#include "shot_planner.h"
+#include "thread_pool.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace Eigen;
+
+const string world_file = "./resources/world.urdf";
+const string robot_file = "./resources/panda_arm.urdf";
+const string robot_name = "PANDA";
+
+const double RAD = M_PI / 180.0;
+
+struct FarmConfig {
+  double hit_velocity; // shot message, 0 for the controller's default
+  PandaControllerParams params;
+};
+
+struct ShotOutcome {
+  bool finished;                  // back in WAIT_MODE within max time
+  unsigned long long soft_limits; // ticks with a soft limit violation
+  double target_speed;            // m/s, as the controller swings it
+  double hit_speed;       // peak end effector speed in JOINT_CONTROLLER_SHOT
+  double direction_error; // rad, between that velocity and the shot direction
+  double sim_time;        // s
+  bool success;
+};
+
+// loading the models is not known to be thread safe, the runs are
+mutex load_mutex;
+
+ShotOutcome runShot(const FarmConfig &config, const ShotMessage &shot,
+                    double max_time) {
+  unique_ptr<Simulation::Sai2Simulation> sim;
+  unique_ptr<Sai2Model::Sai2Model> robot;
+  {
+    lock_guard<mutex> lock(load_mutex);
+    sim.reset(new Simulation::Sai2Simulation(world_file, false));
+    robot.reset(new Sai2Model::Sai2Model(robot_file, false));
+  }
+  sim->setCollisionRestitution(0);
+  sim->setCoeffFrictionStatic(0.6);
+  sim->getJointPositions(robot_name, robot->_q);
+  sim->getJointVelocities(robot_name, robot->_dq);
+  robot->updateModel();
+
+  // never started, so the runs are silent
+  ConsoleLog log;
+  PandaController controller(robot.get(), config.params, log);
+
+  ModeCommand command;
+  command.seq = 0;
+  command.mode = MODE_COMMAND_EXECUTE;
+  command.shot = shot;
+  command.shot.hit_velocity = config.hit_velocity;
+
+  // shot direction (board frame cos psi, sin psi) in the robot frame
+  const Vector3d direction(sin(shot.psi), -cos(shot.psi), 0);
+
+  ShotOutcome outcome = {false, 0, 0, 0, M_PI, 0, false};
+  const double dt = 0.001;
+  const long ticks = max_time / dt;
+  long tick = 0;
+  for (; tick < ticks && !outcome.finished; tick++) {
+    const VectorXd &torques = controller.step(tick == 0 ? &command : nullptr);
+    if (controller.state() == JOINT_CONTROLLER_SHOT) {
+      const Vector3d &velocity = controller.velocity();
+      const double speed = velocity.norm();
+      if (speed > outcome.hit_speed) {
+        outcome.hit_speed = speed;
+        outcome.direction_error =
+            speed > 0 ? acos(min(1.0, velocity.normalized().dot(direction)))
+                      : M_PI;
+      }
+    }
+    outcome.finished = controller.shotFinished();
+
+    sim->setJointTorques(robot_name, torques);
+    sim->integrate(dt);
+    sim->getJointPositions(robot_name, robot->_q);
+    sim->getJointVelocities(robot_name, robot->_dq);
+  }
+  outcome.soft_limits = controller.softLimitViolations();
+  outcome.target_speed = controller.shotSpeed();
+  outcome.sim_time = tick * dt;
+  return outcome;
+}
+
+int main(int argc, char **argv) {
+  const int num_shots = max(1.0, optionValue(argc, argv, "--shots", 16));
+  const unsigned seed = optionValue(argc, argv, "--seed", 1);
+  const int threads = optionValue(argc, argv, "--threads", 0);
+  const double max_time = optionValue(argc, argv, "--max-time", 40);
+  const double speed_tolerance =
+      optionValue(argc, argv, "--speed-tolerance", 0.2);
+  const double direction_tolerance =
+      optionValue(argc, argv, "--direction-tolerance", 15) * RAD;
+  const char *csv_path = optionString(argc, argv, "--csv", nullptr);
+  // the OTG (controller_panda --otg) instead of the trajectory slots
+  const bool otg = hasOption(argc, argv, "--otg");
+
+  // the grid
+  const PandaControllerParams defaults;
+  const vector<double> hit_velocities =
+      optionList(argc, argv, "--hit-velocity", {0});
+  const vector<double> shot_times =
+      optionList(argc, argv, "--shot-time", {defaults.shot_time});
+  const vector<double> centershot_velocities = optionList(
+      argc, argv, "--centershot-velocity", {defaults.centershot_velocity});
+  const vector<double> backswings =
+      optionList(argc, argv, "--backswing", {defaults.backswing / RAD});
+  const vector<double> follow_throughs = optionList(
+      argc, argv, "--follow-through", {defaults.follow_through / RAD});
+  const vector<double> t3s = optionList(argc, argv, "--t3", {defaults.slots.t_3});
+  const vector<double> t4s = optionList(argc, argv, "--t4", {defaults.slots.t_4});
+
+  vector<FarmConfig> configs;
+  for (double hit_velocity : hit_velocities)
+    for (double shot_time : shot_times)
+      for (double centershot_velocity : centershot_velocities)
+        for (double backswing : backswings)
+          for (double follow_through : follow_throughs)
+            for (double t3 : t3s)
+              for (double t4 : t4s) {
+                if (t4 <= t3 || t3 <= defaults.slots.t_2) {
+                  continue;
+                }
+                FarmConfig config;
+                config.hit_velocity = hit_velocity;
+                config.params.simulation = true;
+                config.params.otg = otg;
+                config.params.shot_time = shot_time;
+                config.params.centershot_velocity = centershot_velocity;
+                config.params.backswing = backswing * RAD;
+                config.params.follow_through = follow_through * RAD;
+                config.params.slots.t_3 = t3;
+                config.params.slots.t_4 = t4;
+                configs.push_back(config);
+              }
+  if (configs.empty()) {
+    cerr << "no valid configuration (t3 must lie between "
+         << defaults.slots.t_2 << " and t4)" << endl;
+    return 1;
+  }
+
+  // the center shot, then random ones from the starting arc (board frame, mm)
+  vector<ShotMessage> shots;
+  ShotMessage center = {0, 0, -STARTING_ARC_R, M_PI / 2, 0, 0};
+  shots.push_back(center);
+  mt19937 rng(seed);
+  uniform_real_distribution<double> arc(-M_PI / 6, M_PI / 6);
+  uniform_real_distribution<double> angle(MIN_PSI, M_PI - MIN_PSI);
+  for (int k = 1; k < num_shots; k++) {
+    const double a = arc(rng);
+    ShotMessage shot = {(uint32_t)k, STARTING_ARC_R * sin(a),
+                        -STARTING_ARC_R * cos(a), angle(rng), 0, 0};
+    shots.push_back(shot);
+  }
+
+  ThreadPool pool(threads);
+  const int runs = configs.size() * shots.size();
+  cout << "Shot farm: " << configs.size() << " configurations x "
+       << shots.size() << " shots on " << pool.size() << " threads" << endl;
+
+  vector<ShotOutcome> outcomes(runs);
+  const auto start = chrono::steady_clock::now();
+  pool.parallelFor(runs, [&](int run, int worker) {
+    const FarmConfig &config = configs[run / shots.size()];
+    const ShotMessage &shot = shots[run % shots.size()];
+    ShotOutcome &outcome = outcomes[run];
+    outcome = runShot(config, shot, max_time);
+    outcome.success =
+        outcome.finished && outcome.soft_limits == 0 &&
+        fabs(outcome.hit_speed / outcome.target_speed - 1) <= speed_tolerance &&
+        outcome.direction_error <= direction_tolerance;
+  });
+  const double elapsed =
+      chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  // per configuration summary
+  printf("\n%6s %6s %6s %6s %6s %6s %6s | %7s %8s %6s %7s %7s %6s %6s\n",
+         "hit_v", "shot_t", "c_vel", "back", "follow", "t3", "t4", "success",
+         "finished", "limits", "speed", "target", "dir", "time");
+  printf("%6s %6s %6s %6s %6s %6s %6s | %7s %8s %6s %7s %7s %6s %6s\n", "m/s",
+         "s", "rad/s", "deg", "deg", "s", "s", "", "", "shots", "m/s", "m/s",
+         "deg", "s");
+  double sim_time = 0;
+  for (size_t c = 0; c < configs.size(); c++) {
+    const FarmConfig &config = configs[c];
+    int success = 0, finished = 0, limits = 0;
+    double speed = 0, target = 0, direction = 0, time = 0;
+    for (size_t s = 0; s < shots.size(); s++) {
+      const ShotOutcome &outcome = outcomes[c * shots.size() + s];
+      success += outcome.success;
+      finished += outcome.finished;
+      limits += outcome.soft_limits > 0;
+      speed += outcome.hit_speed;
+      target += outcome.target_speed;
+      direction += outcome.direction_error;
+      time += outcome.sim_time;
+    }
+    sim_time += time;
+    const double n = shots.size();
+    printf("%6.3g %6.3g %6.3g %6.3g %6.3g %6.3g %6.3g | %6.0f%% %7.0f%% %6d "
+           "%7.3f %7.3f %6.1f %6.2f\n",
+           config.hit_velocity, config.params.shot_time,
+           config.params.centershot_velocity, config.params.backswing / RAD,
+           config.params.follow_through / RAD, config.params.slots.t_3,
+           config.params.slots.t_4, 100 * success / n, 100 * finished / n,
+           limits, speed / n, target / n, direction / n / RAD, time / n);
+  }
+  printf("\n%d runs, %.1f s simulated in %.1f s (%.1fx real time)\n", runs,
+         sim_time, elapsed, sim_time / elapsed);
+
+  if (csv_path != nullptr) {
+    FILE *csv = fopen(csv_path, "w");
+    if (csv == nullptr) {
+      cerr << "cannot write " << csv_path << endl;
+      return 1;
+    }
+    fprintf(csv, "config,hit_velocity,shot_time,centershot_velocity,backswing,"
+                 "follow_through,t3,t4,shot,x,y,psi,finished,soft_limits,"
+                 "target_speed,hit_speed,direction_error,sim_time,success\n");
+    // angles in degrees like the options, except psi (radians, as sent)
+    for (int run = 0; run < runs; run++) {
+      const FarmConfig &config = configs[run / shots.size()];
+      const ShotMessage &shot = shots[run % shots.size()];
+      const ShotOutcome &outcome = outcomes[run];
+      fprintf(csv, "%d,%g,%g,%g,%g,%g,%g,%g,%u,%g,%g,%g,%d,%llu,%g,%g,%g,%g,%d\n",
+              (int)(run / shots.size()), config.hit_velocity,
+              config.params.shot_time, config.params.centershot_velocity,
+              config.params.backswing / RAD, config.params.follow_through / RAD,
+              config.params.slots.t_3, config.params.slots.t_4, shot.seq,
+              shot.x, shot.y, shot.psi, outcome.finished, outcome.soft_limits,
+              outcome.target_speed, outcome.hit_speed,
+              outcome.direction_error / RAD,
+              outcome.sim_time, outcome.success);
+    }
+    fclose(csv);
+  }
+  return 0;
+}
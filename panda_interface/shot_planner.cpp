@@ -0,0 +1,629 @@
+#include "shot_planner.h"
+#include "coin_rollout.h"
+#include "ray_kernel.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+
+using namespace std;
+
+namespace {
+// longer than any path across the board
+const double BOARD_REACH = 2 * (BOARD_R + COIN_R);
+// obstacle grid over the board, cells about two coin diameters wide
+const double GRID_CELL = 32;
+// slack on the grid queries so contacts at exactly r_sum are not culled
+const double GRID_SLACK = 1;
+// below this many obstacles rays past the target are checked against all
+const int GRID_MIN_OBSTACLES = 64;
+
+// rotation about z, as rotate() in shot_planner.py
+inline void rotate(double &x, double &y, double theta) {
+  double c = cos(theta), s = sin(theta);
+  double rx = c * x - s * y;
+  y = s * x + c * y;
+  x = rx;
+}
+
+// outcome of coin.py collide(): contact point, distance travelled, position
+// and new direction of the moving coin, new direction of the stationary coin
+struct Collision {
+  double cx, cy;
+  double travel;
+  double mx, my;
+  double mdx, mdy;
+  double sdx, sdy;
+};
+
+// a coin at (ox, oy) with radius rm moving along the unit vector (ux, uy)
+// against a stationary circle; fills c (if given) on contact
+inline bool collide(double ox, double oy, double ux, double uy, double rm,
+                    double sx, double sy, double rs, Collision *c) {
+  if (ux == 0 && uy == 0) {
+    return false;
+  }
+  double projected_dist = (sx - ox) * ux + (sy - oy) * uy;
+  if (projected_dist < 0) {
+    return false;
+  }
+  double nx = ox - sx + projected_dist * ux;
+  double ny = oy - sy + projected_dist * uy;
+  double r_sum = rm + rs;
+  double n2 = nx * nx + ny * ny;
+  if (r_sum <= sqrt(n2)) {
+    return false;
+  }
+  if (c == nullptr) {
+    return true;
+  }
+  double dist_u = sqrt(r_sum * r_sum - n2);
+  c->travel = projected_dist - dist_u;
+  double cdx = nx - dist_u * ux;
+  double cdy = ny - dist_u * uy;
+  c->cx = sx + rs / r_sum * cdx;
+  c->cy = sy + rs / r_sum * cdy;
+  // (cp - s) rather than the scaled offset: for head-on shots the tangent
+  // side below is decided by rounding, keep it the same as the python
+  double rx = c->cx - sx;
+  double ry = c->cy - sy;
+  c->mx = sx + cdx;
+  c->my = sy + cdy;
+  double r_norm = sqrt(rx * rx + ry * ry);
+  c->sdx = -rx / r_norm;
+  c->sdy = -ry / r_norm;
+  // the moving coin leaves along the tangent, on the side it was heading
+  double t_dot = -ry * ux + rx * uy;
+  if (t_dot > 0) {
+    c->mdx = -ry / r_norm;
+    c->mdy = rx / r_norm;
+  } else if (t_dot < 0) {
+    c->mdx = ry / r_norm;
+    c->mdy = -rx / r_norm;
+  } else {
+    c->mdx = 0;
+    c->mdy = 0;
+  }
+  return true;
+}
+} // namespace
+
+void boardPosts(CircleSet &posts) {
+  double px = 0, py = -POST_RING_R;
+  rotate(px, py, 3 * M_PI / 8);
+  for (int i = 0; i < 4; i++) {
+    posts.add(px, py, POST_R);
+    rotate(px, py, i == 1 ? 3 * M_PI / 4 : M_PI / 4);
+  }
+}
+
+void allBoardPosts(CircleSet &posts) {
+  double px = 0, py = -POST_RING_R;
+  rotate(px, py, M_PI / 8);
+  for (int i = 0; i < 8; i++) {
+    posts.add(px, py, POST_R);
+    rotate(px, py, M_PI / 4);
+  }
+}
+
+ShotPlanner::ShotPlanner() : _grid(BOARD_R + COIN_R, GRID_CELL) {
+  // generate_start_pos(STARTING_ARC_R, NUM_START_POSITIONS)
+  _start_x.push_back(0);
+  _start_y.push_back(-STARTING_ARC_R);
+  int half = (NUM_START_POSITIONS - 1) / 2;
+  double unit_angle = (M_PI / 6) / half;
+  for (int i = 1; i <= half; i++) {
+    for (double sign : {1.0, -1.0}) {
+      double x = 0, y = -STARTING_ARC_R;
+      rotate(x, y, sign * i * unit_angle);
+      _start_x.push_back(x);
+      _start_y.push_back(y);
+    }
+  }
+}
+
+void ShotPlanner::setCoins(const double *x, const double *y,
+                           const int *identity, int n) {
+  _obstacles.clear();
+  _targets.clear();
+  for (int i = 0; i < n; i++) {
+    if (identity[i] == COIN_CUE) {
+      continue;
+    }
+    if (identity[i] == COIN_HUMAN) {
+      _targets.push_back(_obstacles.size());
+    }
+    _obstacles.add(x[i], y[i], COIN_R);
+  }
+  boardPosts(_obstacles);
+  _grid.build(_obstacles);
+  _all_obstacles.clear();
+  _all_obstacles.circles = _obstacles;
+  for (int i = 0; i < _obstacles.size(); i++) {
+    _all_obstacles.index.push_back(i);
+  }
+}
+
+namespace {
+// position of obstacle `skip` in a query result, or -1
+int nearIndex(const CircleQuery &near, int skip) {
+  auto it = lower_bound(near.index.begin(), near.index.end(), skip);
+  return it != near.index.end() && *it == skip ? it - near.index.begin() : -1;
+}
+
+// firstHit over a query result; the indices stay ascending, so ties resolve
+// as over the full set. Returns the obstacle index.
+int firstHitIn(const CircleQuery &near, double ox, double oy, double ux,
+               double uy, double radius, int skip, RayHit *hit) {
+  int i = firstHit(near.circles.x.data(), near.circles.y.data(),
+                   near.circles.r.data(), near.circles.size(), ox, oy, ux, uy,
+                   radius, nearIndex(near, skip), hit);
+  if (i < 0) {
+    return -1;
+  }
+  if (hit != nullptr) {
+    hit->index = near.index[i];
+  }
+  return near.index[i];
+}
+
+double clearanceIn(const CircleQuery &near, double ox, double oy, double ux,
+                   double uy, double radius, double max_travel, int skip) {
+  return minClearance(near.circles.x.data(), near.circles.y.data(),
+                      near.circles.r.data(), near.circles.size(), ox, oy, ux,
+                      uy, radius, max_travel, nearIndex(near, skip));
+}
+} // namespace
+
+void ShotPlanner::cueCorridor(double sx, double sy, int target,
+                              CircleQuery &near) const {
+  const int ti = _targets[target];
+  // the cue's center stays within COIN_R + tr of the line to the target's
+  // center until contact, so anything it can touch (or come within the
+  // clearance cap of) on the way is within 2 COIN_R + tr + cap of that line
+  _grid.query({sx, sy, _obstacles.x[ti], _obstacles.y[ti],
+               2 * COIN_R + _obstacles.r[ti] + SHOT_CLEARANCE_CAP +
+                   GRID_SLACK},
+              near);
+}
+
+const CircleQuery &ShotPlanner::pathCorridor(double ox, double oy, double ux,
+                                             double uy, double reach,
+                                             CircleQuery &near) const {
+  if (_obstacles.size() < GRID_MIN_OBSTACLES) {
+    // on a sparse board a query costs about as much as the kernel over all
+    return _all_obstacles;
+  }
+  _grid.query({ox, oy, ox + BOARD_REACH * ux, oy + BOARD_REACH * uy,
+               reach + GRID_SLACK},
+              near);
+  return near;
+}
+
+/*
+The checks of is_viable_path, in order:
+  1) the cue hits the target
+  2) no obstacle is hit before the target
+  3) the deflected cue reaches the 20 point hole
+  4) the target, pushed along the line of centers, hits no obstacle
+  5) the deflected cue hits no obstacle
+Checks 2, 4 and 5 are single first-hit queries (the target itself skipped)
+over only the obstacles the grid finds near the path: for check 2 those near
+the line from the start position to the target, shared by every angle of a
+sweep, for 4 and 5 those along the ray checked. Check 2 compares the distance
+the cue travels to the first obstacle with the distance to the target;
+is_viable_path compared contact point distances and deflected its cue copy
+at every obstacle it passed.
+*/
+int ShotPlanner::evaluate(double sx, double sy, double dx, double dy,
+                          int target, vector<Capsule> *corridor) const {
+  CircleQuery cue_near;
+  cueCorridor(sx, sy, target, cue_near);
+  return evaluate(sx, sy, dx, dy, target, cue_near, corridor);
+}
+
+int ShotPlanner::evaluate(double sx, double sy, double dx, double dy,
+                          int target, const CircleQuery &cue_near,
+                          vector<Capsule> *corridor) const {
+  const int ti = _targets[target];
+  const double tx = _obstacles.x[ti];
+  const double ty = _obstacles.y[ti];
+  const double tr = _obstacles.r[ti];
+
+  Collision hit;
+  if (!collide(sx, sy, dx, dy, COIN_R, tx, ty, tr, &hit)) {
+    return SHOT_MISSES_TARGET;
+  }
+
+  RayHit obstacle;
+  if (firstHitIn(cue_near, sx, sy, dx, dy, COIN_R, ti, &obstacle) >= 0 &&
+      obstacle.travel <= hit.travel) {
+    return SHOT_BLOCKED_BEFORE_TARGET;
+  }
+
+  if (!collide(hit.mx, hit.my, hit.mdx, hit.mdy, COIN_R, 0, 0, COIN_R,
+               nullptr)) {
+    return SHOT_MISSES_CENTER;
+  }
+
+  // the remaining checks (and the score) look at everything ahead of the
+  // target and of the deflected cue up to the far side of the board
+  thread_local CircleQuery near;
+  if (corridor != nullptr) {
+    corridor->push_back({tx, ty, tx + BOARD_REACH * hit.sdx,
+                         ty + BOARD_REACH * hit.sdy, tr + SHOT_CLEARANCE_CAP});
+  }
+  if (firstHitIn(pathCorridor(tx, ty, hit.sdx, hit.sdy, tr, near), tx, ty,
+                 hit.sdx, hit.sdy, tr, ti, nullptr) >= 0) {
+    return SHOT_TARGET_BLOCKED;
+  }
+
+  if (corridor != nullptr) {
+    corridor->push_back({hit.mx, hit.my, hit.mx + BOARD_REACH * hit.mdx,
+                         hit.my + BOARD_REACH * hit.mdy,
+                         COIN_R + SHOT_CLEARANCE_CAP});
+  }
+  if (firstHitIn(pathCorridor(hit.mx, hit.my, hit.mdx, hit.mdy, COIN_R, near),
+                 hit.mx, hit.my, hit.mdx, hit.mdy, COIN_R, ti, nullptr) >= 0) {
+    return SHOT_CUE_BLOCKED;
+  }
+  return SHOT_VIABLE;
+}
+
+double ShotPlanner::score(double sx, double sy, double dx, double dy,
+                          int target) const {
+  CircleQuery cue_near;
+  cueCorridor(sx, sy, target, cue_near);
+  return score(sx, sy, dx, dy, target, cue_near);
+}
+
+double ShotPlanner::score(double sx, double sy, double dx, double dy,
+                          int target, const CircleQuery &cue_near) const {
+  const int ti = _targets[target];
+  const double tx = _obstacles.x[ti];
+  const double ty = _obstacles.y[ti];
+  const double tr = _obstacles.r[ti];
+
+  Collision hit;
+  if (!collide(sx, sy, dx, dy, COIN_R, tx, ty, tr, &hit)) {
+    return 0;
+  }
+  // cue up to the target, then the target and the deflected cue; obstacles
+  // further than the cap from a path cannot change the score
+  double clearance =
+      clearanceIn(cue_near, sx, sy, dx, dy, COIN_R, hit.travel, ti);
+  thread_local CircleQuery near;
+  clearance = min(
+      clearance,
+      clearanceIn(
+          pathCorridor(tx, ty, hit.sdx, hit.sdy, tr + SHOT_CLEARANCE_CAP, near),
+          tx, ty, hit.sdx, hit.sdy, tr, BOARD_REACH, ti));
+  clearance = min(clearance,
+                  clearanceIn(pathCorridor(hit.mx, hit.my, hit.mdx, hit.mdy,
+                                           COIN_R + SHOT_CLEARANCE_CAP, near),
+                              hit.mx, hit.my, hit.mdx, hit.mdy, COIN_R,
+                              BOARD_REACH, ti));
+
+  double psi = atan2(dy, dx);
+  double angle_margin = min(psi - MIN_PSI, M_PI - MIN_PSI - psi);
+  return max(0.0, min(clearance, SHOT_CLEARANCE_CAP)) / SHOT_CLEARANCE_CAP +
+         max(0.0, angle_margin) / (M_PI / 2 - MIN_PSI);
+}
+
+void ShotPlanner::sweep(double sx, double sy, double ux, double uy,
+                        double step, int target, const CircleQuery &cue_near,
+                        PairResult &result) const {
+  int code;
+  while ((code = evaluate(sx, sy, ux, uy, target, cue_near,
+                          &result.corridor)) != SHOT_MISSES_TARGET) {
+    double angle = atan2(uy, ux);
+    if (code != SHOT_BLOCKED_BEFORE_TARGET && !result.has_failsafe) {
+      result.failsafe = {sx, sy, angle, 0, 0};
+      result.has_failsafe = true;
+    }
+    if (code == SHOT_VIABLE && angle >= MIN_PSI && angle <= M_PI - MIN_PSI) {
+      result.viable.push_back(
+          {sx, sy, angle, score(sx, sy, ux, uy, target, cue_near), 0});
+    }
+    rotate(ux, uy, step);
+  }
+}
+
+void ShotPlanner::searchPair(int start, int target,
+                             PairResult &result) const {
+  const double sx = _start_x[start];
+  const double sy = _start_y[start];
+  const double tx = _obstacles.x[_targets[target]];
+  const double ty = _obstacles.y[_targets[target]];
+  const double tr = _obstacles.r[_targets[target]];
+  result.start = start;
+  result.target_x = tx;
+  result.target_y = ty;
+  result.viable.clear();
+  result.has_failsafe = false;
+  result.corridor.clear();
+  // every cue path that hits the target stays within COIN_R + tr of the
+  // line to its center
+  result.corridor.push_back(
+      {sx, sy, tx, ty, 2 * COIN_R + tr + SHOT_CLEARANCE_CAP});
+
+  thread_local CircleQuery cue_near;
+  cueCorridor(sx, sy, target, cue_near);
+
+  // direct line to the target, then sweep to either side of it
+  double ux = tx - sx;
+  double uy = ty - sy;
+  double norm = hypot(ux, uy);
+  ux /= norm;
+  uy /= norm;
+  sweep(sx, sy, ux, uy, ANGLE_EPSILON, target, cue_near, result);
+  rotate(ux, uy, -ANGLE_EPSILON);
+  sweep(sx, sy, ux, uy, -ANGLE_EPSILON, target, cue_near, result);
+}
+
+namespace {
+int findCircle(const CircleSet &set, double x, double y, double r) {
+  for (int i = 0; i < set.size(); i++) {
+    if (set.r[i] == r && fabs(set.x[i] - x) <= SHOT_CACHE_TOLERANCE &&
+        fabs(set.y[i] - y) <= SHOT_CACHE_TOLERANCE) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool corridorTouches(const PairResult &result, const CircleSet &changed) {
+  for (const Capsule &capsule : result.corridor) {
+    for (int i = 0; i < changed.size(); i++) {
+      if (capsule.distance(changed.x[i], changed.y[i]) <
+          capsule.reach + changed.r[i]) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+} // namespace
+
+void ShotPlanner::plan(ShotPlan &plan, const ShotPlanOptions &options) const {
+  typedef chrono::steady_clock Clock;
+  const Clock::time_point deadline =
+      Clock::now() + chrono::duration_cast<Clock::duration>(
+                         chrono::duration<double, milli>(options.deadline_ms));
+  const int pairs = _start_x.size() * numTargets();
+
+  // one result per (start, target) pair, merged in search order so the plan
+  // does not depend on how the pairs were scheduled
+  vector<PairResult> results(pairs);
+  vector<char> done(pairs, 0);
+
+  // coins that appeared or disappeared since the cached board; coins that
+  // stayed keep the cached coordinates
+  ShotPlanCache *cache = options.cache;
+  CircleSet board;
+  vector<int> pair_target_cached(numTargets(), -1);
+  if (cache != nullptr) {
+    CircleSet changed;
+    vector<char> kept(cache->_board.size(), 0);
+    vector<int> cached_index(_obstacles.size(), -1);
+    for (int i = 0; i < _obstacles.size(); i++) {
+      int j = findCircle(cache->_board, _obstacles.x[i], _obstacles.y[i],
+                         _obstacles.r[i]);
+      if (j >= 0 && !kept[j]) {
+        kept[j] = 1;
+        cached_index[i] = j;
+        board.add(cache->_board.x[j], cache->_board.y[j], cache->_board.r[j]);
+      } else {
+        changed.add(_obstacles.x[i], _obstacles.y[i], _obstacles.r[i]);
+        board.add(_obstacles.x[i], _obstacles.y[i], _obstacles.r[i]);
+      }
+    }
+    for (int j = 0; j < cache->_board.size(); j++) {
+      if (!kept[j]) {
+        changed.add(cache->_board.x[j], cache->_board.y[j],
+                    cache->_board.r[j]);
+      }
+    }
+
+    // carry over the pairs of unchanged targets that no change touches
+    for (const PairResult &cached : cache->_pairs) {
+      for (int t = 0; t < numTargets(); t++) {
+        int j = cached_index[_targets[t]];
+        if (j >= 0 &&
+            fabs(cache->_board.x[j] - cached.target_x) <=
+                SHOT_CACHE_TOLERANCE &&
+            fabs(cache->_board.y[j] - cached.target_y) <=
+                SHOT_CACHE_TOLERANCE) {
+          int i = cached.start * numTargets() + t;
+          if (!done[i] && !corridorTouches(cached, changed)) {
+            results[i] = cached;
+            done[i] = 1;
+          }
+          break;
+        }
+      }
+    }
+    cache->_reused = count(done.begin(), done.end(), 1);
+  }
+
+  auto search = [&](int i, int) {
+    if (done[i] || (options.deadline_ms > 0 && Clock::now() > deadline)) {
+      return;
+    }
+    searchPair(i / numTargets(), i % numTargets(), results[i]);
+    done[i] = 2;
+  };
+  if (options.pool != nullptr) {
+    options.pool->parallelFor(pairs, search);
+  } else {
+    for (int i = 0; i < pairs; i++) {
+      search(i, 0);
+    }
+  }
+
+  plan.viable.clear();
+  plan.best.clear();
+  plan.has_failsafe = false;
+  plan.complete = true;
+  for (int i = 0; i < pairs; i++) {
+    if (!done[i]) {
+      plan.complete = false;
+      continue;
+    }
+    plan.viable.insert(plan.viable.end(), results[i].viable.begin(),
+                       results[i].viable.end());
+    if (results[i].has_failsafe && !plan.has_failsafe) {
+      plan.failsafe = results[i].failsafe;
+      plan.has_failsafe = true;
+    }
+  }
+
+  // top k by score, earlier in search order on ties
+  plan.best = plan.viable;
+  stable_sort(plan.best.begin(), plan.best.end(),
+              [](const ShotCandidate &a, const ShotCandidate &b) {
+                return a.score > b.score;
+              });
+  if (options.rollout != nullptr && !plan.best.empty()) {
+    if ((int)plan.best.size() > options.rollout_candidates) {
+      plan.best.resize(max(1, options.rollout_candidates));
+    }
+    vector<double> points(plan.best.size());
+    options.rollout->expectedPoints(plan.best.data(), plan.best.size(),
+                                    points.data(), options.pool);
+    for (size_t i = 0; i < plan.best.size(); i++) {
+      plan.best[i].expected_points = points[i];
+    }
+    // higher score first on ties
+    stable_sort(plan.best.begin(), plan.best.end(),
+                [](const ShotCandidate &a, const ShotCandidate &b) {
+                  return a.expected_points > b.expected_points;
+                });
+  }
+  if ((int)plan.best.size() > options.top_k) {
+    plan.best.resize(max(0, options.top_k));
+  }
+
+  if (cache != nullptr) {
+    cache->_searched = count(done.begin(), done.end(), 2);
+    cache->_board = board;
+    cache->_pairs.clear();
+    for (int i = 0; i < pairs; i++) {
+      if (done[i]) {
+        cache->_pairs.push_back(move(results[i]));
+      }
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+namespace {
+// pool and cache live as long as the library; one plan at a time on them
+mutex shared_mutex;
+ShotPlanCache shared_cache;
+ThreadPool &shared_pool() {
+  static ThreadPool pool;
+  return pool;
+}
+} // namespace
+
+int shot_planner_plan(const double *x, const double *y, const int *identity,
+                      int n, double *viable, int max_viable, double *failsafe,
+                      int *has_failsafe) {
+  ShotPlanner planner;
+  planner.setCoins(x, y, identity, n);
+  ShotPlan plan;
+  planner.plan(plan);
+
+  int count = plan.viable.size();
+  for (int i = 0; i < min(count, max_viable); i++) {
+    viable[3 * i] = plan.viable[i].x;
+    viable[3 * i + 1] = plan.viable[i].y;
+    viable[3 * i + 2] = plan.viable[i].psi;
+  }
+  *has_failsafe = plan.has_failsafe;
+  if (plan.has_failsafe) {
+    failsafe[0] = plan.failsafe.x;
+    failsafe[1] = plan.failsafe.y;
+    failsafe[2] = plan.failsafe.psi;
+  }
+  return count;
+}
+
+namespace {
+// plans on the shared pool and cache (shared_mutex held) and fills the
+// outputs of shot_planner_plan_best / _expected, with `columns` values per
+// row of best
+int planShared(const double *x, const double *y, const int *identity, int n,
+               int top_k, double deadline_ms, const CoinRollout *rollout,
+               int rollout_candidates, int columns, double *best,
+               double *failsafe, int *has_failsafe, int *complete) {
+  ShotPlanner planner;
+  planner.setCoins(x, y, identity, n);
+  ShotPlanOptions options;
+  options.top_k = top_k;
+  options.deadline_ms = deadline_ms;
+  options.pool = &shared_pool();
+  options.cache = &shared_cache;
+  options.rollout = rollout;
+  options.rollout_candidates = rollout_candidates;
+  ShotPlan plan;
+  planner.plan(plan, options);
+
+  int count = plan.best.size();
+  for (int i = 0; i < count; i++) {
+    double *row = best + columns * i;
+    row[0] = plan.best[i].x;
+    row[1] = plan.best[i].y;
+    row[2] = plan.best[i].psi;
+    row[3] = plan.best[i].score;
+    if (columns > 4) {
+      row[4] = plan.best[i].expected_points;
+    }
+  }
+  *has_failsafe = plan.has_failsafe;
+  if (plan.has_failsafe) {
+    failsafe[0] = plan.failsafe.x;
+    failsafe[1] = plan.failsafe.y;
+    failsafe[2] = plan.failsafe.psi;
+  }
+  *complete = plan.complete;
+  return count;
+}
+} // namespace
+
+int shot_planner_plan_best(const double *x, const double *y,
+                           const int *identity, int n, int top_k,
+                           double deadline_ms, double *best, double *failsafe,
+                           int *has_failsafe, int *complete) {
+  lock_guard<mutex> lock(shared_mutex);
+  return planShared(x, y, identity, n, top_k, deadline_ms, nullptr, 0, 4, best,
+                    failsafe, has_failsafe, complete);
+}
+
+int shot_planner_plan_expected(const double *x, const double *y,
+                               const int *identity, int n, int top_k,
+                               double deadline_ms, int rollout_candidates,
+                               double *best, double *failsafe,
+                               int *has_failsafe, int *complete,
+                               double *board_points) {
+  lock_guard<mutex> lock(shared_mutex);
+  CoinRollout rollout;
+  rollout.setBoard(x, y, identity, n);
+  *board_points = rollout.boardPoints();
+  return planShared(x, y, identity, n, top_k, deadline_ms, &rollout,
+                    rollout_candidates, 5, best, failsafe, has_failsafe,
+                    complete);
+}
+
+void shot_planner_cache_stats(int *reused, int *searched) {
+  lock_guard<mutex> lock(shared_mutex);
+  *reused = shared_cache.reused();
+  *searched = shared_cache.searched();
+}
+
+void shot_planner_clear_cache() {
+  lock_guard<mutex> lock(shared_mutex);
+  shared_cache.clear();
+}
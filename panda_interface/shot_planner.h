@@ -0,0 +1,231 @@
+/*
+Shot planner: C++ replacement for the plan_shot search in src/shot_planner.py.
+Given the coins on the board (board frame, mm) it walks the same candidate
+grid as the python planner - start positions along the starting arc, every
+opponent coin as a target, the aiming angle swept in ANGLE_EPSILON steps
+away from the direct line until the cue misses the target - and applies the
+same five viability checks (see ShotPlanner::evaluate). Coins and obstacles
+are kept in structure-of-arrays form so the per-candidate checks are plain
+loops over contiguous arrays.
+
+The (start position, target) pairs can be searched on a ThreadPool with a
+deadline; viable shots are scored and the best few kept (see ShotPlanner::
+score), and with a ShotPlanCache results are kept between turns. The
+first-hit queries only see the obstacles a BoardGrid finds near the path.
+With a CoinRollout the best shots are rolled out on the board and ranked by
+the points they are expected to leave (see coin_rollout.h). A C interface
+(shot_planner_plan, shot_planner_plan_best, shot_planner_plan_expected) is
+exported for the ctypes bindings in src/shot_planner.py.
+*/
+
+#ifndef SHOT_PLANNER_H
+#define SHOT_PLANNER_H
+
+#include "board_grid.h"
+
+#include <cmath>
+#include <vector>
+
+class CoinRollout;
+class ThreadPool;
+
+// board geometry, mm (same values as src/shot_planner.py)
+const double BOARD_R = 276.225;
+const double STARTING_ARC_R = 255.5875;
+const double COIN_R = 15.5;
+const double POST_R = 12;
+// radius of the circle the posts stand on
+const double POST_RING_R = 80.9625;
+const double ANGLE_EPSILON = 0.01;
+const double MIN_PSI = M_PI / 3.5;
+const int NUM_START_POSITIONS = 50;
+// obstacle clearance (mm) beyond which a shot is not considered any safer
+const double SHOT_CLEARANCE_CAP = 50;
+// coins that moved less than this (mm) between boards count as unchanged
+const double SHOT_CACHE_TOLERANCE = 1;
+
+// coin identities (src/coin.py)
+#define COIN_ROBOT 1
+#define COIN_HUMAN 2
+#define COIN_CUE 3
+
+// viability codes, as returned by is_viable_path
+#define SHOT_VIABLE 0
+#define SHOT_MISSES_TARGET 1
+#define SHOT_BLOCKED_BEFORE_TARGET 2
+#define SHOT_MISSES_CENTER 3
+#define SHOT_TARGET_BLOCKED 4
+#define SHOT_CUE_BLOCKED 5
+
+struct ShotCandidate {
+  double x;   // cue start position
+  double y;
+  double psi; // shot angle, atan2 of the aiming direction
+  double score;
+  // robot minus human points after the shot, if ranked by a CoinRollout
+  double expected_points;
+};
+
+// the four posts not covered by the starting arc (appended to posts), the
+// obstacles of the viability check
+void boardPosts(CircleSet &posts);
+// all eight posts of the 15 ring (appended to posts), for coin physics
+void allBoardPosts(CircleSet &posts);
+
+// search result of one (start position, target) pair, plus the corridor of
+// board space it depended on
+struct PairResult {
+  int start;
+  double target_x, target_y;
+  std::vector<ShotCandidate> viable;
+  bool has_failsafe;
+  ShotCandidate failsafe;
+  std::vector<Capsule> corridor;
+};
+
+/*
+Pair results carried over between plans. On the next plan the new board is
+diffed against the cached one; a pair is searched again only if its target
+changed or a coin appeared or disappeared inside its corridor, so replanning
+after a throw costs roughly what the throw disturbed.
+*/
+class ShotPlanCache {
+public:
+  ShotPlanCache() : _reused(0), _searched(0) {}
+
+  void clear() {
+    _board.clear();
+    _pairs.clear();
+  }
+  // pairs taken from the cache / searched by the last plan
+  int reused() const { return _reused; }
+  int searched() const { return _searched; }
+
+private:
+  friend class ShotPlanner;
+
+  CircleSet _board; // coin positions the cached pairs were searched with
+  std::vector<PairResult> _pairs;
+  int _reused;
+  int _searched;
+};
+
+struct ShotPlanOptions {
+  // best shots to keep in ShotPlan::best
+  int top_k = 5;
+  // stop starting new (start position, target) pairs after this long, 0 for
+  // no limit
+  double deadline_ms = 0;
+  // search on a pool instead of the calling thread
+  ThreadPool *pool = nullptr;
+  // reuse (and update) pair results of earlier plans
+  ShotPlanCache *cache = nullptr;
+  // roll out the rollout_candidates best shots by score on this (the same
+  // board as the planner's) and rank ShotPlan::best by expected points
+  // instead; done after the search, so outside the deadline
+  const CoinRollout *rollout = nullptr;
+  int rollout_candidates = 64;
+};
+
+struct ShotPlan {
+  // viable shots inside [MIN_PSI, pi - MIN_PSI], in search order
+  std::vector<ShotCandidate> viable;
+  // highest scoring (or with a rollout, most expected points) viable shots,
+  // best first
+  std::vector<ShotCandidate> best;
+  // first candidate that hits its target with nothing in between
+  bool has_failsafe;
+  ShotCandidate failsafe;
+  // false if the deadline cut the search short
+  bool complete;
+};
+
+class ShotPlanner {
+public:
+  ShotPlanner();
+
+  // replaces the board; cue coins are ignored, every other coin is an
+  // obstacle and opponent (COIN_HUMAN) coins are targets
+  void setCoins(const double *x, const double *y, const int *identity, int n);
+
+  // searches the candidate grid
+  void plan(ShotPlan &plan,
+            const ShotPlanOptions &options = ShotPlanOptions()) const;
+
+  // viability of one shot from (sx, sy) along the unit direction (dx, dy)
+  // at target `target` (0 .. numTargets() - 1), SHOT_* code; the paths past
+  // the target that were traced are appended to corridor if given
+  int evaluate(double sx, double sy, double dx, double dy, int target,
+               std::vector<Capsule> *corridor = nullptr) const;
+
+  // quality of a viable shot in [0, 2]: obstacle clearance of all three
+  // paths (capped at SHOT_CLEARANCE_CAP) plus how far psi is from the
+  // MIN_PSI bounds, each normalized to [0, 1]
+  double score(double sx, double sy, double dx, double dy, int target) const;
+
+  const CircleSet &obstacles() const { return _obstacles; }
+  int numTargets() const { return _targets.size(); }
+
+private:
+  // obstacles a cue from (sx, sy) can touch (or pass within the clearance
+  // cap of) before it hits the target, for any hitting angle
+  void cueCorridor(double sx, double sy, int target, CircleQuery &near) const;
+  // obstacles within reach of the ray from (ox, oy) across the board, in
+  // near or (on sparse boards) all of them
+  const CircleQuery &pathCorridor(double ox, double oy, double ux, double uy,
+                                  double reach, CircleQuery &near) const;
+  // evaluate / score with the cueCorridor of (sx, sy) already queried
+  int evaluate(double sx, double sy, double dx, double dy, int target,
+               const CircleQuery &cue_near,
+               std::vector<Capsule> *corridor) const;
+  double score(double sx, double sy, double dx, double dy, int target,
+               const CircleQuery &cue_near) const;
+  // walks one side of the angle sweep for (start, target), appending to result
+  void sweep(double sx, double sy, double ux, double uy, double step,
+             int target, const CircleQuery &cue_near,
+             PairResult &result) const;
+  // both sweeps for one (start position index, target) pair
+  void searchPair(int start, int target, PairResult &result) const;
+
+  CircleSet _obstacles;      // board coins plus the four posts
+  std::vector<int> _targets; // indices into _obstacles
+  BoardGrid _grid;           // over _obstacles
+  CircleQuery _all_obstacles;
+  std::vector<double> _start_x;
+  std::vector<double> _start_y;
+};
+
+extern "C" {
+// plans a shot for n coins; fills up to max_viable (x, y, psi) triples into
+// viable and the failsafe triple into failsafe (if has_failsafe is set).
+// Returns the total number of viable shots, which may exceed max_viable.
+int shot_planner_plan(const double *x, const double *y, const int *identity,
+                      int n, double *viable, int max_viable, double *failsafe,
+                      int *has_failsafe);
+
+// plans on a shared thread pool and cache within deadline_ms (0: no limit);
+// fills up to top_k (x, y, psi, score) rows into best, best first, and the
+// failsafe triple. Returns the number of rows written; *complete is cleared
+// if the deadline was hit.
+int shot_planner_plan_best(const double *x, const double *y,
+                           const int *identity, int n, int top_k,
+                           double deadline_ms, double *best, double *failsafe,
+                           int *has_failsafe, int *complete);
+
+// shot_planner_plan_best, with the rollout_candidates best by score rolled
+// out and ranked by expected points; rows are (x, y, psi, score,
+// expected_points) and *board_points is the points of the board as it is
+int shot_planner_plan_expected(const double *x, const double *y,
+                               const int *identity, int n, int top_k,
+                               double deadline_ms, int rollout_candidates,
+                               double *best, double *failsafe,
+                               int *has_failsafe, int *complete,
+                               double *board_points);
+
+// pairs reused from the cache / searched by the last shot_planner_plan_best
+void shot_planner_cache_stats(int *reused, int *searched);
+// forgets the cached board (e.g. for a new game)
+void shot_planner_clear_cache();
+}
+
+#endif // SHOT_PLANNER_H
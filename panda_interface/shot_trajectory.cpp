@@ -0,0 +1,151 @@
+#include "shot_trajectory.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace Eigen;
+
+namespace {
+// diameter of board is 20.125 in, convert to m:
+const double r = 20.125 / 2 * 0.0254;
+
+const double x_offset = 0.7385; // need to calibrate
+const double y_offset = 0.1070 + 0.035;
+const double z_offset = 0.3120; // need to calibrate
+
+// minimum-jerk profile: s(tau) = 10 tau^3 - 15 tau^4 + 6 tau^5 peaks at
+// 15/8 distance/T in velocity and 10/sqrt(3) distance/T^2 in acceleration
+const double min_jerk_velocity = 15.0 / 8.0;
+const double min_jerk_acceleration = 10.0 / sqrt(3.0);
+
+double minJerk(double tau) {
+  tau = max(0.0, min(1.0, tau));
+  return tau * tau * tau * (10 + tau * (-15 + 6 * tau));
+}
+} // namespace
+
+ShotWaypoints::ShotWaypoints(const Vector4d &cue_start_pos)
+    : arc_radius(r), arc_center_x(x_offset), arc_center_y(y_offset) {
+  home << 0.2859, 0.2787, 0.4300; // calibrate this
+  cue << r * sin(-M_PI / 4) + x_offset, r * cos(-M_PI / 4) + y_offset,
+      z_offset; // calibrate this
+  Matrix4d T;
+  T << 0, 1, 0, x_offset, -1, 0, 0, y_offset, 0, 0, 1, z_offset, 0, 0, 0, 1;
+  start = (T * cue_start_pos).head<3>();
+  cue_angle = atan2(cue(0) - x_offset, cue(1) - y_offset);
+  start_angle = atan2(start(0) - x_offset, start(1) - y_offset);
+}
+
+Vector3d ShotWaypoints::arcPoint(double a) const {
+  return Vector3d(arc_radius * sin(a) + arc_center_x,
+                  arc_radius * cos(a) + arc_center_y, cue(2));
+}
+
+Matrix3d homeOrientation() {
+  Matrix3d home_orientation;
+  home_orientation << 0.7360145, 0.6763110, 0.0297644, -0.0413102, 0.0009846,
+      0.9991459, 0.6757041, -0.7366155, 0.0286632;
+  return home_orientation;
+}
+
+Matrix3d cueOrientation() {
+  // rotate -45 degrees to gather the coin
+  return AngleAxisd(-M_PI / 4, Vector3d::UnitZ()).toRotationMatrix() *
+         homeOrientation();
+}
+
+Matrix3d aimOrientation(double psi) {
+  Matrix3d hit_rot;
+  hit_rot << cos(-M_PI / 2 + psi), -sin(-M_PI / 2 + psi), 0,
+      sin(-M_PI / 2 + psi), cos(-M_PI / 2 + psi), 0, 0, 0, 1;
+  return hit_rot * homeOrientation();
+}
+
+//------------------------------------------------------------------------------
+ShotTrajectory::ShotTrajectory(const OtgLimits &limits)
+    : _limits(limits), _arc_radius(r), _arc_center_x(x_offset),
+      _arc_center_y(y_offset), _arc_z(z_offset), _arc_from(0), _arc_to(0),
+      _segment(OTG_TO_CUE), _time(0) {
+  plan(Vector4d(0, -r, 0, 1), M_PI / 2);
+}
+
+double ShotTrajectory::minJerkTime(double distance, double velocity,
+                                   double acceleration) {
+  distance = fabs(distance);
+  return max(min_jerk_velocity * distance / velocity,
+             sqrt(min_jerk_acceleration * distance / acceleration));
+}
+
+void ShotTrajectory::plan(const Vector4d &cue_start_pos, double psi) {
+  const ShotWaypoints waypoints(cue_start_pos);
+  const Quaterniond home_rot(homeOrientation());
+  const Quaterniond cue_rot(cueOrientation());
+  const Quaterniond aim_rot(aimOrientation(psi));
+
+  _arc_radius = waypoints.arc_radius;
+  _arc_center_x = waypoints.arc_center_x;
+  _arc_center_y = waypoints.arc_center_y;
+  _arc_z = waypoints.cue(2);
+  _arc_from = waypoints.cue_angle;
+  _arc_to = waypoints.start_angle;
+  const Vector3d arc_end = waypoints.arcPoint(_arc_to);
+
+  _from[OTG_TO_CUE] = waypoints.home;
+  _to[OTG_TO_CUE] = waypoints.cue;
+  _rot_from[OTG_TO_CUE] = home_rot;
+  _rot_to[OTG_TO_CUE] = cue_rot;
+
+  _from[OTG_ALONG_ARC] = waypoints.cue;
+  _to[OTG_ALONG_ARC] = arc_end;
+  _rot_from[OTG_ALONG_ARC] = cue_rot;
+  _rot_to[OTG_ALONG_ARC] = cue_rot;
+
+  // the start position is on the arc, up to the planner's rounding
+  _from[OTG_AIM] = arc_end;
+  _to[OTG_AIM] = waypoints.start;
+  _rot_from[OTG_AIM] = cue_rot;
+  _rot_to[OTG_AIM] = aim_rot;
+
+  _from[OTG_HOME] = waypoints.start;
+  _to[OTG_HOME] = waypoints.home;
+  _rot_from[OTG_HOME] = aim_rot;
+  _rot_to[OTG_HOME] = home_rot;
+
+  for (int k = 0; k < OTG_SEGMENTS; k++) {
+    const double distance =
+        k == OTG_ALONG_ARC ? _arc_radius * (_arc_to - _arc_from)
+                           : (_to[k] - _from[k]).norm();
+    const double angle = _rot_from[k].angularDistance(_rot_to[k]);
+    _duration[k] = max(
+        {_limits.min_segment_time,
+         minJerkTime(distance, _limits.linear_velocity,
+                     _limits.linear_acceleration),
+         minJerkTime(angle, _limits.angular_velocity,
+                     _limits.angular_acceleration)});
+  }
+  start(OTG_TO_CUE);
+}
+
+void ShotTrajectory::start(int segment) {
+  _segment = segment;
+  _time = 0;
+}
+
+bool ShotTrajectory::advance(double dt, double rate) {
+  _time += dt * rate;
+  return complete();
+}
+
+void ShotTrajectory::pose(Vector3d &x, Matrix3d &rot) const {
+  const int k = _segment;
+  const double s = minJerk(_time / _duration[k]);
+  if (k == OTG_ALONG_ARC) {
+    const double a = _arc_from + s * (_arc_to - _arc_from);
+    x << _arc_radius * sin(a) + _arc_center_x,
+        _arc_radius * cos(a) + _arc_center_y, _arc_z;
+  } else {
+    x = _from[k] + s * (_to[k] - _from[k]);
+  }
+  rot = _rot_from[k].slerp(s, _rot_to[k]).toRotationMatrix();
+}
@@ -0,0 +1,121 @@
+/*
+Waypoints of the shot trajectory and the online trajectory generator (OTG)
+of controller_panda --otg.
+
+ShotWaypoints holds the fixed points of a shot in the robot frame: home, the
+cue coin, and the cue coin's start position on the starting arc (from the
+planner, board frame), plus the end effector orientations at home, at the
+cue coin and aimed along psi. The fixed slot trajectory
+(calculatePointInTrajectory) and the OTG both build on them.
+
+The OTG replaces the time slots with one minimum-jerk segment per move: home
+to the cue coin, along the arc to the start position, the turn to psi and,
+after the shot, back home. Each segment takes the shortest time in which its
+minimum-jerk profile stays within the OtgLimits, with a floor of
+min_segment_time. Time within a segment advances by dt times a rate in
+(0, 1] that the controller lowers while a joint is near its soft velocity or
+torque limit, so the arm slows down instead of violating it. The controller
+moves to the next segment when the current one completes.
+*/
+
+#ifndef SHOT_TRAJECTORY_H
+#define SHOT_TRAJECTORY_H
+
+#include <Eigen/Dense>
+
+// OTG segments
+#define OTG_TO_CUE 0
+#define OTG_ALONG_ARC 1
+#define OTG_AIM 2
+#define OTG_HOME 3
+#define OTG_SEGMENTS 4
+
+// waypoints of a shot, robot frame (m)
+struct ShotWaypoints {
+  // cue_start_pos: start position of the cue coin, board frame (m,
+  // homogeneous)
+  explicit ShotWaypoints(const Eigen::Vector4d &cue_start_pos);
+
+  // point of the starting arc at angle a (atan2(x, y) about its center), at
+  // the height of the cue coin
+  Eigen::Vector3d arcPoint(double a) const;
+
+  Eigen::Vector3d home;
+  Eigen::Vector3d cue;
+  Eigen::Vector3d start;
+  double arc_radius;
+  double arc_center_x, arc_center_y;
+  double cue_angle, start_angle; // of cue / start on the arc
+};
+
+// end effector orientation at home, holding the cue coin, and aimed at psi
+Eigen::Matrix3d homeOrientation();
+Eigen::Matrix3d cueOrientation();
+Eigen::Matrix3d aimOrientation(double psi);
+
+struct OtgLimits {
+  double linear_velocity = 0.25;     // m/s
+  double linear_acceleration = 0.5;  // m/s^2
+  double angular_velocity = 1.0;     // rad/s
+  double angular_acceleration = 2.0; // rad/s^2
+  double min_segment_time = 0.3;     // s
+  // fraction of a joint's soft velocity / torque limit above which time is
+  // slowed down, to 0.1 of real time at the limit
+  double slowdown = 0.8;
+  // the shot starts once the aim segment is done and the end effector is
+  // within settle_position (m) of it and slower than settle_velocity (m/s),
+  // or settle_timeout (s) after the segment ended
+  double settle_position = 0.005;
+  double settle_velocity = 0.02;
+  double settle_timeout = 1.0;
+};
+
+class ShotTrajectory {
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  explicit ShotTrajectory(const OtgLimits &limits = OtgLimits());
+
+  // plans the segments of a shot, see ShotWaypoints
+  void plan(const Eigen::Vector4d &cue_start_pos, double psi);
+
+  // restarts the time in segment (OTG_*)
+  void start(int segment);
+
+  // advances the time in the current segment by dt * rate; true once the
+  // segment is complete
+  bool advance(double dt, double rate);
+
+  // desired pose at the current time
+  void pose(Eigen::Vector3d &x, Eigen::Matrix3d &rot) const;
+
+  int segment() const { return _segment; }
+  bool complete() const { return _time >= _duration[_segment]; }
+  // time spent in the current segment past its end, s
+  double overtime() const {
+    return complete() ? _time - _duration[_segment] : 0;
+  }
+  double duration(int segment) const { return _duration[segment]; }
+  const OtgLimits &limits() const { return _limits; }
+
+private:
+  // shortest minimum-jerk duration for distance within the velocity and
+  // acceleration limits
+  static double minJerkTime(double distance, double velocity,
+                            double acceleration);
+
+  OtgLimits _limits;
+  // straight segments (all but OTG_ALONG_ARC) go from _from to _to, the arc
+  // from _arc_from to _arc_to
+  Eigen::Vector3d _from[OTG_SEGMENTS];
+  Eigen::Vector3d _to[OTG_SEGMENTS];
+  Eigen::Quaterniond _rot_from[OTG_SEGMENTS];
+  Eigen::Quaterniond _rot_to[OTG_SEGMENTS];
+  double _arc_radius, _arc_center_x, _arc_center_y, _arc_z;
+  double _arc_from, _arc_to;
+  double _duration[OTG_SEGMENTS];
+  int _segment;
+  double _time;
+};
+
+#endif // SHOT_TRAJECTORY_H
@@ -2,14 +2,24 @@
 #include "Sai2Graphics.h"
 #include "Sai2Simulation.h"
 #include <dynamics3d.h>
+#include "asset_cache.h"
 #include "redis/RedisClient.h"
+#include "redis_pipeline.h"
+#include "options.h"
+#include "realtime.h"
+#include "shm_transport.h"
+#include "loop_profiler.h"
+#include "telemetry.h"
 #include "timer/LoopTimer.h"
+#include "triple_buffer.h"
 
 #include <GLFW/glfw3.h> //must be loaded after loading opengl/glew
 
+#include <chrono>
 #include <iostream>
 #include <string>
 
+#include <sched.h>
 #include <signal.h>
 bool fSimulationRunning = false;
 void sighandler(int){fSimulationRunning = false;}
@@ -21,6 +31,8 @@ const string world_file = "./resources/world.urdf";
 const string robot_file = "./resources/panda_arm.urdf";
 const string robot_name = "PANDA";
 const string camera_name = "camera_fixed";
+// meshes preconverted for Sai2Graphics, see asset_cache.h
+const string asset_cache_dir = "./resources/cache";
 
 // redis keys:
 // - write:
@@ -28,9 +40,45 @@ const std::string JOINT_ANGLES_KEY = "sai2::cs225a::panda_robot::sensors::q";
 const std::string JOINT_VELOCITIES_KEY = "sai2::cs225a::panda_robot::sensors::dq";
 // - read
 const std::string TORQUES_COMMANDED_KEY = "sai2::cs225a::panda_robot::actuators::fgc";
+// - loop timing snapshot
+const std::string TIMING_KEY = "sai2::cs225a::panda_robot::timing::simulation";
+
+// simulation loop timing phases
+#define PHASE_REDIS_READ 0
+#define PHASE_INTEGRATE 1
+#define PHASE_KINEMATICS 2
+#define PHASE_REDIS_WRITE 3
 
 RedisClient redis_client;
 
+// raw double encoding for the state keys (--binary)
+bool binary_io = false;
+
+// state and torques through shared memory instead of redis (--shm)
+bool use_shm = false;
+ShmTransport shm;
+
+// joint state handed from the simulation thread to the render thread
+struct RobotSnapshot {
+	unsigned long long step;
+	int dof;
+	double q[SHM_MAX_DOF];
+};
+TripleBuffer<RobotSnapshot> render_buffer;
+
+// no window, step in lockstep with the controller as fast as possible (--headless)
+bool headless = false;
+
+// real-time setup for the simulation thread (--rt)
+RealtimeOptions realtime_options;
+
+// per-tick telemetry of the simulation (--record <file>, --record-seconds)
+const char* record_path = nullptr;
+double record_seconds = 600;
+
+// start of main, for the startup time reported at the first step
+chrono::steady_clock::time_point process_start;
+
 // simulation function prototype
 void simulation(Sai2Model::Sai2Model* robot, Simulation::Sai2Simulation* sim);
 
@@ -52,8 +100,38 @@ bool fTransZp = false;
 bool fTransZn = false;
 bool fRotPanTilt = false;
 
-int main() {
-	cout << "Loading URDF world model file: " << world_file << endl;
+int main(int argc, char** argv) {
+	process_start = chrono::steady_clock::now();
+	binary_io = hasOption(argc, argv, "--binary");
+	// graphics refresh rate, independent of the 1 kHz simulation
+	const double render_hz = optionValue(argc, argv, "--render-hz", 60);
+	use_shm = hasOption(argc, argv, "--shm");
+	headless = hasOption(argc, argv, "--headless");
+	realtime_options = realtimeOptions(argc, argv);
+	record_path = optionString(argc, argv, "--record", nullptr);
+	record_seconds = optionValue(argc, argv, "--record-seconds", 600);
+	if (headless && !use_shm) {
+		// lockstep needs the step counters of the shared memory slots
+		cout << "--headless implies --shm" << endl;
+		use_shm = true;
+	}
+	if (use_shm && !shm.open()) {
+		return 1;
+	}
+
+	// the world as the graphics and simulation load it: with the meshes from
+	// the asset cache unless --no-asset-cache
+	string model_file = world_file;
+	if (!hasOption(argc, argv, "--no-asset-cache")) {
+		AssetCache asset_cache(asset_cache_dir);
+		model_file = asset_cache.model(world_file);
+		const AssetCacheStats& assets = asset_cache.stats();
+		cout << "Asset cache: " << assets.meshes << " meshes, "
+		     << assets.converted << " converted in " << assets.convert_time * 1e3
+		     << " ms, " << assets.failed << " failed, sources hashed in "
+		     << assets.hash_time * 1e3 << " ms" << endl;
+	}
+	cout << "Loading URDF world model file: " << model_file << endl;
 
 	// start redis client
 	redis_client = RedisClient();
@@ -64,17 +142,12 @@ int main() {
 	signal(SIGTERM, &sighandler);
 	signal(SIGINT, &sighandler);
 
-	// load graphics scene
-	auto graphics = new Sai2Graphics::Sai2Graphics(world_file, true);
-	Eigen::Vector3d camera_pos, camera_lookat, camera_vertical;
-	graphics->getCameraPose(camera_name, camera_pos, camera_vertical, camera_lookat);
-
 	// load robots
 	auto robot = new Sai2Model::Sai2Model(robot_file, false);
 	robot->updateKinematics();
 
 	// load simulation world
-	auto sim = new Simulation::Sai2Simulation(world_file, false);
+	auto sim = new Simulation::Sai2Simulation(model_file, false);
 	sim->setCollisionRestitution(0);
 	sim->setCoeffFrictionStatic(0.6);
 
@@ -83,6 +156,25 @@ int main() {
 	sim->getJointVelocities(robot_name, robot->_dq);
 	robot->updateKinematics();
 
+	if (headless) {
+		// no graphics: run the simulation loop on this thread until interrupted
+		cout << "Running headless, waiting for controller_panda --shm --lockstep" << endl;
+		fSimulationRunning = true;
+		simulation(robot, sim);
+		return 0;
+	}
+
+	// load graphics scene
+	auto graphics = new Sai2Graphics::Sai2Graphics(model_file, true);
+	Eigen::Vector3d camera_pos, camera_lookat, camera_vertical;
+	graphics->getCameraPose(camera_name, camera_pos, camera_vertical, camera_lookat);
+
+	// the render thread draws its own copy of the robot so that it never
+	// touches the model the simulation thread is updating
+	auto render_robot = new Sai2Model::Sai2Model(robot_file, false);
+	render_robot->_q = robot->_q;
+	render_robot->updateKinematics();
+
 	/*------- Set up visualization -------*/
 	// set up error callback
 	glfwSetErrorCallback(glfwError);
@@ -119,23 +211,32 @@ int main() {
 
 	fSimulationRunning = true;
 	thread sim_thread(simulation, robot, sim);
+
+	LoopTimer render_timer;
+	render_timer.initializeTimer();
+	render_timer.setLoopFrequency(render_hz);
 	
 	// while window is open:
 	while (fSimulationRunning)
 	{
+		render_timer.waitForNextLoop();
+
+		// pick up the latest joint state published by the simulation thread
+		if (render_buffer.update()) {
+			const RobotSnapshot& snapshot = render_buffer.read();
+			render_robot->_q = Map<const VectorXd>(snapshot.q, snapshot.dof);
+			render_robot->updateKinematics();
+		}
 
-		// update graphics. this automatically waits for the correct amount of time
+		// update graphics
 		int width, height;
 		glfwGetFramebufferSize(window, &width, &height);
-		graphics->updateGraphics(robot_name, robot);
+		graphics->updateGraphics(robot_name, render_robot);
 		graphics->render(camera_name, width, height);
 
 		// swap buffers
 		glfwSwapBuffers(window);
 
-		// wait until all GL commands are completed
-		glFinish();
-
 		// check for any OpenGL errors
 		GLenum err;
 		err = glGetError();
@@ -230,11 +331,61 @@ void simulation(Sai2Model::Sai2Model* robot, Simulation::Sai2Simulation* sim) {
 
 	unsigned long long simulation_counter = 0;
 
+	// batched redis io: torques in, q and dq out
+	RedisPipeline redis_pipeline(redis_client);
+	redis_pipeline.setBinaryEncoding(binary_io);
+	if (use_shm) {
+		// publish the initial state so the controller can start
+		shm.writeState(robot->_q, robot->_dq, simulation_counter);
+	} else {
+		redis_pipeline.addRead(TORQUES_COMMANDED_KEY, &command_torques);
+		redis_pipeline.addWrite(JOINT_ANGLES_KEY, &robot->_q);
+		redis_pipeline.addWrite(JOINT_VELOCITIES_KEY, &robot->_dq);
+	}
+
+	// per-phase timing, snapshot published to redis once per second
+	LoopProfiler profiler("simulation", {"redis_read", "integrate", "kinematics", "redis_write"}, 1000);
+	profiler.startPublisher(TIMING_KEY);
+
+	vector<string> telemetry_columns = {"time"};
+	appendColumns(telemetry_columns, "q", dof);
+	appendColumns(telemetry_columns, "dq", dof);
+	appendColumns(telemetry_columns, "tau", dof);
+	telemetry_columns.push_back("period_us");
+	telemetry_columns.push_back("compute_us");
+	TelemetryRecorder telemetry(telemetry_columns, 1000 * record_seconds);
+	if (record_path != nullptr && !telemetry.open(record_path)) {
+		fSimulationRunning = false;
+	}
+
+	// after the publisher thread is started, so it does not inherit the policy
+	enterRealtime(realtime_options, "simviz_panda");
+
+	cout << "Simulation startup: "
+	     << chrono::duration<double, milli>(chrono::steady_clock::now() - process_start).count()
+	     << " ms to the first step" << endl;
 	while (fSimulationRunning) {
-		fTimerDidSleep = timer.waitForNextLoop();
+		if (headless) {
+			// lockstep: advance once the controller has answered the last state
+			uint64_t command_step = 0;
+			while (fSimulationRunning && (!shm.readTorques(command_torques, &command_step) || command_step != simulation_counter)) {
+				sched_yield();
+			}
+			if (!fSimulationRunning) {
+				break;
+			}
+			fTimerDidSleep = true;
+		} else {
+			fTimerDidSleep = timer.waitForNextLoop();
+		}
+		profiler.startTick(fTimerDidSleep);
 
 		// read arm torques from redis
-		command_torques = redis_client.getEigenMatrixJSON(TORQUES_COMMANDED_KEY);
+		redis_pipeline.read();
+		if (use_shm && !headless) {
+			shm.readTorques(command_torques);
+		}
+		profiler.mark(PHASE_REDIS_READ);
 
 		// set torques to simulation
 		sim->setJointTorques(robot_name, command_torques);
@@ -243,27 +394,69 @@ void simulation(Sai2Model::Sai2Model* robot, Simulation::Sai2Simulation* sim) {
 		// double curr_time = timer.elapsedTime();
 		// double loop_dt = curr_time - last_time; 
 		sim->integrate(0.001);
+		profiler.mark(PHASE_INTEGRATE);
 
 		// read joint positions, velocities, update model
 		sim->getJointPositions(robot_name, robot->_q);
 		sim->getJointVelocities(robot_name, robot->_dq);
 		robot->updateKinematics();
+		if (!headless) {
+			RobotSnapshot& snapshot = render_buffer.write();
+			snapshot.step = simulation_counter + 1;
+			snapshot.dof = dof;
+			Map<VectorXd>(snapshot.q, dof) = robot->_q;
+			render_buffer.publish();
+		}
+		profiler.mark(PHASE_KINEMATICS);
 
 		// write new robot state to redis
-		redis_client.setEigenMatrixJSON(JOINT_ANGLES_KEY, robot->_q);
-		redis_client.setEigenMatrixJSON(JOINT_VELOCITIES_KEY, robot->_dq);
+		redis_pipeline.write();
+		if (use_shm) {
+			shm.writeState(robot->_q, robot->_dq, simulation_counter + 1);
+		}
+		profiler.mark(PHASE_REDIS_WRITE);
+		profiler.endTick();
+
+		if (telemetry.recording()) {
+			double* row = telemetry.row();
+			*row++ = simulation_counter * 0.001;
+			Map<VectorXd>(row, dof) = robot->_q;
+			row += dof;
+			Map<VectorXd>(row, dof) = robot->_dq;
+			row += dof;
+			Map<VectorXd>(row, dof) = command_torques;
+			row += dof;
+			*row++ = profiler.lastPeriod() * 1e-3;
+			*row++ = profiler.lastCompute() * 1e-3;
+			telemetry.commit();
+		}
 
 		//update last time
 		// last_time = curr_time;
 
 		simulation_counter++;
 	}
+	profiler.stopPublisher();
+	telemetry.close();
 
 	double end_time = timer.elapsedTime();
 	std::cout << "\n";
 	std::cout << "Simulation Loop run time  : " << end_time << " seconds\n";
-	std::cout << "Simulation Loop updates   : " << timer.elapsedCycles() << "\n";
-	std::cout << "Simulation Loop frequency : " << timer.elapsedCycles()/end_time << "Hz\n";
+	if (headless) {
+		double sim_time = simulation_counter * 0.001;
+		std::cout << "Simulation Loop updates   : " << simulation_counter << "\n";
+		std::cout << "Simulation Loop frequency : " << simulation_counter/end_time << "Hz\n";
+		std::cout << "Simulated time            : " << sim_time << " seconds\n";
+		std::cout << "Speedup over real time    : " << sim_time/end_time << "x\n";
+	} else {
+		std::cout << "Simulation Loop updates   : " << timer.elapsedCycles() << "\n";
+		std::cout << "Simulation Loop frequency : " << timer.elapsedCycles()/end_time << "Hz\n";
+	}
+	profiler.printSummary();
+	if (telemetry.written() > 0) {
+		std::cout << "Simulation telemetry rows : " << telemetry.written() << " written to " << record_path
+			<< " (" << telemetry.dropped() + telemetry.overflowed() << " lost)\n";
+	}
 }
 
 //------------------------------------------------------------------------------
@@ -0,0 +1,54 @@
+/*
+Lock-free single-producer / single-consumer ring of fixed capacity (a power
+of two). Neither side blocks: tryPush fails when the ring is full, tryPop
+when it is empty. The ring is allocated inside the object, and head and tail
+are kept a cache line apart (padding rather than alignas, so the queue can
+be allocated with plain new).
+*/
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+template <typename T, size_t CAPACITY> class SpscQueue {
+  static_assert((CAPACITY & (CAPACITY - 1)) == 0 && CAPACITY > 0,
+                "SpscQueue capacity must be a power of two");
+
+public:
+  SpscQueue() : _head(0), _tail(0) {}
+
+  // producer side
+  bool tryPush(const T &item) {
+    const size_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _head.load(std::memory_order_acquire) == CAPACITY) {
+      return false;
+    }
+    _items[tail & (CAPACITY - 1)] = item;
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer side
+  bool tryPop(T &item) {
+    const size_t head = _head.load(std::memory_order_relaxed);
+    if (head == _tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = _items[head & (CAPACITY - 1)];
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t capacity() const { return CAPACITY; }
+
+private:
+  T _items[CAPACITY];
+  char _pad_items[64];
+  std::atomic<size_t> _head; // consumer
+  char _pad_head[64];
+  std::atomic<size_t> _tail; // producer
+};
+
+#endif // SPSC_QUEUE_H
@@ -0,0 +1,135 @@
+#include "state_bus.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <new>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace Eigen;
+
+namespace {
+const uint32_t STATE_BUS_MAGIC = 0x53425553; // "SBUS"
+const uint32_t STATE_BUS_VERSION = 1;
+} // namespace
+
+struct StateBus::Region {
+  std::atomic<uint32_t> magic; // set last, once the seqlock is constructed
+  uint32_t version;
+  alignas(64) Seqlock<StateBusSnapshot> snapshot;
+};
+
+StateBus::StateBus() : _region(nullptr), _writable(false) {}
+
+StateBus::~StateBus() { close(); }
+
+bool StateBus::openWriter(const string &name) {
+  close();
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0666);
+  if (fd < 0) {
+    cerr << "StateBus: cannot open " << name << endl;
+    return false;
+  }
+  if (ftruncate(fd, sizeof(Region)) != 0) {
+    cerr << "StateBus: cannot size " << name << endl;
+    ::close(fd);
+    return false;
+  }
+  void *p = mmap(nullptr, sizeof(Region), PROT_READ | PROT_WRITE, MAP_SHARED,
+                 fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    cerr << "StateBus: cannot map " << name << endl;
+    return false;
+  }
+  _region = (Region *)p;
+  _writable = true;
+
+  // a fresh seqlock even over a region left by an earlier controller, which
+  // may have stopped in the middle of a write; readers mapped to it just see
+  // the version start over
+  _region->magic.store(0, memory_order_relaxed);
+  new (&_region->snapshot) Seqlock<StateBusSnapshot>();
+  _region->version = STATE_BUS_VERSION;
+  _region->magic.store(STATE_BUS_MAGIC, memory_order_release);
+  return true;
+}
+
+bool StateBus::openReader(const string &name) {
+  close();
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Region)) {
+    ::close(fd);
+    return false;
+  }
+  void *p = mmap(nullptr, sizeof(Region), PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    cerr << "StateBus: cannot map " << name << endl;
+    return false;
+  }
+  _region = (Region *)p;
+  _writable = false;
+  if (_region->magic.load(memory_order_acquire) != STATE_BUS_MAGIC ||
+      _region->version != STATE_BUS_VERSION) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void StateBus::close() {
+  if (_region != nullptr) {
+    munmap(_region, sizeof(Region));
+    _region = nullptr;
+  }
+}
+
+void StateBus::publish(const StateBusSnapshot &snapshot) {
+  if (_writable) {
+    _region->snapshot.store(snapshot);
+  }
+}
+
+bool StateBus::read(StateBusSnapshot &snapshot) const {
+  return _region != nullptr && _region->snapshot.load(snapshot);
+}
+
+uint32_t StateBus::version() const {
+  return _region != nullptr ? _region->snapshot.version() : 0;
+}
+
+void fillSnapshot(StateBusSnapshot &snapshot, uint64_t tick, int mode,
+                  int state, const VectorXd &q, const VectorXd &dq,
+                  const VectorXd &tau, const Vector3d &x, const Vector3d &xdot,
+                  const Matrix3d &rotation) {
+  const int dof = min((int)q.size(), SHM_MAX_DOF);
+  snapshot.tick = tick;
+  snapshot.timestamp = ShmTransport::now();
+  snapshot.dof = dof;
+  snapshot.mode = mode;
+  snapshot.state = state;
+  snapshot.reserved = 0;
+  for (int i = 0; i < dof; i++) {
+    snapshot.q[i] = q(i);
+    snapshot.dq[i] = dq(i);
+    snapshot.tau[i] = i < tau.size() ? tau(i) : 0;
+  }
+  for (int i = 0; i < 3; i++) {
+    snapshot.x[i] = x(i);
+    snapshot.xdot[i] = xdot(i);
+    for (int j = 0; j < 3; j++) {
+      snapshot.rotation[3 * i + j] = rotation(i, j);
+    }
+  }
+}
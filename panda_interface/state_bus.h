@@ -0,0 +1,77 @@
+/*
+Robot state bus: controller_panda --bus publishes one snapshot per tick (q,
+dq, commanded torques, end effector pose and velocity, mode and state) into
+a POSIX shared memory seqlock, /dev/shm/crokinole_state_bus. Any number of
+read-only consumers (get_pose --bus, src/state_bus.py) map it and read the
+latest snapshot at their own rate. The controller never waits on them, and
+they do not load the redis server the control loop depends on.
+
+The region is the magic and version, then at offset 64 the seqlock: its
+sequence (uint32) and at offset 72 the StateBusSnapshot, little-endian. The
+sequence is odd while a snapshot is being written.
+*/
+
+#ifndef STATE_BUS_H
+#define STATE_BUS_H
+
+#include "seqlock.h"
+#include "shm_transport.h"
+
+#include <Eigen/Dense>
+
+#include <cstdint>
+#include <string>
+
+const std::string STATE_BUS_DEFAULT_NAME = "/crokinole_state_bus";
+
+struct StateBusSnapshot {
+  uint64_t tick;    // controller ticks since it started
+  double timestamp; // steady clock, seconds
+  int32_t dof;
+  int32_t mode;  // WAIT_MODE / EXECUTE_MODE
+  int32_t state; // JOINT_CONTROLLER ...
+  int32_t reserved;
+  double q[SHM_MAX_DOF];
+  double dq[SHM_MAX_DOF];
+  double tau[SHM_MAX_DOF]; // commanded
+  double x[3];             // end effector position, m
+  double xdot[3];          // m/s
+  double rotation[9];      // end effector orientation, row-major
+};
+
+class StateBus {
+public:
+  StateBus();
+  ~StateBus();
+
+  // the controller: maps the region read-write, creating it if needed, and
+  // starts a new sequence of snapshots
+  bool openWriter(const std::string &name = STATE_BUS_DEFAULT_NAME);
+  // consumers: maps an existing region read-only; false if there is none
+  // (yet)
+  bool openReader(const std::string &name = STATE_BUS_DEFAULT_NAME);
+  void close();
+
+  // writer side; never blocks
+  void publish(const StateBusSnapshot &snapshot);
+
+  // reader side: the latest snapshot, false if none was published
+  bool read(StateBusSnapshot &snapshot) const;
+  // snapshots published so far, cheap to poll
+  uint32_t version() const;
+
+private:
+  struct Region;
+  Region *_region;
+  bool _writable;
+};
+
+// snapshot of the robot state (dof up to SHM_MAX_DOF), the torques and the
+// end effector pose
+void fillSnapshot(StateBusSnapshot &snapshot, uint64_t tick, int mode,
+                  int state, const Eigen::VectorXd &q,
+                  const Eigen::VectorXd &dq, const Eigen::VectorXd &tau,
+                  const Eigen::Vector3d &x, const Eigen::Vector3d &xdot,
+                  const Eigen::Matrix3d &rotation);
+
+#endif // STATE_BUS_H
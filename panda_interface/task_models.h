@@ -0,0 +1,99 @@
+/*
+Task models of the posori + joint hierarchy for an arm with a compile-time
+number of joints. Fills the same task members as
+Sai2Primitives::PosOriTask / JointTask::updateTaskModel (jacobians, Lambda,
+Jbar, nullspaces), but with Matrix<double, DOF, DOF> mass / nullspace and
+Matrix<double, 6, DOF> jacobian math, which Eigen unrolls and vectorizes.
+The TaskModels use the tasks' robot model as the tasks do (_M_inv from the
+current model update).
+
+The robot's dof is checked at runtime: for any other arm the Sai2Primitives
+updateTaskModel calls are used instead, so the controller code is the same
+either way.
+*/
+
+#ifndef TASK_MODELS_H
+#define TASK_MODELS_H
+
+#include "Sai2Model.h"
+#include "Sai2Primitives.h"
+
+#include <Eigen/Dense>
+
+template <int DOF> class TaskModels {
+public:
+  typedef Eigen::Matrix<double, DOF, DOF> MatrixDof;
+  typedef Eigen::Matrix<double, 6, DOF> Jacobian;
+  typedef Eigen::Matrix<double, 6, 6> Matrix6;
+
+  explicit TaskModels(Sai2Model::Sai2Model *robot)
+      : _robot(robot), _fixed(robot->dof() == DOF),
+        _J_dynamic(6, robot->dof()),
+        _N_prec_dynamic(
+            Eigen::MatrixXd::Identity(robot->dof(), robot->dof())) {}
+
+  // false if the robot does not have DOF joints (dynamic fallback)
+  bool fixed() const { return _fixed; }
+
+  // joint task alone at the top of the hierarchy
+  void updateJoint(Sai2Primitives::JointTask *joint_task) {
+    if (!_fixed) {
+      _N_prec_dynamic.setIdentity();
+      joint_task->updateTaskModel(_N_prec_dynamic);
+      return;
+    }
+    joint_task->_N_prec.setIdentity();
+  }
+
+  // posori task on top, joint task in its nullspace
+  void updatePosOriJoint(Sai2Primitives::PosOriTask *posori_task,
+                         Sai2Primitives::JointTask *joint_task) {
+    if (!_fixed) {
+      _N_prec_dynamic.setIdentity();
+      posori_task->updateTaskModel(_N_prec_dynamic);
+      joint_task->updateTaskModel(posori_task->_N);
+      return;
+    }
+
+    _robot->J_0(_J_dynamic, posori_task->_link_name,
+                posori_task->_control_frame.translation());
+    _J = _J_dynamic;
+    _M_inv = _robot->_M_inv;
+
+    // N_prec is the identity at the top of the hierarchy, so the projected
+    // jacobian is the jacobian
+    _Lambda_inv.noalias() = _J * _M_inv * _J.transpose();
+    _Lambda = _Lambda_inv.ldlt().solve(Matrix6::Identity());
+    _M_inv_Jt.noalias() = _M_inv * _J.transpose();
+    _Jbar.noalias() = _M_inv_Jt * _Lambda;
+    _N = MatrixDof::Identity();
+    _N.noalias() -= _Jbar * _J;
+
+    posori_task->_N_prec.setIdentity();
+    posori_task->_jacobian = _J;
+    posori_task->_projected_jacobian = _J;
+    posori_task->_Lambda = _Lambda;
+    posori_task->_Jbar = _Jbar;
+    posori_task->_N = _N;
+    joint_task->_N_prec = _N;
+  }
+
+private:
+  Sai2Model::Sai2Model *_robot;
+  bool _fixed;
+
+  // fixed-size path
+  Eigen::MatrixXd _J_dynamic; // J_0 output, same size every tick
+  Jacobian _J;
+  MatrixDof _M_inv;
+  Matrix6 _Lambda_inv;
+  Matrix6 _Lambda;
+  Eigen::Matrix<double, DOF, 6> _M_inv_Jt;
+  Eigen::Matrix<double, DOF, 6> _Jbar;
+  MatrixDof _N;
+
+  // fallback
+  Eigen::MatrixXd _N_prec_dynamic;
+};
+
+#endif // TASK_MODELS_H
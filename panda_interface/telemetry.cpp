@@ -0,0 +1,225 @@
+#include "telemetry.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+// header field offsets
+const size_t COLUMNS_OFFSET = 4;
+const size_t CAPACITY_OFFSET = 8;
+const size_t ROWS_OFFSET = 16;
+const size_t START_TIME_OFFSET = 24;
+const size_t NAMES_OFFSET = 32;
+
+uint64_t *rowsField(char *map) { return (uint64_t *)(map + ROWS_OFFSET); }
+
+double unixTime() {
+  return chrono::duration<double>(
+             chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+} // namespace
+
+//------------------------------------------------------------------------------
+TelemetryRecorder::TelemetryRecorder(const vector<string> &columns,
+                                     size_t capacity)
+    : _columns(columns), _capacity(capacity), _ring(nullptr), _dropped(0),
+      _map(nullptr), _map_size(0), _written(0), _overflowed(0),
+      _running(false) {
+  if ((int)columns.size() > TELEMETRY_ROW_WIDTH ||
+      (int)columns.size() > TELEMETRY_MAX_COLUMNS) {
+    throw runtime_error("TelemetryRecorder: too many columns");
+  }
+  memset(&_row, 0, sizeof(_row));
+}
+
+TelemetryRecorder::~TelemetryRecorder() { close(); }
+
+bool TelemetryRecorder::open(const string &path) {
+  const size_t size = TELEMETRY_HEADER_SIZE + _columns.size() * _capacity * 8;
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    cerr << "TelemetryRecorder: cannot create " << path << endl;
+    return false;
+  }
+  if (ftruncate(fd, size) != 0) {
+    cerr << "TelemetryRecorder: cannot size " << path << endl;
+    ::close(fd);
+    return false;
+  }
+  void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    cerr << "TelemetryRecorder: cannot map " << path << endl;
+    return false;
+  }
+  _map = (char *)p;
+  _map_size = size;
+
+  memcpy(_map, "TLM", 3);
+  _map[3] = TELEMETRY_VERSION;
+  const uint32_t columns = _columns.size();
+  const uint64_t capacity = _capacity;
+  const double start_time = unixTime();
+  memcpy(_map + COLUMNS_OFFSET, &columns, sizeof(columns));
+  memcpy(_map + CAPACITY_OFFSET, &capacity, sizeof(capacity));
+  memcpy(_map + START_TIME_OFFSET, &start_time, sizeof(start_time));
+  for (size_t k = 0; k < _columns.size(); k++) {
+    strncpy(_map + NAMES_OFFSET + k * TELEMETRY_NAME_SIZE, _columns[k].c_str(),
+            TELEMETRY_NAME_SIZE - 1);
+  }
+  _written = 0;
+  publishRows();
+
+  _ring = new SpscQueue<Row, TELEMETRY_RING_ROWS>();
+  _running = true;
+  _writer = thread(&TelemetryRecorder::run, this);
+  return true;
+}
+
+void TelemetryRecorder::close() {
+  if (!_writer.joinable()) {
+    return;
+  }
+  _running = false;
+  _writer.join();
+  msync(_map, _map_size, MS_SYNC);
+  munmap(_map, _map_size);
+  _map = nullptr;
+  delete _ring;
+  _ring = nullptr;
+}
+
+void TelemetryRecorder::commit() {
+  if (_ring == nullptr) {
+    return;
+  }
+  if (!_ring->tryPush(_row)) {
+    _dropped.store(_dropped.load(memory_order_relaxed) + 1,
+                   memory_order_relaxed);
+  }
+}
+
+void TelemetryRecorder::publishRows() {
+  __atomic_store_n(rowsField(_map), _written, __ATOMIC_RELEASE);
+}
+
+void TelemetryRecorder::run() {
+  double *data = (double *)(_map + TELEMETRY_HEADER_SIZE);
+  const size_t columns = _columns.size();
+  Row row;
+  while (true) {
+    // read the flag first so rows committed before close() are written
+    const bool running = _running;
+    bool wrote = false;
+    while (_ring->tryPop(row)) {
+      if (_written == _capacity) {
+        _overflowed++;
+        continue;
+      }
+      for (size_t k = 0; k < columns; k++) {
+        data[k * _capacity + _written] = row.values[k];
+      }
+      _written++;
+      wrote = true;
+    }
+    if (wrote) {
+      publishRows();
+    }
+    if (!running) {
+      break;
+    }
+    this_thread::sleep_for(chrono::milliseconds(5));
+  }
+}
+
+void appendColumns(vector<string> &columns, const string &prefix, int n) {
+  for (int i = 0; i < n; i++) {
+    columns.push_back(prefix + to_string(i));
+  }
+}
+
+//------------------------------------------------------------------------------
+TelemetryFile::TelemetryFile()
+    : _map(nullptr), _map_size(0), _rows(0), _capacity(0), _start_time(0) {}
+
+TelemetryFile::~TelemetryFile() { close(); }
+
+void TelemetryFile::open(const string &path) {
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw runtime_error("TelemetryFile: cannot open " + path);
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < TELEMETRY_HEADER_SIZE) {
+    ::close(fd);
+    throw runtime_error("TelemetryFile: " + path + " is not a telemetry file");
+  }
+  void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    throw runtime_error("TelemetryFile: cannot map " + path);
+  }
+  _map = (const char *)p;
+  _map_size = st.st_size;
+
+  uint32_t columns;
+  memcpy(&columns, _map + COLUMNS_OFFSET, sizeof(columns));
+  memcpy(&_capacity, _map + CAPACITY_OFFSET, sizeof(_capacity));
+  _rows = __atomic_load_n((const uint64_t *)(_map + ROWS_OFFSET),
+                          __ATOMIC_ACQUIRE);
+  memcpy(&_start_time, _map + START_TIME_OFFSET, sizeof(_start_time));
+  if (memcmp(_map, "TLM", 3) != 0 ||
+      (unsigned char)_map[3] != TELEMETRY_VERSION ||
+      columns > (uint32_t)TELEMETRY_MAX_COLUMNS || _rows > _capacity ||
+      TELEMETRY_HEADER_SIZE + columns * _capacity * 8 > _map_size) {
+    close();
+    throw runtime_error("TelemetryFile: " + path + " is not a telemetry file");
+  }
+  for (uint32_t k = 0; k < columns; k++) {
+    const char *name = _map + NAMES_OFFSET + k * TELEMETRY_NAME_SIZE;
+    _columns.push_back(string(name, strnlen(name, TELEMETRY_NAME_SIZE)));
+  }
+}
+
+void TelemetryFile::close() {
+  if (_map != nullptr) {
+    munmap((void *)_map, _map_size);
+  }
+  _map = nullptr;
+  _map_size = 0;
+  _rows = 0;
+  _capacity = 0;
+  _columns.clear();
+}
+
+int TelemetryFile::find(const string &name) const {
+  for (size_t k = 0; k < _columns.size(); k++) {
+    if (_columns[k] == name) {
+      return k;
+    }
+  }
+  return -1;
+}
+
+const double *TelemetryFile::column(int index) const {
+  return (const double *)(_map + TELEMETRY_HEADER_SIZE) + index * _capacity;
+}
+
+const double *TelemetryFile::column(const string &name) const {
+  int index = find(name);
+  if (index < 0) {
+    throw runtime_error("TelemetryFile: no column " + name);
+  }
+  return column(index);
+}
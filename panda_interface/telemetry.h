@@ -0,0 +1,125 @@
+/*
+Per-tick telemetry of the 1 kHz loops (--record <file>).
+The loop thread fills one row of doubles per tick and commits it into a
+preallocated lock-free ring; a background thread moves the rows into a
+memory-mapped columnar file, so the loop never touches the file.
+
+File layout (little-endian), meant to be mapped as is:
+  header, TELEMETRY_HEADER_SIZE bytes:
+    "TLM" magic, u8 version, u32 columns, u64 capacity (rows), u64 rows
+    (written so far, updated while recording), f64 start time (unix
+    seconds), then the column names, TELEMETRY_NAME_SIZE bytes each, 0
+    padded
+  data: column k is capacity f64 values at
+    TELEMETRY_HEADER_SIZE + k * capacity * 8, of which the first rows are
+    valid
+The file is created sparse at full size, so unused capacity takes no disk.
+TelemetryFile (here) and src/telemetry_reader.py read it back.
+*/
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "spsc_queue.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+const int TELEMETRY_HEADER_SIZE = 4096;
+const int TELEMETRY_NAME_SIZE = 32;
+const int TELEMETRY_MAX_COLUMNS =
+    (TELEMETRY_HEADER_SIZE - 32) / TELEMETRY_NAME_SIZE;
+const unsigned char TELEMETRY_VERSION = 1;
+// rows in flight between the loop and the writer thread
+const size_t TELEMETRY_RING_ROWS = 4096;
+// row width of the ring, the recorders here use fewer columns
+const int TELEMETRY_ROW_WIDTH = 96;
+
+class TelemetryRecorder {
+public:
+  // capacity: rows the file can hold, recording stops when it is full
+  TelemetryRecorder(const std::vector<std::string> &columns, size_t capacity);
+  ~TelemetryRecorder();
+
+  // creates and maps the file and starts the writer thread; false (after
+  // printing why) if the file cannot be created
+  bool open(const std::string &path);
+  // writes the remaining rows and closes the file
+  void close();
+
+  // loop thread: fill row() (indices as in the column list), then commit()
+  double *row() { return _row.values; }
+  void commit();
+
+  bool recording() const { return _writer.joinable(); }
+  int columns() const { return _columns.size(); }
+  // rows lost to a full ring / a full file
+  uint64_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+  uint64_t overflowed() const { return _overflowed; }
+  uint64_t written() const { return _written; }
+
+private:
+  struct Row {
+    double values[TELEMETRY_ROW_WIDTH];
+  };
+
+  void run();
+  void publishRows();
+
+  std::vector<std::string> _columns;
+  size_t _capacity;
+
+  Row _row; // loop thread scratch
+  SpscQueue<Row, TELEMETRY_RING_ROWS> *_ring;
+  std::atomic<uint64_t> _dropped;
+
+  // writer thread
+  char *_map;
+  size_t _map_size;
+  uint64_t _written;
+  uint64_t _overflowed;
+
+  std::atomic<bool> _running;
+  std::thread _writer;
+};
+
+// adds prefix0 .. prefix<n-1> (e.g. q0 .. q6) to columns
+void appendColumns(std::vector<std::string> &columns, const std::string &prefix,
+                   int n);
+
+// read side: maps a recording and gives direct pointers into its columns
+class TelemetryFile {
+public:
+  TelemetryFile();
+  ~TelemetryFile();
+
+  // throws std::runtime_error if path is not a telemetry file
+  void open(const std::string &path);
+  void close();
+
+  // rows recorded when the file was opened
+  uint64_t rows() const { return _rows; }
+  uint64_t capacity() const { return _capacity; }
+  double startTime() const { return _start_time; }
+  const std::vector<std::string> &columns() const { return _columns; }
+
+  // index into columns(), -1 if there is no such column
+  int find(const std::string &name) const;
+  // rows() values of the column
+  const double *column(int index) const;
+  // throws std::runtime_error if there is no such column
+  const double *column(const std::string &name) const;
+
+private:
+  const char *_map;
+  size_t _map_size;
+  uint64_t _rows;
+  uint64_t _capacity;
+  double _start_time;
+  std::vector<std::string> _columns;
+};
+
+#endif // TELEMETRY_H
@@ -0,0 +1,105 @@
+#include "thread_pool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool(int threads)
+    : _task(nullptr), _generation(0), _remaining(0), _stop(false) {
+  if (threads <= 0) {
+    threads = max(1u, thread::hardware_concurrency());
+  }
+  for (int i = 0; i < threads; i++) {
+    _queues.emplace_back(new Queue);
+  }
+  for (int i = 0; i < threads - 1; i++) {
+    _threads.emplace_back(&ThreadPool::workerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    lock_guard<mutex> lock(_mutex);
+    _stop = true;
+  }
+  _wake.notify_all();
+  for (auto &t : _threads) {
+    t.join();
+  }
+}
+
+void ThreadPool::parallelFor(int n, const function<void(int, int)> &task) {
+  if (n <= 0) {
+    return;
+  }
+  const int workers = size();
+  {
+    lock_guard<mutex> lock(_mutex);
+    _task = &task;
+    _remaining = n;
+    for (int w = 0; w < workers; w++) {
+      lock_guard<mutex> queue_lock(_queues[w]->mutex);
+      for (int i = (long)w * n / workers; i < (long)(w + 1) * n / workers;
+           i++) {
+        _queues[w]->tasks.push_back(i);
+      }
+    }
+    _generation++;
+  }
+  _wake.notify_all();
+
+  runTasks(workers - 1);
+
+  unique_lock<mutex> lock(_mutex);
+  _done.wait(lock, [this]() { return _remaining.load() == 0; });
+  _task = nullptr;
+}
+
+bool ThreadPool::pop(int worker, int &task) {
+  Queue &q = *_queues[worker];
+  lock_guard<mutex> lock(q.mutex);
+  if (q.tasks.empty()) {
+    return false;
+  }
+  task = q.tasks.front();
+  q.tasks.pop_front();
+  return true;
+}
+
+bool ThreadPool::steal(int worker, int &task) {
+  const int workers = size();
+  for (int k = 1; k < workers; k++) {
+    Queue &q = *_queues[(worker + k) % workers];
+    lock_guard<mutex> lock(q.mutex);
+    if (!q.tasks.empty()) {
+      task = q.tasks.back();
+      q.tasks.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::runTasks(int worker) {
+  int task;
+  while (pop(worker, task) || steal(worker, task)) {
+    (*_task)(task, worker);
+    if (_remaining.fetch_sub(1) == 1) {
+      lock_guard<mutex> lock(_mutex);
+      _done.notify_all();
+    }
+  }
+}
+
+void ThreadPool::workerLoop(int worker) {
+  unsigned long long seen = 0;
+  while (true) {
+    {
+      unique_lock<mutex> lock(_mutex);
+      _wake.wait(lock, [&]() { return _stop || _generation != seen; });
+      if (_stop) {
+        return;
+      }
+      seen = _generation;
+    }
+    runTasks(worker);
+  }
+}
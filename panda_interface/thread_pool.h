@@ -0,0 +1,57 @@
+/*
+Small work-stealing thread pool for batch jobs (shot search, rollouts).
+parallelFor(n, task) splits [0, n) into one contiguous block per worker;
+each worker runs its own block front to back and, once it is empty, steals
+from the back of the other workers' blocks. The calling thread works too.
+parallelFor calls must not overlap (one batch at a time).
+*/
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+  // threads <= 0: one per hardware thread, including the caller
+  explicit ThreadPool(int threads = 0);
+  ~ThreadPool();
+
+  // runs task(i, worker) for every i in [0, n), returns once all are done;
+  // worker is in [0, size()) and identifies the thread running the task
+  void parallelFor(int n, const std::function<void(int, int)> &task);
+
+  // number of threads working on a batch, including the caller
+  int size() const { return _queues.size(); }
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<int> tasks;
+  };
+
+  bool pop(int worker, int &task);
+  bool steal(int worker, int &task);
+  void runTasks(int worker);
+  void workerLoop(int worker);
+
+  std::vector<std::unique_ptr<Queue>> _queues; // last one is the caller's
+  std::vector<std::thread> _threads;
+
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  std::condition_variable _done;
+  const std::function<void(int, int)> *_task;
+  unsigned long long _generation;
+  std::atomic<int> _remaining;
+  bool _stop;
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,70 @@
+#include "trajectory_table.h"
+
+#include <chrono>
+#include <cmath>
+
+using namespace std;
+using namespace Eigen;
+
+TrajectoryTable::TrajectoryTable(double t_start, double t_end, double dt)
+    : _t_start(t_start), _dt(dt), _samples(lround((t_end - t_start) / dt) + 1),
+      _baked(0), _bake_time(0) {}
+
+void TrajectoryTable::reset(const PositionFunction &position,
+                            const OrientationFunction &orientation) {
+  _position = position;
+  _orientation = orientation;
+  _baked = 0;
+  _bake_time = 0;
+  // any time past the end of the table, e.g. the "going home" segment
+  _outside = evaluate(_t_start + (_samples.size() + 1) * _dt);
+}
+
+TrajectoryTable::Sample TrajectoryTable::evaluate(double t) const {
+  Sample sample;
+  sample.position = _position(t);
+  sample.orientation = Quaterniond(_orientation(t));
+  return sample;
+}
+
+bool TrajectoryTable::bakeStep(int max_samples) {
+  if (ready()) {
+    return true;
+  }
+  auto start = chrono::steady_clock::now();
+  int end = min(_baked + max_samples, (int)_samples.size());
+  for (int i = _baked; i < end; i++) {
+    // same expression as the controller's t = counter * dt
+    _samples[i] = evaluate(_t_start + i * _dt);
+    // keep neighbouring quaternions in the same hemisphere for slerp
+    if (i > 0 && _samples[i].orientation.dot(_samples[i - 1].orientation) < 0) {
+      _samples[i].orientation.coeffs() *= -1;
+    }
+  }
+  _baked = end;
+  _bake_time +=
+      chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  return ready();
+}
+
+void TrajectoryTable::lookup(double t, Vector3d &position,
+                             Matrix3d &orientation) const {
+  double s = (t - _t_start) / _dt;
+  // the last sample sits on t_end, which the trajectory treats as outside
+  if (s < 0 || s >= _samples.size() - 1) {
+    position = _outside.position;
+    orientation = _outside.orientation.toRotationMatrix();
+    return;
+  }
+  int i = (int)floor(s + 1e-9);
+  double frac = s - i;
+  const Sample &a = _samples[i];
+  if (frac < 1e-9) {
+    position = a.position;
+    orientation = a.orientation.toRotationMatrix();
+    return;
+  }
+  const Sample &b = _samples[i + 1];
+  position = a.position + frac * (b.position - a.position);
+  orientation = a.orientation.slerp(frac, b.orientation).toRotationMatrix();
+}
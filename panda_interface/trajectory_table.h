@@ -0,0 +1,62 @@
+/*
+Precomputed operational space trajectory.
+Once the shot parameters are known the whole position / orientation profile
+is sampled at the control rate into one contiguous table (orientation stored
+as quaternions). Baking is incremental (bakeStep) so it can be spread over
+the ticks the arm spends in JOINT_CONTROLLER; lookups are an index plus a
+lerp / slerp between neighbouring samples. Queries on the sample grid return
+the sample itself, i.e. exactly what the closed-form functions returned.
+*/
+
+#ifndef TRAJECTORY_TABLE_H
+#define TRAJECTORY_TABLE_H
+
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+
+#include <functional>
+#include <vector>
+
+class TrajectoryTable {
+public:
+  typedef std::function<Eigen::Vector3d(double)> PositionFunction;
+  typedef std::function<Eigen::Matrix3d(double)> OrientationFunction;
+
+  // samples t_start..t_end (inclusive) every dt, storage allocated here
+  TrajectoryTable(double t_start, double t_end, double dt = 0.001);
+
+  // discards the table and starts baking the given profile; t outside
+  // [t_start, t_end) is served from a single sample taken after t_end
+  void reset(const PositionFunction &position,
+             const OrientationFunction &orientation);
+  // bakes up to max_samples more samples, returns true once complete
+  bool bakeStep(int max_samples);
+  bool ready() const { return _baked == (int)_samples.size(); }
+
+  void lookup(double t, Eigen::Vector3d &position,
+              Eigen::Matrix3d &orientation) const;
+
+  // wall clock spent baking, seconds
+  double bakeTime() const { return _bake_time; }
+  int size() const { return _samples.size(); }
+
+private:
+  struct Sample {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    Eigen::Quaterniond orientation;
+    Eigen::Vector3d position;
+  };
+
+  Sample evaluate(double t) const;
+
+  double _t_start;
+  double _dt;
+  PositionFunction _position;
+  OrientationFunction _orientation;
+  std::vector<Sample, Eigen::aligned_allocator<Sample>> _samples;
+  Sample _outside;
+  int _baked;
+  double _bake_time;
+};
+
+#endif // TRAJECTORY_TABLE_H
@@ -0,0 +1,53 @@
+/*
+Lock-free triple buffer for handing the latest value from one producer thread
+to one consumer thread (e.g. simulation -> rendering).
+The producer always writes into its own back buffer and publishes it with a
+single atomic exchange; the consumer picks up the newest published buffer
+with another exchange. Neither side ever blocks or retries, and the two never
+touch the same buffer at the same time. Intermediate values the consumer did
+not get to are dropped.
+*/
+
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+template <typename T> class TripleBuffer {
+public:
+  TripleBuffer() : _back(0), _middle(1), _front(2) {}
+
+  // producer side: fill write(), then publish()
+  T &write() { return _buffers[_back].value; }
+  void publish() {
+    _back = _middle.exchange(_back | DIRTY, std::memory_order_acq_rel) & INDEX;
+  }
+
+  // consumer side: returns true if a newer value was published since the
+  // last call; read() is the newest value seen so far either way
+  bool update() {
+    if ((_middle.load(std::memory_order_relaxed) & DIRTY) == 0) {
+      return false;
+    }
+    _front = _middle.exchange(_front, std::memory_order_acq_rel) & INDEX;
+    return true;
+  }
+  const T &read() const { return _buffers[_front].value; }
+
+private:
+  static const uint8_t INDEX = 0x3;
+  static const uint8_t DIRTY = 0x4;
+
+  // one cache line per buffer so producer and consumer never share one
+  struct alignas(64) Slot {
+    T value;
+  };
+
+  Slot _buffers[3];
+  alignas(64) uint8_t _back;                // producer only
+  alignas(64) std::atomic<uint8_t> _middle; // shared, index | DIRTY
+  alignas(64) uint8_t _front;               // consumer only
+};
+
+#endif // TRIPLE_BUFFER_H
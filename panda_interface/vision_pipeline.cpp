@@ -0,0 +1,349 @@
+#include "vision_pipeline.h"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+VisionPipeline::VisionPipeline(const VisionConfig &config,
+                               const Listener &listener)
+    : _config(config), _listener(listener), _frames(config.buffers),
+      _free(config.buffers), _captured(config.buffers),
+      _detected(config.buffers), _history(config.window), _history_size(0),
+      _history_next(0), _running(false), _captured_count(0),
+      _dropped_count(0), _classified_count(0) {
+  for (auto &frame : _frames) {
+    frame.bgr.create(config.height, config.width, CV_8UC3);
+    frame.gray.create(config.height, config.width, CV_8UC1);
+    frame.blurred.create(config.height, config.width, CV_8UC1);
+    frame.circles.reserve(4 * VISION_MAX_COINS);
+    frame.shades.reserve(4 * VISION_MAX_COINS);
+    frame.candidates.reserve(4 * VISION_MAX_COINS);
+    frame.refined.reserve(16);
+    _free.push(&frame);
+  }
+}
+
+VisionPipeline::~VisionPipeline() { stop(); }
+
+void VisionPipeline::start() {
+  if (!_camera.open(_config.device)) {
+    throw runtime_error("VisionPipeline: cannot open camera " +
+                        to_string(_config.device));
+  }
+  _camera.set(cv::CAP_PROP_FRAME_WIDTH, _config.width);
+  _camera.set(cv::CAP_PROP_FRAME_HEIGHT, _config.height);
+  // hand out the newest frame, not one the driver queued a while ago
+  _camera.set(cv::CAP_PROP_BUFFERSIZE, 1);
+
+  _running = true;
+  _capture_thread = thread(&VisionPipeline::captureLoop, this);
+  _detect_thread = thread(&VisionPipeline::detectLoop, this);
+  _classify_thread = thread(&VisionPipeline::classifyLoop, this);
+}
+
+void VisionPipeline::stop() {
+  if (!_running) {
+    return;
+  }
+  _running = false;
+  _free.close();
+  _captured.close();
+  _detected.close();
+  _capture_thread.join();
+  _detect_thread.join();
+  _classify_thread.join();
+  _camera.release();
+}
+
+void VisionPipeline::captureLoop() {
+  uint32_t seq = 0;
+  for (int k = 0; k < _config.warmup && _running; k++) {
+    _camera.grab();
+  }
+  while (_running) {
+    Frame *frame;
+    if (!_free.tryPop(frame)) {
+      // every buffer is still being worked on: skip this frame
+      if (_camera.grab()) {
+        _dropped_count++;
+      }
+      continue;
+    }
+    // reads into the buffer's own storage as long as the size matches
+    if (!_camera.read(frame->bgr)) {
+      _free.push(frame);
+      continue;
+    }
+    frame->seq = seq++;
+    frame->stamp =
+        chrono::duration<double>(chrono::system_clock::now().time_since_epoch())
+            .count();
+    _captured_count++;
+    if (!_captured.push(frame)) {
+      break;
+    }
+  }
+}
+
+namespace {
+// isWhite / isBlack: average of the blurred image around (x, y), -1 if the
+// window is outside the image
+float shadeAt(const cv::Mat &blurred, double x, double y) {
+  int px = (int)x, py = (int)y;
+  cv::Rect window =
+      cv::Rect(px - VISION_CSD, py - VISION_CSD, 2 * VISION_CSD,
+               2 * VISION_CSD) &
+      cv::Rect(0, 0, blurred.cols, blurred.rows);
+  if (window.area() == 0) {
+    return -1;
+  }
+  return cv::mean(blurred(window))[0];
+}
+} // namespace
+
+void VisionPipeline::detectLoop() {
+  Frame *frame;
+  while (_captured.pop(frame)) {
+    auto start = chrono::steady_clock::now();
+    if (_config.roi) {
+      detectROI(*frame);
+    } else {
+      detectFull(*frame);
+    }
+    _detect_time.record(chrono::duration_cast<chrono::nanoseconds>(
+                            chrono::steady_clock::now() - start)
+                            .count());
+    if (!_detected.push(frame)) {
+      break;
+    }
+  }
+}
+
+void VisionPipeline::detectFull(Frame &frame) const {
+  cv::cvtColor(frame.bgr, frame.gray, cv::COLOR_BGR2GRAY);
+  // remove salt and pepper noise
+  cv::medianBlur(frame.gray, frame.blurred, 9);
+  cv::HoughCircles(frame.blurred, frame.circles, cv::HOUGH_GRADIENT, 1.9, 10,
+                   50, 30, VISION_MIN_RADIUS, VISION_MAX_RADIUS);
+  frame.shades.clear();
+  for (const auto &circle : frame.circles) {
+    frame.shades.push_back(shadeAt(frame.blurred, circle[0], circle[1]));
+  }
+}
+
+void VisionPipeline::prepareBoard(int cols, int rows) {
+  _board_frame_size = cv::Size(cols, rows);
+  // board center and radius in pixels, inverse of the pixel -> mm mapping
+  // in classify(), plus a coin so coins on the boundary are still whole
+  const double cx = cols / 2 + VISION_OFFSET_X;
+  const double cy = rows / 2 - VISION_OFFSET_Y;
+  const double radius =
+      VISION_BOUNDARY_RADIUS / VISION_DEPTH *
+          max(VISION_FOCUS_X, VISION_FOCUS_Y) +
+      VISION_MAX_RADIUS;
+  _board_roi = cv::Rect((int)floor(cx - radius), (int)floor(cy - radius),
+                        (int)ceil(2 * radius) + 1, (int)ceil(2 * radius) + 1) &
+               cv::Rect(0, 0, cols, rows);
+
+  const double s = _config.coarse_scale;
+  cv::Size coarse_size((int)round(_board_roi.width * s),
+                       (int)round(_board_roi.height * s));
+  _coarse_outside = cv::Mat(coarse_size, CV_8UC1, cv::Scalar(255));
+  cv::circle(_coarse_outside,
+             cv::Point((int)round((cx - _board_roi.x) * s),
+                       (int)round((cy - _board_roi.y) * s)),
+             (int)round(radius * s), cv::Scalar(0), cv::FILLED);
+}
+
+void VisionPipeline::detectROI(Frame &frame) {
+  if (cv::Size(frame.bgr.cols, frame.bgr.rows) != _board_frame_size) {
+    prepareBoard(frame.bgr.cols, frame.bgr.rows);
+  }
+  const double s = _config.coarse_scale;
+  frame.circles.clear();
+  frame.shades.clear();
+
+  // coarse pass: board region only, downscaled, outside of the board blanked
+  cv::cvtColor(frame.bgr(_board_roi), frame.gray, cv::COLOR_BGR2GRAY);
+  cv::resize(frame.gray, frame.coarse, _coarse_outside.size(), 0, 0,
+             cv::INTER_AREA);
+  cv::medianBlur(frame.coarse, frame.coarse_blurred, 5);
+  frame.coarse_blurred.setTo(cv::Scalar(0), _coarse_outside);
+  // fewer edge pixels per circle at the lower resolution, so fewer votes
+  cv::HoughCircles(frame.coarse_blurred, frame.candidates, cv::HOUGH_GRADIENT,
+                   1.9, 10 * s, 50, 30 * s, (int)floor(VISION_MIN_RADIUS * s),
+                   (int)ceil(VISION_MAX_RADIUS * s));
+
+  // refine each candidate at full resolution, in a window that holds the
+  // coin, the coarse position error and the blur kernel (shifted rather
+  // than clipped at the region's edge, so the patch buffer keeps its size)
+  const int half = VISION_MAX_RADIUS + (int)ceil(2 / s) + 4;
+  const int side = min(2 * half, min(_board_roi.width, _board_roi.height));
+  for (const auto &candidate : frame.candidates) {
+    double gx = candidate[0] / s, gy = candidate[1] / s;
+    cv::Rect window(
+        max(0, min(_board_roi.width - side, (int)gx - half)),
+        max(0, min(_board_roi.height - side, (int)gy - half)), side, side);
+    cv::medianBlur(frame.gray(window), frame.patch_blurred, 9);
+    cv::HoughCircles(frame.patch_blurred, frame.refined, cv::HOUGH_GRADIENT,
+                     1.9, 2 * half, 50, 30, VISION_MIN_RADIUS,
+                     VISION_MAX_RADIUS);
+    // keep the coarse estimate if the small window did not collect enough
+    // votes
+    double x = gx - window.x, y = gy - window.y, r = candidate[2] / s;
+    if (!frame.refined.empty()) {
+      x = frame.refined[0][0];
+      y = frame.refined[0][1];
+      r = frame.refined[0][2];
+    }
+    float shade = shadeAt(frame.patch_blurred, x, y);
+
+    // back to full frame pixels; neighbouring candidates can refine to the
+    // same coin
+    x += window.x + _board_roi.x;
+    y += window.y + _board_roi.y;
+    bool duplicate = false;
+    for (const auto &circle : frame.circles) {
+      duplicate |= hypot(circle[0] - x, circle[1] - y) < 10;
+    }
+    if (!duplicate) {
+      frame.circles.push_back(cv::Vec3f((float)x, (float)y, (float)r));
+      frame.shades.push_back(shade);
+    }
+  }
+}
+
+void VisionPipeline::classifyLoop() {
+  CoinList coins, result;
+  Frame *frame;
+  while (_detected.pop(frame)) {
+    classify(*frame, coins);
+    _free.push(frame);
+    vote(coins, result);
+    _classified_count++;
+    if (_listener) {
+      _listener(result);
+    }
+  }
+}
+
+void VisionPipeline::classify(const Frame &frame, CoinList &coins) const {
+  const double c = cos(VISION_THETA), s = sin(VISION_THETA);
+  coins.seq = frame.seq;
+  coins.stamp = frame.stamp;
+  coins.voted = 1;
+  coins.count = 0;
+  for (size_t k = 0; k < frame.circles.size(); k++) {
+    if (coins.count == VISION_MAX_COINS) {
+      break;
+    }
+    const cv::Vec3f &circle = frame.circles[k];
+    const float shade = frame.shades[k];
+    if (shade < 0) {
+      continue;
+    }
+    bool white = shade >= VISION_WHITE_THRESHOLD;
+    if (!white && shade > VISION_BLACK_THRESHOLD) {
+      continue;
+    }
+
+    // pixel -> camera -> board frame
+    double pixel_x = circle[0] - frame.bgr.cols / 2 - VISION_OFFSET_X;
+    double pixel_y = -(circle[1] - frame.bgr.rows / 2) - VISION_OFFSET_Y;
+    double x = pixel_x / VISION_FOCUS_X * VISION_DEPTH;
+    double y = pixel_y / VISION_FOCUS_Y * VISION_DEPTH;
+    double bx = c * x - s * y;
+    double by = s * x + c * y;
+
+    uint8_t identity;
+    double r = hypot(bx, by);
+    if (white &&
+        hypot(bx - VISION_CUE_X, by - VISION_CUE_Y) < VISION_CUE_EPSILON) {
+      identity = 3;
+    } else if (r < VISION_BOUNDARY_RADIUS && r > 8) {
+      identity = white ? 1 : 2;
+    } else {
+      continue;
+    }
+    coins.coins[coins.count++] = {(float)bx, (float)by, identity};
+  }
+}
+
+void VisionPipeline::vote(const CoinList &coins, CoinList &result) {
+  const int window = _history.size();
+  _history[_history_next] = coins;
+  _history_next = (_history_next + 1) % window;
+  _history_size = min(_history_size + 1, window);
+
+  // most common count, the smaller one on ties (np.argmax of np.bincount)
+  int histogram[VISION_MAX_COINS + 1] = {0};
+  for (int k = 0; k < _history_size; k++) {
+    histogram[_history[k].count]++;
+  }
+  int mode = 0;
+  for (int n = 1; n <= VISION_MAX_COINS; n++) {
+    if (histogram[n] > histogram[mode]) {
+      mode = n;
+    }
+  }
+  // newest list with that count
+  for (int k = 1; k <= _history_size; k++) {
+    const CoinList &candidate = _history[(_history_next - k + window) % window];
+    if (candidate.count == mode) {
+      result = candidate;
+      break;
+    }
+  }
+  result.voted = _history_size;
+}
+
+namespace {
+void putU16(char *p, uint16_t v) {
+  p[0] = (char)(v & 0xff);
+  p[1] = (char)(v >> 8);
+}
+
+void putU32(char *p, uint32_t v) {
+  for (int b = 0; b < 4; b++) {
+    p[b] = (char)(v >> (8 * b));
+  }
+}
+
+void putF32(char *p, float v) {
+  uint32_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  putU32(p, bits);
+}
+
+void putF64(char *p, double v) {
+  uint64_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  for (int b = 0; b < 8; b++) {
+    p[b] = (char)(bits >> (8 * b));
+  }
+}
+} // namespace
+
+void encodeCoinMessage(const CoinList &coins, string &out) {
+  out.resize(COIN_MESSAGE_HEADER_SIZE + coins.count * COIN_MESSAGE_COIN_SIZE);
+  char *p = &out[0];
+  p[0] = 'C';
+  p[1] = 'N';
+  p[2] = 'S';
+  p[3] = (char)COIN_MESSAGE_VERSION;
+  putU32(p + 4, coins.seq);
+  putF64(p + 8, coins.stamp);
+  putU16(p + 16, coins.voted);
+  putU16(p + 18, coins.count);
+  p += COIN_MESSAGE_HEADER_SIZE;
+  for (int i = 0; i < coins.count; i++, p += COIN_MESSAGE_COIN_SIZE) {
+    putF32(p, coins.coins[i].x);
+    putF32(p + 4, coins.coins[i].y);
+    p[8] = (char)coins.coins[i].identity;
+  }
+}
@@ -0,0 +1,173 @@
+/*
+Streaming coin detection: C++ version of updateBoardCoins in
+src/coins_updater.py that runs continuously instead of once per turn.
+Three stages on their own threads, connected by bounded queues:
+  capture   camera frame into a free buffer (frames are dropped, not queued,
+            while every buffer is busy, so detection never lags the camera)
+  detect    grayscale, median blur and HoughCircles, and the average shade
+            of each circle for the white / black test
+  classify  white / black test, pixel -> board mm, cue and board boundary
+            filters, then a vote over the last few frames: the newest list
+            with the most common coin count wins
+The frame buffers are allocated up front and cycle through the stages, so
+the steady state does not allocate. Every voted list is handed to a
+callback (coin_vision publishes it to redis with encodeCoinMessage).
+
+With VisionConfig::roi the detect stage only looks at the board: a coarse
+HoughCircles pass over the masked board region at reduced resolution finds
+candidates, and each one is refined at full resolution in a small window
+around it. Detection time per frame is recorded either way.
+*/
+
+#ifndef VISION_PIPELINE_H
+#define VISION_PIPELINE_H
+
+#include "bounded_queue.h"
+#include "loop_profiler.h"
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// calibration, same values as src/coins_updater.py / calibrate_camera.py
+const double VISION_FOCUS_X = 986.1724;
+const double VISION_FOCUS_Y = 994.4793;
+const double VISION_OFFSET_X = -62.5; // pixel center offset
+const double VISION_OFFSET_Y = -8;
+const double VISION_DEPTH = 1220 * 254 / std::sqrt(251.4 * 251.4 + 2.4 * 2.4);
+const double VISION_THETA = -0.001;
+const double VISION_WHITE_THRESHOLD = 165;
+const double VISION_BLACK_THRESHOLD = 165;
+const int VISION_CSD = 8; // color search distance, pixels
+const double VISION_CUE_X = -140;
+const double VISION_CUE_Y = -183;
+const double VISION_CUE_EPSILON = 50;
+const double VISION_BOUNDARY_RADIUS = 255;
+// HoughCircles radius range, pixels at full resolution
+const int VISION_MIN_RADIUS = 8;
+const int VISION_MAX_RADIUS = 12;
+
+// more than the 24 coins of a game plus the cue
+const int VISION_MAX_COINS = 32;
+
+struct VisionCoin {
+  float x, y;       // board frame, mm
+  uint8_t identity; // as in src/coin.py: 1 robot, 2 human, 3 cue
+};
+
+struct CoinList {
+  uint32_t seq;        // camera frame the list was detected in
+  double stamp;        // capture time, unix seconds
+  int voted;           // frames in the vote
+  int count;
+  VisionCoin coins[VISION_MAX_COINS];
+};
+
+struct VisionConfig {
+  int device = -1; // cv::VideoCapture index, -1 for any camera
+  int width = 640;
+  int height = 480;
+  int buffers = 4; // frames in flight between the stages
+  int window = 20; // frames voted over
+  int warmup = 21; // frames skipped after opening the camera (exposure)
+  bool roi = false;          // board-only coarse to fine detection
+  double coarse_scale = 0.5; // resolution of the coarse pass
+};
+
+class VisionPipeline {
+public:
+  typedef std::function<void(const CoinList &)> Listener;
+
+  // listener is called on the classify thread with every voted list
+  VisionPipeline(const VisionConfig &config, const Listener &listener);
+  ~VisionPipeline();
+
+  // opens the camera and starts the stages, throws std::runtime_error if the
+  // camera cannot be opened
+  void start();
+  // stops and joins the stages
+  void stop();
+
+  // frames taken from the camera / dropped because no buffer was free /
+  // classified
+  unsigned captured() const { return _captured_count; }
+  unsigned dropped() const { return _dropped_count; }
+  unsigned classified() const { return _classified_count; }
+  // time spent in the detect stage per frame
+  const LatencyHistogram &detectTime() const { return _detect_time; }
+
+private:
+  struct Frame {
+    cv::Mat bgr;
+    cv::Mat gray;
+    cv::Mat blurred;
+    std::vector<cv::Vec3f> circles; // full frame pixels
+    std::vector<float> shades;      // per circle, -1 if not measurable
+    uint32_t seq;
+    double stamp;
+    // roi mode scratch
+    cv::Mat coarse;
+    cv::Mat coarse_blurred;
+    cv::Mat patch_blurred;
+    std::vector<cv::Vec3f> candidates;
+    std::vector<cv::Vec3f> refined;
+  };
+
+  void captureLoop();
+  void detectLoop();
+  void classifyLoop();
+  void detectFull(Frame &frame) const;
+  void detectROI(Frame &frame);
+  // board region and mask for frames of this size (detect thread)
+  void prepareBoard(int cols, int rows);
+  // coins of one frame, unvoted
+  void classify(const Frame &frame, CoinList &coins) const;
+  // adds coins to the vote window and fills the winner into result
+  void vote(const CoinList &coins, CoinList &result);
+
+  VisionConfig _config;
+  Listener _listener;
+  cv::VideoCapture _camera;
+
+  std::vector<Frame> _frames;
+  BoundedQueue<Frame *> _free;
+  BoundedQueue<Frame *> _captured;
+  BoundedQueue<Frame *> _detected;
+
+  // detect thread only: board bounding box in the frame, and the pixels of
+  // the coarse image outside the board
+  cv::Size _board_frame_size;
+  cv::Rect _board_roi;
+  cv::Mat _coarse_outside;
+  LatencyHistogram _detect_time;
+
+  // classify thread only
+  std::vector<CoinList> _history; // ring of the last window lists
+  int _history_size;
+  int _history_next;
+
+  std::atomic<bool> _running;
+  std::atomic<unsigned> _captured_count;
+  std::atomic<unsigned> _dropped_count;
+  std::atomic<unsigned> _classified_count;
+  std::thread _capture_thread;
+  std::thread _detect_thread;
+  std::thread _classify_thread;
+};
+
+// redis payload for a coin list, written into out (capacity reused):
+// "CNS" magic, u8 version, u32 seq, f64 stamp, u16 voted, u16 count, then
+// count times (f32 x, f32 y, u8 identity), all little-endian
+const int COIN_MESSAGE_HEADER_SIZE = 20;
+const int COIN_MESSAGE_COIN_SIZE = 9;
+const unsigned char COIN_MESSAGE_VERSION = 1;
+void encodeCoinMessage(const CoinList &coins, std::string &out);
+
+#endif // VISION_PIPELINE_H
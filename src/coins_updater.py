@@ -9,6 +9,7 @@ from calibrate_camera import isBlack, isWhite
 from coin import *
 import numpy as np
 import cv2
+import struct
 import time
 
 # focal lengths
@@ -37,6 +38,16 @@ BOUNDARY_RADIUS = 255
 
 #----------------------------------#
 
+# board state published continuously by panda_interface/coin_vision
+BOARD_COINS_KEY = "boardcoins"
+COIN_MESSAGE_VERSION = 1
+COIN_MESSAGE_HEADER = struct.Struct('<3sBIdHH')  # magic, version, seq, stamp, voted, count
+COIN_MESSAGE_COIN = struct.Struct('<ffB')        # x, y (mm), identity
+# a list older than this (s) means coin_vision is not running
+BOARD_COINS_MAX_AGE = 1.0
+
+#----------------------------------#
+
 def isCue(X, Y):
     epsilion = 50  # error in mm
     if(np.sqrt((X-CUE_POSITION_X)**2 + (Y-CUE_POSITION_Y)**2)) < epsilion:
@@ -129,6 +140,26 @@ def updateBoardCoins():
     return list_of_coins[idx_max_freq]
 
 
+def readBoardCoins(server, max_age=BOARD_COINS_MAX_AGE, min_stamp=0):
+    """ returns the coin list panda_interface/coin_vision last published, or None if
+    there is none, it is older than max_age seconds or it was captured before
+    min_stamp (time.time()) (server: redis.Redis without decode_responses) """
+    message = server.get(BOARD_COINS_KEY)
+    if message is None or len(message) < COIN_MESSAGE_HEADER.size:
+        return None
+    magic, version, seq, stamp, voted, count = COIN_MESSAGE_HEADER.unpack_from(message)
+    if magic != b'CNS' or version != COIN_MESSAGE_VERSION:
+        return None
+    if time.time() - stamp > max_age or stamp < min_stamp:
+        return None
+    coins = []
+    for k in range(count):
+        x, y, identity = COIN_MESSAGE_COIN.unpack_from(
+            message, COIN_MESSAGE_HEADER.size + k*COIN_MESSAGE_COIN.size)
+        coins.append(Coin(x, y, identity))
+    return coins
+
+
 #--------------TEST HARNESS------------#
 if __name__ == "__main__":
     coins = updateBoardCoins()
@@ -11,6 +11,8 @@ from coin import *
 import numpy as np
 import matplotlib.pyplot as plt
 import copy
+import ctypes
+import os
 from random import randint
 
 
@@ -257,6 +259,136 @@ def plan_shot(coins):
 
     return path
 
+'''
+    C++ shot planner (panda_interface/shot_planner.cpp, built as libshot_planner)
+    searches the same candidate grid as plan_shot in parallel without plotting,
+    scores the viable shots and returns the best one found within a deadline.
+    Results are cached between calls; only pairs disturbed by coins that moved
+    since the last board are searched again. With rollout_candidates the best
+    shots are also rolled out with coin physics (panda_interface/coin_rollout.h)
+    and ranked by the robot minus human points they are expected to leave.
+    plan_shot_fast falls back to plan_shot if the library is not built.
+'''
+SHOT_PLANNER_LIB = os.environ.get('SHOT_PLANNER_LIB', os.path.join(
+    os.path.dirname(os.path.abspath(__file__)), '..', 'bin', 'panda_interface', 'libshot_planner.so'))
+
+# planning time budget while the arm waits in WAIT_MODE
+PLANNING_DEADLINE_MS = 500
+# shots (best by score) rolled out to rank by expected points, 0 for none
+ROLLOUT_CANDIDATES = 64
+
+_planner_lib = None
+
+def load_shot_planner():
+    global _planner_lib
+    if _planner_lib is None:
+        try:
+            lib = ctypes.CDLL(SHOT_PLANNER_LIB)
+        except OSError:
+            print "could not load", SHOT_PLANNER_LIB
+            return None
+        c_double_p = ctypes.POINTER(ctypes.c_double)
+        lib.shot_planner_plan.argtypes = [c_double_p, c_double_p, ctypes.POINTER(ctypes.c_int), ctypes.c_int,
+                                          c_double_p, ctypes.c_int, c_double_p, ctypes.POINTER(ctypes.c_int)]
+        lib.shot_planner_plan.restype = ctypes.c_int
+        lib.shot_planner_plan_best.argtypes = [c_double_p, c_double_p, ctypes.POINTER(ctypes.c_int), ctypes.c_int,
+                                               ctypes.c_int, ctypes.c_double, c_double_p, c_double_p,
+                                               ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_int)]
+        lib.shot_planner_plan_best.restype = ctypes.c_int
+        lib.shot_planner_plan_expected.argtypes = [c_double_p, c_double_p, ctypes.POINTER(ctypes.c_int), ctypes.c_int,
+                                                   ctypes.c_int, ctypes.c_double, ctypes.c_int, c_double_p, c_double_p,
+                                                   ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_int), c_double_p]
+        lib.shot_planner_plan_expected.restype = ctypes.c_int
+        lib.shot_planner_cache_stats.argtypes = [ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_int)]
+        lib.shot_planner_cache_stats.restype = None
+        lib.shot_planner_clear_cache.argtypes = []
+        lib.shot_planner_clear_cache.restype = None
+        _planner_lib = lib
+    return _planner_lib
+
+'''
+    returns the top_k best scoring (start_pos, angle, score) shots found within deadline_ms,
+    the failsafe shot (or None) and whether the search covered the whole grid
+'''
+def find_best_paths_fast(lib, coins, top_k=5, deadline_ms=PLANNING_DEADLINE_MS):
+    n = len(coins)
+    x = (ctypes.c_double * n)(*[coin.origin[0] for coin in coins])
+    y = (ctypes.c_double * n)(*[coin.origin[1] for coin in coins])
+    identity = (ctypes.c_int * n)(*[coin.identity for coin in coins])
+    best = (ctypes.c_double * (4*top_k))()
+    failsafe = (ctypes.c_double * 3)()
+    has_failsafe = ctypes.c_int(0)
+    complete = ctypes.c_int(0)
+
+    count = lib.shot_planner_plan_best(x, y, identity, n, top_k, deadline_ms, best, failsafe,
+                                       ctypes.byref(has_failsafe), ctypes.byref(complete))
+    best_paths = [(np.array([best[4*i], best[4*i+1]]), best[4*i+2], best[4*i+3]) for i in range(count)]
+    failsafe_path = None
+    if has_failsafe.value:
+        failsafe_path = (np.array([failsafe[0], failsafe[1]]), failsafe[2])
+    return best_paths, failsafe_path, bool(complete.value)
+
+'''
+    as find_best_paths_fast, with the rollout_candidates best scoring shots rolled out and the
+    top_k (start_pos, angle, score, expected_points) by expected points returned, and the
+    points of the board as it is
+'''
+def find_expected_paths_fast(lib, coins, top_k=5, deadline_ms=PLANNING_DEADLINE_MS,
+                             rollout_candidates=ROLLOUT_CANDIDATES):
+    n = len(coins)
+    x = (ctypes.c_double * n)(*[coin.origin[0] for coin in coins])
+    y = (ctypes.c_double * n)(*[coin.origin[1] for coin in coins])
+    identity = (ctypes.c_int * n)(*[coin.identity for coin in coins])
+    best = (ctypes.c_double * (5*top_k))()
+    failsafe = (ctypes.c_double * 3)()
+    has_failsafe = ctypes.c_int(0)
+    complete = ctypes.c_int(0)
+    board_points = ctypes.c_double(0)
+
+    count = lib.shot_planner_plan_expected(x, y, identity, n, top_k, deadline_ms, rollout_candidates, best,
+                                           failsafe, ctypes.byref(has_failsafe), ctypes.byref(complete),
+                                           ctypes.byref(board_points))
+    best_paths = [(np.array([best[5*i], best[5*i+1]]), best[5*i+2], best[5*i+3], best[5*i+4]) for i in range(count)]
+    failsafe_path = None
+    if has_failsafe.value:
+        failsafe_path = (np.array([failsafe[0], failsafe[1]]), failsafe[2])
+    return best_paths, failsafe_path, bool(complete.value), board_points.value
+
+def plan_shot_fast(coins, deadline_ms=PLANNING_DEADLINE_MS, rollout_candidates=ROLLOUT_CANDIDATES):
+    lib = load_shot_planner()
+    if lib is None:
+        return plan_shot(coins)
+
+    default_path = (np.array([0, -STARTING_ARC_R]), np.pi/2)
+    if not [coin for coin in coins if coin.identity == 2]:
+        print "no opponent coin; aiming for center"
+        return default_path
+
+    if rollout_candidates > 0:
+        best_paths, failsafe_path, complete, board_points = find_expected_paths_fast(
+            lib, coins, deadline_ms=deadline_ms, rollout_candidates=rollout_candidates)
+    else:
+        best_paths, failsafe_path, complete = find_best_paths_fast(lib, coins, deadline_ms=deadline_ms)
+    if not complete:
+        print "planning deadline of", deadline_ms, "ms hit, using the best shot so far"
+    reused = ctypes.c_int(0)
+    searched = ctypes.c_int(0)
+    lib.shot_planner_cache_stats(ctypes.byref(reused), ctypes.byref(searched))
+    print "shot pairs reused from the last board:", reused.value, "searched:", searched.value
+
+    if not best_paths:
+        if failsafe_path is None:
+            print "no failsafe path, aiming for center"
+            return default_path
+        print "sending failsafe path"
+        return failsafe_path
+    if rollout_candidates > 0:
+        print "sending best viable path by expected points,", best_paths[0][3], "(board now", board_points, \
+            "), score", best_paths[0][2]
+    else:
+        print "sending best viable path, score", best_paths[0][2]
+    return (best_paths[0][0], best_paths[0][1])
+
 
 if __name__ == "__main__":
     coins = [Coin(80, 0, 2), Coin(0, -80, 1), Coin(75, -55, 1), Coin(-100, -100, 2)]
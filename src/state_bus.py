@@ -0,0 +1,73 @@
+'''
+    state_bus.py
+
+    reads the robot state snapshots controller_panda --bus publishes every tick
+    (layout in panda_interface/state_bus.h), from shared memory and without redis,
+    as often as the caller likes.
+
+    bus = StateBus()
+    state = bus.read()      None until the controller has published
+    state.q, state.x, state.rotation, state.mode, state.state, state.tick
+'''
+
+import collections
+import mmap
+import struct
+import sys
+import time
+
+STATE_BUS_PATH = "/dev/shm/crokinole_state_bus"
+STATE_BUS_MAGIC = 0x53425553
+STATE_BUS_VERSION = 1
+STATE_BUS_HEADER = struct.Struct('<II')  # magic, version
+STATE_BUS_SEQ_OFFSET = 64
+STATE_BUS_SNAPSHOT_OFFSET = 72
+MAX_DOF = 7
+# tick, timestamp, dof, mode, state, reserved, q, dq, tau, x, xdot, rotation (row-major)
+STATE_BUS_SNAPSHOT = struct.Struct('<Qdiiii%dd' % (3*MAX_DOF + 3 + 3 + 9))
+
+StateSnapshot = collections.namedtuple(
+    'StateSnapshot', 'tick timestamp mode state q dq tau x xdot rotation')
+
+
+class StateBus(object):
+    def __init__(self, path=STATE_BUS_PATH):
+        with open(path, 'rb') as f:
+            self.map = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        magic, version = STATE_BUS_HEADER.unpack_from(self.map, 0)
+        if magic != STATE_BUS_MAGIC or version != STATE_BUS_VERSION:
+            raise ValueError(path + " is not a state bus")
+
+    def version(self):
+        """ snapshots published so far """
+        return struct.unpack_from('<I', self.map, STATE_BUS_SEQ_OFFSET)[0] // 2
+
+    def read(self):
+        """ the latest snapshot, None if none was published """
+        while True:
+            seq0 = struct.unpack_from('<I', self.map, STATE_BUS_SEQ_OFFSET)[0]
+            values = STATE_BUS_SNAPSHOT.unpack_from(self.map, STATE_BUS_SNAPSHOT_OFFSET)
+            seq1 = struct.unpack_from('<I', self.map, STATE_BUS_SEQ_OFFSET)[0]
+            if seq0 == seq1 and not seq0 & 1:
+                break
+        if seq0 == 0:
+            return None
+        tick, timestamp, dof, mode, state = values[:5]
+        rest = values[6:]
+        q, dq, tau = rest[0:dof], rest[MAX_DOF:MAX_DOF + dof], rest[2*MAX_DOF:2*MAX_DOF + dof]
+        x, xdot = rest[3*MAX_DOF:3*MAX_DOF + 3], rest[3*MAX_DOF + 3:3*MAX_DOF + 6]
+        rotation = rest[3*MAX_DOF + 6:]
+        return StateSnapshot(tick, timestamp, mode, state, q, dq, tau, x, xdot,
+                             [rotation[0:3], rotation[3:6], rotation[6:9]])
+
+
+#--------------TEST HARNESS------------#
+if __name__ == "__main__":
+    bus = StateBus(sys.argv[1] if len(sys.argv) > 1 else STATE_BUS_PATH)
+    while True:
+        state = bus.read()
+        if state is not None:
+            print("tick %d mode %d state %d x %s" % (state.tick, state.mode, state.state,
+                                                    " ".join("%.4f" % v for v in state.x)))
+        time.sleep(0.2)
+#---------------------------------------#
@@ -4,11 +4,22 @@ State Machine (Master Code) for Crokinole
 Author: Varun Nayak
 
 TODO: Combine the whole trajectory into one, so that we need only two states.
+
+  python state_machine.py [--pipeline]
+With --pipeline the turns overlap: the controller publishes "shot_done" once
+the swing is over, and while the arm goes home the coins are left to settle,
+the board is read and the next shot is planned and sent. The controller
+queues it and goes straight into fetching the next cue coin, which has to be
+in the home position by then. Without it every turn waits for the arm to be
+back and for the operator.
 '''
 
 #----IMPORT DEPENDENCIES HERE----#
 import redis
 import ast
+import math
+import struct
+import sys
 import time
 
 from coins_updater import *
@@ -16,9 +27,24 @@ from coin import *
 from shot_planner import *
 from enum import Enum
 
-MODE_CHANGE_KEY = "modechange"
-SHOT_ANGLE_KEY = "shotangle"
-SHOT_POS_KEY = "shotpos"
+MODE_CHANGE_KEY = "modechange"  # also the channel mode changes are published on
+# binary shot message, decoded by panda_interface/mode_channel.cpp
+SHOT_KEY = "shot"
+SHOT_MESSAGE_VERSION = 1
+SHOT_MESSAGE = struct.Struct('<3sBIddddd')  # magic, version, seq, x, y (mm), psi, hit velocity (m/s), swing angle (rad)
+# 0 leaves the hit velocity / swing angle to the controller's defaults
+HIT_VELOCITY = 0
+SWING_ANGLE = 0
+shot_seq = 0
+
+PIPELINE = '--pipeline' in sys.argv
+# the coins have settled once coin_vision shows them within SETTLE_DISTANCE (mm)
+# of where they were for SETTLE_TIME (s), or SETTLE_TIMEOUT (s) after the shot;
+# without coin_vision SETTLE_TIMEOUT is waited out before a capture
+SETTLE_DISTANCE = 2.0
+SETTLE_TIME = 0.5
+SETTLE_TIMEOUT = 3.0
+SETTLE_POLL = 0.05
 
 # states
 class State(Enum):
@@ -27,34 +53,104 @@ class State(Enum):
 
 #-----ADD REDIS KEYS HERE------#
 myserver = redis.Redis(decode_responses=True)
+# binary values (coin_vision board state, shot message)
+vision_server = redis.Redis()
+# mode changes published by the controller
+mode_events = myserver.pubsub(ignore_subscribe_messages=True)
 
 #-----STATE TRANSITION FUNCTIONS------#
 
 # Transition from WAIT4KEY to EXECUTING
 def transition1():
-    # get the board state (coins and identities)
-    coins = updateBoardCoins()
+    # get the board state (coins and identities), from coin_vision if it is
+    # running, otherwise from a fresh capture
+    coins = readBoardCoins(vision_server)
+    if coins is None:
+        coins = updateBoardCoins()
+    sendShot(coins)
+
+# true if every coin of coins is within SETTLE_DISTANCE of one of previous
+def boardSettled(previous, coins):
+    if previous is None or len(previous) != len(coins):
+        return False
+    for coin in coins:
+        if not any(other.identity == coin.identity and
+                   math.hypot(*(other.origin - coin.origin)) <= SETTLE_DISTANCE
+                   for other in previous):
+            return False
+    return True
+
+# board state once the coins have settled after a shot that finished at
+# shot_done (time.time())
+def readSettledBoard(shot_done):
+    previous = None
+    still_since = None
+    while time.time() - shot_done < SETTLE_TIMEOUT:
+        coins = readBoardCoins(vision_server, min_stamp=shot_done)
+        if coins is None:
+            if readBoardCoins(vision_server) is None:
+                break  # no coin_vision
+        elif boardSettled(previous, coins):
+            if time.time() - still_since >= SETTLE_TIME:
+                return coins
+        else:
+            previous = coins
+            still_since = time.time()
+        time.sleep(SETTLE_POLL)
+    coins = readBoardCoins(vision_server, min_stamp=shot_done)
+    if coins is None:
+        time.sleep(max(0.0, SETTLE_TIMEOUT - (time.time() - shot_done)))
+        coins = updateBoardCoins()
+    return coins
+
+def sendShot(coins):
     for coin in coins:
         print(coin.origin[0], coin.origin[1], coin.identity)
     # plan the shot and get the shot parameters
-    shot = plan_shot(coins)
-    # #pass the shot parameters over redis
-    x_pos = str(shot[0][0])
-    y_pos = str(shot[0][1])
-    myserver.set(SHOT_POS_KEY, x_pos + "," + y_pos)
-    myserver.set(SHOT_ANGLE_KEY, str(shot[1]))
+    shot = plan_shot_fast(coins)
+    # pass the shot parameters over redis, all in one message
+    global shot_seq
+    shot_seq += 1
+    vision_server.set(SHOT_KEY, SHOT_MESSAGE.pack(b'SHT', SHOT_MESSAGE_VERSION, shot_seq,
+                                                  shot[0][0], shot[0][1], shot[1],
+                                                  HIT_VELOCITY, SWING_ANGLE))
     # pass key over redis to make controller change state from waiting to executing
+    # (the controller listens on the channel and reads the shot message set above)
     myserver.set(MODE_CHANGE_KEY, "execute")
+    myserver.publish(MODE_CHANGE_KEY, "execute")
     pass
 
 # Transition from EXECUTING TO WAIT4KEY
 def transition2():
     pass
 
+# the turns of --pipeline: the first one as usual, then each next one is
+# planned and sent once the swing of the last one is done
+def runPipelined():
+    while raw_input(
+            "Place the cue coin in the home position and enter 'y' to start: ").lower() != 'y':
+        print("Okay, will ask once again...")
+    transition1()
+    while (True):
+        message = mode_events.get_message(timeout=1.0)
+        if(message is None):
+            continue
+        if(message['data'] == "shot_done"):
+            coins = readSettledBoard(time.time())
+            sendShot(coins)
+            print("Next shot sent, place the next cue coin in the home position")
+        elif(message['data'] == "wait"):
+            # the next shot came after the arm was home, it starts from WAIT_MODE
+            print("Controller back in WAIT_MODE")
+
 def main():
     # initialize the state
     state = State.WAIT4KEY
     myserver.set(MODE_CHANGE_KEY, "wait")
+    # subscribe before the first shot so the controller's "wait" is not missed
+    mode_events.subscribe(MODE_CHANGE_KEY)
+    if PIPELINE:
+        runPipelined()
 	# run state machine
     while (True):
         if(state == State.WAIT4KEY):
@@ -67,8 +163,9 @@ def main():
             else:
                 print("Okay, will ask once again...")
         elif(state == State.EXECUTING):
-            redis_input = myserver.get(MODE_CHANGE_KEY)
-            if(redis_input == "wait"):
+            # blocks until the controller publishes a mode change (or 1 s passes)
+            message = mode_events.get_message(timeout=1.0)
+            if(message is not None and message['data'] == "wait"):
                 transition2()  # transitions actions
                 state = State.WAIT4KEY
                 print("Going back to WAIT4KEY...")
@@ -0,0 +1,69 @@
+'''
+    telemetry_reader.py
+
+    reads the telemetry recorded by controller_panda / simviz_panda --record <file>
+    (layout in panda_interface/telemetry.h). the file is memory mapped and every
+    column is a numpy view into it, so opening a recording copies nothing.
+
+    rec = Telemetry("shot.tlm")
+    rec["time"], rec["x_desired0"]      one column, shape (rows,)
+    rec.group("q")                      q0 .. q6 side by side, shape (rows, 7)
+'''
+
+import numpy as np
+import struct
+import sys
+
+TELEMETRY_HEADER_SIZE = 4096
+TELEMETRY_NAME_SIZE = 32
+TELEMETRY_VERSION = 1
+TELEMETRY_HEADER = struct.Struct('<3sBIQQd')  # magic, version, columns, capacity, rows, start time
+
+
+class Telemetry(object):
+    def __init__(self, path):
+        with open(path, 'rb') as f:
+            header = f.read(TELEMETRY_HEADER_SIZE)
+        if len(header) < TELEMETRY_HEADER_SIZE:
+            raise ValueError(path + " is not a telemetry file")
+        magic, version, columns, capacity, rows, start_time = TELEMETRY_HEADER.unpack_from(header)
+        if magic != b'TLM' or version != TELEMETRY_VERSION or rows > capacity:
+            raise ValueError(path + " is not a telemetry file")
+        self.rows = rows
+        self.start_time = start_time
+        self.names = []
+        for k in range(columns):
+            name = header[TELEMETRY_HEADER.size + k*TELEMETRY_NAME_SIZE:
+                          TELEMETRY_HEADER.size + (k + 1)*TELEMETRY_NAME_SIZE]
+            self.names.append(name.split(b'\0')[0].decode('ascii'))
+        self.index = dict((name, k) for k, name in enumerate(self.names))
+        # one row per column, each capacity long; only the first rows are valid
+        self.data = np.memmap(path, dtype='<f8', mode='r', offset=TELEMETRY_HEADER_SIZE,
+                              shape=(columns, capacity))[:, :rows]
+
+    def __getitem__(self, name):
+        return self.data[self.index[name]]
+
+    def __contains__(self, name):
+        return name in self.index
+
+    def group(self, prefix):
+        """ columns prefix0, prefix1, .. as a (rows, n) view """
+        first = self.index[prefix + "0"]
+        n = 0
+        while prefix + str(n) in self.index:
+            n += 1
+        return self.data[first:first + n].T
+
+
+#--------------TEST HARNESS------------#
+if __name__ == "__main__":
+    rec = Telemetry(sys.argv[1])
+    print("%d rows, %d columns" % (rec.rows, len(rec.names)))
+    for name in rec.names:
+        column = rec[name]
+        if rec.rows > 0:
+            print("  %-16s %12.5g .. %12.5g" % (name, column.min(), column.max()))
+        else:
+            print("  %s" % name)
+#---------------------------------------#